@@ -0,0 +1,1424 @@
+#include <stdlib.h> // malloc, calloc
+#include <string.h> // memset, memcpy
+#include "blocks.h"
+
+#include "zinflate.h" // For CSW compression
+
+// Where a decoder is up to within its block
+enum phases
+{
+    PH_PILOT,
+    PH_SYNC,
+    PH_DATA,
+    PH_PAUSE,
+    PH_PAUSE_EDGE,
+    PH_PAUSE_LOW,
+    PH_PAUSE_REST
+};
+
+uint32_t parse_uint(uint8_t ptr[], int width)
+{
+    uint32_t value = 0;
+    for (int x = 0; x < width; x++)
+        value |= (ptr[x] << (x * 8));
+
+    return value;
+}
+
+// Hold the level for the remaining cycles, across several words if need be
+static bool send_hold(t_decoder *d, t_pulse_sink *s)
+{
+    while (d->hold > PULSE_MAX)
+    {
+        if (pulse_space(s) < 2)
+            return false;
+
+        // Longest word, then a zero word to flip straight back
+        uint64_t cycles = PULSE_MAX;
+        int64_t rest = (int64_t)(d->hold - cycles) - ASM_FLIP;
+        // Leave enough for the final word to hold - just over PULSE_MAX leaves less than nothing
+        if (rest < ASM_OFFSET + 1)
+        {
+            cycles -= ASM_OFFSET + 1 - rest;
+            rest = ASM_OFFSET + 1;
+        }
+        send_cycles(s, cycles);
+        send_pulse(s, 0);
+        d->hold = rest;
+    }
+
+    if (d->hold > 0)
+    {
+        if (pulse_space(s) == 0)
+            return false;
+
+        // Nothing is shorter than the PIO's own overhead
+        send_cycles(s, (d->hold > ASM_OFFSET) ? d->hold : ASM_OFFSET + 1);
+        d->hold = 0;
+    }
+    return true;
+}
+
+/*
+ * From TZX specification:
+ * "A Pause block consists of a low pulse level...
+ * ... To ensure that the last edge produced is properly
+ * finished there should be at least 1ms pause of the
+ * opposite level, after that the pulse should go low."
+ */
+static bool send_pause(t_decoder *d, t_pulse_sink *s)
+{
+    if (d->phase == PH_PAUSE)
+    {
+        if (d->blk.pause == 0)
+            return true;
+
+        // 1ms at the level the last edge went to
+        d->hold = (uint64_t)(FREQ / 1000) * PULSE_SCALE;
+        d->phase = PH_PAUSE_EDGE;
+    }
+
+    if (d->phase == PH_PAUSE_EDGE)
+    {
+        if (!send_hold(d, s))
+            return false;
+        d->hold = (uint64_t)(d->blk.pause - 1) * (FREQ / 1000) * PULSE_SCALE;
+        d->phase = PH_PAUSE_LOW;
+    }
+
+    if (d->phase == PH_PAUSE_LOW)
+    {
+        if (d->hold == 0)
+            return true;
+        if (pulse_space(s) == 0)
+            return false;
+
+        // Then the rest of the pause LOW - the flip is part of the pause
+        if (s->level == 1)
+        {
+            send_pulse(s, 0);
+            d->hold -= ASM_FLIP;
+        }
+        d->phase = PH_PAUSE_REST;
+    }
+
+    return send_hold(d, s);
+}
+
+// Send the remaining count of a tone of fixed length, true when complete
+static bool send_pure_tone(t_decoder *d, t_pulse_sink *s, uint16_t duration)
+{
+    uint32_t n = pulse_space(s);
+    if (n > d->count)
+        n = d->count;
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        send_pulse(s, duration);
+    }
+    d->count -= n;
+
+    return d->count == 0;
+}
+
+// Send a stream of pulses of set lengths - Pulse Sequence blocks
+static bool send_pulse_array(t_decoder *d, t_pulse_sink *s)
+{
+    // Lengths are uint16_t
+    while (d->count > 0)
+    {
+        if (pulse_space(s) == 0)
+            return false;
+
+        send_pulse(s, tape_uint(d->tape, d->addr, 2));
+        d->addr += 2;
+        d->count--;
+    }
+    return true;
+}
+
+// Load the next (up to) 32 samples of a raw recording, MSB first
+static void load_raw_word(t_decoder *d)
+{
+    uint32_t bytes = (d->end - d->addr < 4) ? d->end - d->addr : 4;
+
+    d->raw_word = 0;
+    for (uint32_t x = 0; x < bytes; x++)
+        d->raw_word |= (uint32_t)tape_byte(d->tape, d->addr++) << (24 - x * 8);
+    d->raw_left = bytes * 8;
+
+    // Only some of the last byte may be used
+    if ((d->addr == d->end) && (d->blk.used_bits < 8))
+        d->raw_left -= 8 - d->blk.used_bits;
+}
+
+/*
+ * Used for raw recordings. Runs are found a word at a time rather than a
+ * bit at a time: the samples are XORed with the level being held, so the
+ * first set bit is where the level changes, and counting leading zeros
+ * gives the length of the run up to it. A run can span many words (a long
+ * silence is one run), and is held across several pulses if need be.
+ */
+static bool send_raw_block(t_decoder *d, t_pulse_sink *s)
+{
+    for (;;)
+    {
+        // Finish the run already found
+        if (!send_hold(d, s))
+            return false;
+
+        if (d->raw_left == 0)
+        {
+            if (d->addr >= d->end)
+                break;
+            load_raw_word(d);
+            continue;
+        }
+
+        // Samples that differ from the level held, within those left
+        uint32_t diff = (d->raw_word ^ -(uint32_t)d->prev_bit) & (0xFFFFFFFF << (32 - d->raw_left));
+        if (diff == 0)
+        {
+            // The run goes on into the next word
+            d->ticks += d->raw_left;
+            d->raw_left = 0;
+            continue;
+        }
+
+        uint8_t run = __builtin_clz(diff);
+        d->ticks += run;
+        d->hold = (uint64_t)d->ticks * d->blk.sample_ticks * PULSE_SCALE;
+        d->ticks = 0;
+        d->prev_bit ^= 1;
+        d->raw_word <<= run;
+        d->raw_left -= run;
+    }
+
+    // The last run ends with the data
+    d->hold = (uint64_t)d->ticks * d->blk.sample_ticks * PULSE_SCALE;
+    d->ticks = 0;
+    return send_hold(d, s);
+}
+
+static bool send_standard_block(t_decoder *d, t_pulse_sink *s)
+{
+    t_block_desc *blk = &d->blk;
+
+    // Pilot tone
+    if (d->phase == PH_PILOT)
+    {
+        if (!send_pure_tone(d, s, blk->p_pulse))
+            return false;
+        d->phase = PH_SYNC;
+    }
+
+    // Sync - just two pulses
+    if (d->phase == PH_SYNC)
+    {
+        if (pulse_space(s) < 2)
+            return false;
+        send_pulse(s, blk->sync_a);
+        send_pulse(s, blk->sync_b);
+        d->phase = PH_DATA;
+    }
+
+    /*
+     * Payload
+     */
+    // Whole bytes are two nibbles from the table - 16 words, so no change of level
+    uint32_t whole = (blk->used_bits != 8) ? d->end - 1 : d->end;
+    uint32_t room = pulse_space(s) / 16;
+    while ((d->addr < whole) && (room-- > 0))
+    {
+        uint8_t data = tape_byte(d->tape, d->addr++);
+        pulse_t *out = &s->buf[s->pos];
+        memcpy(out, d->nibble[data >> 4], 8 * sizeof(pulse_t));
+        memcpy(out + 8, d->nibble[data & 0x0F], 8 * sizeof(pulse_t));
+        s->pos += 16;
+    }
+
+    // Process the bytes one bit at a time - just the last, if it is partly used
+    while (d->addr < d->end)
+    {
+        // Each byte is 16 pulses
+        if (pulse_space(s) < 16)
+            return false;
+
+        // Process the bits in the byte, MSB first..
+        int last_bit = 0;
+        if ((d->addr == d->end - 1) && (blk->used_bits != 8))
+        {
+            last_bit = 8 - blk->used_bits;
+        }
+
+        uint8_t data = tape_byte(d->tape, d->addr++);
+        for (int y = 8; --y >= last_bit;)
+        {
+            // Play the appropriate wave for 1 or 0
+            if ((data >> y) & 0x1)
+            {
+                send_pulse(s, blk->bit_1);
+                send_pulse(s, blk->bit_1);
+            }
+            else
+            {
+                send_pulse(s, blk->bit_0);
+                send_pulse(s, blk->bit_0);
+            }
+        }
+    }
+    return true;
+}
+
+// Expand every nibble into its pulse words, so bytes are just two copies
+static void begin_standard_block(t_decoder *d)
+{
+    pulse_t bit[2] = {pulse_word(d->blk.bit_0), pulse_word(d->blk.bit_1)};
+
+    for (int n = 0; n < 16; n++)
+    {
+        for (int y = 0; y < 4; y++)
+        {
+            pulse_t w = bit[(n >> (3 - y)) & 0x1];
+            d->nibble[n][2 * y] = w;
+            d->nibble[n][2 * y + 1] = w;
+        }
+    }
+}
+
+/*
+ * (1) Normal RLE of 5 short pulses:
+ *  03 05 01 04 07
+ * ___-----_----_
+ *
+ *  A pulse longer than 0xFF / 255 samples:
+ *  - start with 0x00
+ *  - then 4 bytes 00 60 BF 93 01 = 600 secs @ 44100Hz
+ *
+ * (2) Z-RLE is RLE but compressed with zlib deflate
+ *
+ * Either way the RLE is read as the pulses are sent, so memory use does not
+ * depend on the size of the block.
+ */
+static void begin_csw_block(t_decoder *d)
+{
+    d->count = d->blk.d_total;
+    if (d->blk.sample_rate == 0)
+        d->count = 0;
+
+    if (d->blk.compression > 1)
+    {
+        // Z-RLE - inflate as we go, give up on the block if it won't start
+        d->zinf = malloc(sizeof(t_zinflate));
+        if ((d->zinf == NULL) || (zinf_init(d->zinf, d->tape, d->addr, d->end - d->addr) < 0))
+        {
+            block_end(d);
+            d->count = 0;
+        }
+    }
+}
+
+// Next RLE byte, -1 at the end of the data
+static int csw_byte(t_decoder *d)
+{
+    if (d->zinf != NULL)
+    {
+        uint8_t c;
+        return zinf_read(d->zinf, &c, 1) ? c : -1;
+    }
+
+    if (d->addr >= d->end)
+        return -1;
+    return tape_byte(d->tape, d->addr++);
+}
+
+// Next pulse length in samples, false at the end of the data
+static bool csw_sample(t_decoder *d, uint32_t *samples)
+{
+    int c = csw_byte(d);
+    if (c < 0)
+        return false;
+    if (c != 0x00)
+    {
+        *samples = c;
+        return true;
+    }
+
+    // Long pulse: the next four bytes
+    uint32_t value = 0;
+    for (int x = 0; x < 4; x++)
+    {
+        if ((c = csw_byte(d)) < 0)
+            return false;
+        value |= (uint32_t)c << (x * 8);
+    }
+    *samples = value;
+    return true;
+}
+
+static bool send_csw_block(t_decoder *d, t_pulse_sink *s)
+{
+    while (true)
+    {
+        // Long pulses go out as a hold over several words
+        if (!send_hold(d, s))
+            return false;
+
+        uint32_t samples;
+        if ((d->count == 0) || !csw_sample(d, &samples))
+            return true;
+        d->count--;
+
+        // In cycles, carrying the remainder over so rounding never drifts
+        uint64_t cycles = (uint64_t)samples * FREQ * PULSE_SCALE + d->frac;
+        d->hold = cycles / d->blk.sample_rate;
+        d->frac = cycles % d->blk.sample_rate;
+    }
+}
+
+// Symbols in an alphabet - a count of zero means 256
+static uint16_t gen_symbols(uint8_t count)
+{
+    return count ? count : 256;
+}
+
+// Compile a symbol definition table: flags, and a run of words for the pulses
+static void read_symbols(t_decoder *d, t_gen_sym *syms, uint16_t symbols, uint8_t max_pulses, uint32_t *used)
+{
+    // For each symbol in the alphabet
+    for (uint16_t x = 0; x < symbols; x++)
+    {
+        t_gen_sym *sym = &syms[x];
+        // Get the flags for the symbol
+        sym->flags = tape_byte(d->tape, d->addr++) & 0x03;
+        sym->at = *used;
+        sym->len = 0;
+
+        // Get the pulse sequence for the symbol - a zero length pulse ends it
+        bool ended = false;
+        for (uint8_t y = 0; y < max_pulses; y++)
+        {
+            uint16_t duration = tape_uint(d->tape, d->addr, 2);
+            d->addr += 2;
+            if (duration == 0)
+                ended = true;
+            if (!ended)
+            {
+                d->sym_words[(*used)++] = pulse_word(duration);
+                sym->len++;
+            }
+        }
+    }
+}
+
+// Send a symbol, after any level change its flags call for
+static inline void send_symbol(t_decoder *d, t_pulse_sink *s, const t_gen_sym *sym)
+{
+    /*
+     *   Signal Level Change
+     *   0 = opposite current state (do nothing)
+     *   1 = hold current state
+     *   2 = force low
+     *   3 = force high
+     */
+    switch (sym->flags)
+    {
+    case 0x01:
+        // Get it back to what it was last
+        send_pulse(s, 0);
+        break;
+    case 0x02:
+        // Next pulse would be HIGH, need LOW
+        if (s->level == 1)
+            send_pulse(s, 0);
+        break;
+    case 0x03:
+        // Next pulse would be LOW, need HIGH
+        if (s->level == 0)
+            send_pulse(s, 0);
+        break;
+    default:
+        break;
+    }
+    send_words(s, &d->sym_words[sym->at], sym->len);
+}
+
+/*
+ * With 1 or 2 bits per symbol, and no symbol that depends on the level,
+ * each nibble of data always plays the same run of words. Those are
+ * built up front, so a byte of data is two copies rather than 4-8 symbols.
+ */
+static void begin_gen_runs(t_decoder *d)
+{
+    if ((d->bit_size != 1) && (d->bit_size != 2))
+        return;
+
+    uint8_t per = 4 / d->bit_size;
+    uint8_t mask = (1 << d->bit_size) - 1;
+
+    uint16_t most = 0;
+    for (uint16_t x = 0; x <= mask; x++)
+    {
+        t_gen_sym *sym = &d->d_syms[x];
+        if (sym->flags >= 0x02)
+            return;
+        uint16_t len = sym->len + sym->flags;
+        if (len > most)
+            most = len;
+    }
+    if (16 * per * most > GEN_RUN_WORDS)
+        return;
+
+    d->run_words = malloc(sizeof(pulse_t) * 16 * per * most);
+    if (d->run_words == NULL)
+        return;
+
+    uint16_t used = 0;
+    d->run_max = 0;
+    for (uint8_t n = 0; n < 16; n++)
+    {
+        d->runs[n].at = used;
+        // Symbols in the nibble, MSB first
+        for (uint8_t k = 0; k < per; k++)
+        {
+            t_gen_sym *sym = &d->d_syms[(n >> (4 - (k + 1) * d->bit_size)) & mask];
+            // No edge is a zero word, whatever the level
+            if (sym->flags == 0x01)
+                d->run_words[used++] = 0;
+            memcpy(&d->run_words[used], &d->sym_words[sym->at], sym->len * sizeof(pulse_t));
+            used += sym->len;
+        }
+        d->runs[n].len = used - d->runs[n].at;
+        if (d->runs[n].len > d->run_max)
+            d->run_max = d->runs[n].len;
+    }
+}
+
+static void begin_gen_block(t_decoder *d)
+{
+    t_block_desc *blk = &d->blk;
+    uint16_t p_symbols = gen_symbols(blk->p_symbols);
+    uint16_t d_symbols = gen_symbols(blk->d_symbols);
+
+    // For the data playback which is **bit-based**
+    d->bit_size = 0; // 0-8 bits, enough to number every symbol
+    while ((1u << d->bit_size) < d_symbols)
+        d->bit_size++;
+    d->bit_cache = 0; // holds bits left over
+    d->bit_left = 0;  // how many bits left over
+
+    // Codes past the end of the data alphabet play nothing
+    uint16_t n_p = (blk->p_total > 0) ? p_symbols : 0;
+    uint16_t n_d = (blk->d_total > 0) ? (1u << d->bit_size) : 0;
+    d->syms = calloc(n_p + n_d + 1, sizeof(t_gen_sym));
+    d->sym_words = malloc(sizeof(pulse_t) * (n_p * blk->p_max_pulses + n_d * blk->d_max_pulses + 1));
+    if ((d->syms == NULL) || (d->sym_words == NULL))
+    {
+        // Nothing to play
+        d->phase = PH_DATA;
+        d->count = 0;
+        return;
+    }
+
+    uint32_t used = 0;
+    uint32_t p_rle = 0;
+
+    // Symbols Def - Pilot/Sync, followed by the RLE of the pilot/sync
+    if (blk->p_total > 0)
+    {
+        d->p_syms = d->syms;
+        read_symbols(d, d->p_syms, p_symbols, blk->p_max_pulses, &used);
+        p_rle = d->addr;
+        d->addr += 3 * blk->p_total;
+    }
+
+    // Symbols Def - Data, followed by the bit stream
+    if (blk->d_total > 0)
+    {
+        d->d_syms = d->syms + n_p;
+        read_symbols(d, d->d_syms, d_symbols, blk->d_max_pulses, &used);
+        begin_gen_runs(d);
+    }
+    // Note where the data bit stream starts
+    d->end = d->addr;
+
+    if (blk->p_total > 0)
+    {
+        // Pilot goes first, then on to the data
+        d->phase = PH_PILOT;
+        d->count = blk->p_total;
+        d->addr = p_rle;
+    }
+    else
+    {
+        d->phase = PH_DATA;
+        d->count = blk->d_total;
+    }
+}
+
+static bool send_gen_block(t_decoder *d, t_pulse_sink *s)
+{
+    t_block_desc *blk = &d->blk;
+
+    /*
+     * Generalised Pilot / Sync Playback
+     */
+    while (d->phase == PH_PILOT)
+    {
+        if (d->repeat == 0)
+        {
+            // Next RLE entry - or on to the data
+            if (d->count == 0)
+            {
+                d->phase = PH_DATA;
+                d->addr = d->end;
+                d->count = blk->d_total;
+                break;
+            }
+            d->count--;
+
+            // Get the symbol value
+            d->symdef = tape_byte(d->tape, d->addr++);
+            // Get the repeat value
+            d->repeat = tape_uint(d->tape, d->addr, 2);
+            d->addr += 2;
+
+            // Not in the alphabet - skip it
+            if (d->symdef >= gen_symbols(blk->p_symbols))
+                d->repeat = 0;
+            continue;
+        }
+
+        // Repeat the pilot / sync symbol as many times as there is room for
+        const t_gen_sym *sym = &d->p_syms[d->symdef];
+        uint32_t n = pulse_space(s) / (sym->len + 1u);
+        if (n == 0)
+            return false;
+        if (n > d->repeat)
+            n = d->repeat;
+        d->repeat -= n;
+        while (n-- > 0)
+            send_symbol(d, s, sym);
+    }
+
+    /*
+     * Generalised Data Playback
+     */
+    // Data is different - it's done by bits, not bytes and no RLE repeating
+    uint8_t per_byte = d->bit_size ? 8 / d->bit_size : 0;
+    while (d->count > 0)
+    {
+        // A byte at a time from the nibble runs, while on a byte boundary
+        if ((d->run_words != NULL) && (d->bit_left == 0) && (d->count >= per_byte))
+        {
+            if (pulse_space(s) < 2u * d->run_max)
+                return false;
+
+            uint8_t data = tape_byte(d->tape, d->addr++);
+            send_words(s, &d->run_words[d->runs[data >> 4].at], d->runs[data >> 4].len);
+            send_words(s, &d->run_words[d->runs[data & 0x0F].at], d->runs[data & 0x0F].len);
+            d->count -= per_byte;
+            continue;
+        }
+
+        // Room for the whole sequence and a level change
+        if (pulse_space(s) < blk->d_max_pulses + 1u)
+            return false;
+
+        // If we don't have enough bits to look up the symbol
+        if (d->bit_left < d->bit_size)
+        {
+            // Shift up the previous value
+            d->bit_cache <<= 8;
+            // Pull in another 8 bits
+            d->bit_cache |= tape_byte(d->tape, d->addr++);
+            // state we've added more bits
+            d->bit_left += 8;
+        }
+        // Adjust the bit_left in advance, as we use it now
+        d->bit_left -= d->bit_size;
+        // Shift & mask the bits into focus - this will look up the symbol
+        uint8_t symdef = (d->bit_cache >> d->bit_left) & ((1 << d->bit_size) - 1);
+        send_symbol(d, s, &d->d_syms[symdef]);
+
+        // Mask only the bits left
+        d->bit_cache &= ((1 << d->bit_left) - 1);
+        // count - decrement the number of data points
+        d->count--;
+    }
+    return true;
+}
+
+/*
+ * PZX pulses are durations in t-states, so each one is a pulsegen word as
+ * it stands, less ASM_OFFSET - nothing is decoded, only copied. Levels are
+ * given outright instead of flipped: pulses start low, and a pulse of no
+ * length changes the level without taking any time. The zero word for that
+ * is only sent once a pulse at the new level follows, so zero-length pulses
+ * in a row cost nothing.
+ */
+static inline void pzx_flip(t_decoder *d, t_pulse_sink *s)
+{
+    if (s->level != d->want)
+        send_pulse(s, 0);
+}
+
+// Send a pulse at the level wanted - room for 2 words, or one too long for a word is left in hold
+static void pzx_pulse(t_decoder *d, t_pulse_sink *s, uint32_t duration)
+{
+    if (duration == 0)
+    {
+        d->want ^= 1;
+        return;
+    }
+
+    pzx_flip(d, s);
+    d->want ^= 1;
+    uint64_t cycles = (uint64_t)duration * PULSE_SCALE;
+    if (cycles > PULSE_MAX)
+        d->hold = cycles;
+    else
+        // Nothing is shorter than the PIO's own overhead
+        send_cycles(s, (cycles > ASM_OFFSET) ? cycles : ASM_OFFSET + 1);
+}
+
+/*
+ * Single pulses of under 0x8000 t-states, at the level they are wanted,
+ * are most of a PULS block: they go straight from the tape window into the
+ * sink, as many as are in the window and fit
+ */
+static void pzx_plain_pulses(t_decoder *d, t_pulse_sink *s)
+{
+    t_tape *t = d->tape;
+    if ((s->level != d->want) || (d->addr - t->base >= t->len))
+        return;
+
+    uint32_t avail = t->base + t->len - d->addr;
+    if (avail > d->end - d->addr)
+        avail = d->end - d->addr;
+    const uint8_t *in = t->data + (d->addr - t->base);
+    uint32_t room = pulse_space(s);
+    uint32_t n = 0;
+
+    for (; (n < room) && (2 * n + 2 <= avail); n++)
+    {
+        uint32_t duration = in[2 * n] | (in[2 * n + 1] << 8);
+        if ((duration == 0) || (duration >= 0x8000) || (duration * PULSE_SCALE <= ASM_OFFSET))
+            break;
+        s->buf[s->pos + n] = duration * PULSE_SCALE - ASM_OFFSET;
+    }
+
+    s->pos += n;
+    s->level ^= n & 1;
+    d->want ^= n & 1;
+    d->addr += 2 * n;
+}
+
+// PZX pulse sequence (PULS): runs of the same pulse
+static bool send_pzx_pulses(t_decoder *d, t_pulse_sink *s)
+{
+    for (;;)
+    {
+        // Finish a pulse too long for one word
+        if (!send_hold(d, s))
+            return false;
+
+        if (d->count == 0)
+        {
+            pzx_plain_pulses(d, s);
+            if (d->addr + 2 > d->end)
+                return true;
+            if (pulse_space(s) < 2)
+                return false;
+
+            // A repeat count if it is given, then a duration of 15 bits, or 31 in two halves
+            uint32_t value = tape_uint(d->tape, d->addr, 2);
+            d->addr += 2;
+            d->count = 1;
+            if (value > 0x8000)
+            {
+                d->count = value & 0x7FFF;
+                value = tape_uint(d->tape, d->addr, 2);
+                d->addr += 2;
+            }
+            if (value >= 0x8000)
+            {
+                value = ((value & 0x7FFF) << 16) | tape_uint(d->tape, d->addr, 2);
+                d->addr += 2;
+            }
+            d->duration = value;
+            continue;
+        }
+
+        // Only the level changes
+        if (d->duration == 0)
+        {
+            d->want ^= d->count & 1;
+            d->count = 0;
+            continue;
+        }
+
+        if (pulse_space(s) < 2)
+            return false;
+        pzx_pulse(d, s, d->duration);
+        d->count--;
+
+        // The rest of a run of short ones are copies of the same word
+        if (d->hold == 0)
+        {
+            uint32_t n = pulse_space(s);
+            if (n > d->count)
+                n = d->count;
+            pulse_t word = s->buf[s->pos - 1];
+            for (uint32_t i = 0; i < n; i++)
+                s->buf[s->pos++] = word;
+            s->level ^= n & 1;
+            d->want ^= n & 1;
+            d->count -= n;
+        }
+    }
+}
+
+/*
+ * PZX data (DATA): each bit is its own sequence of pulses, for a 0 or a 1.
+ * Two pulses a bit, as most loaders use, go through a nibble table like
+ * standard data, so a byte is two copies. The data starts at the level
+ * given, and a tail pulse follows the last bit
+ */
+static void begin_pzx_data(t_decoder *d)
+{
+    t_block_desc *blk = &d->blk;
+    uint16_t pulses = blk->pulses_0 + blk->pulses_1;
+
+    d->want = blk->level;
+    d->count = blk->d_total;
+    d->phase = PH_PILOT;
+
+    // The bits follow the two sequences - only as many as are in the block
+    uint32_t start = d->addr;
+    d->addr += 2 * pulses;
+    if (d->addr > d->end)
+        d->addr = d->end;
+    if (d->count > (d->end - d->addr) * 8)
+        d->count = (d->end - d->addr) * 8;
+
+    bool table = (blk->pulses_0 == 2) && (blk->pulses_1 == 2);
+    for (int i = 0; table && (i < 4); i++)
+        table = tape_uint(d->tape, start + 2 * i, 2) * PULSE_SCALE > ASM_OFFSET;
+    if (table)
+    {
+        pulse_t bit[2][2];
+        for (int i = 0; i < 4; i++)
+            bit[i / 2][i % 2] = pulse_word(tape_uint(d->tape, start + 2 * i, 2));
+
+        for (int n = 0; n < 16; n++)
+        {
+            for (int y = 0; y < 4; y++)
+            {
+                int b = (n >> (3 - y)) & 0x1;
+                d->nibble[n][2 * y] = bit[b][0];
+                d->nibble[n][2 * y + 1] = bit[b][1];
+            }
+        }
+        return;
+    }
+
+    d->bit_pulses = malloc((pulses ? pulses : 1) * sizeof(uint16_t));
+    if (d->bit_pulses == NULL)
+    {
+        d->count = 0;
+        return;
+    }
+    for (uint16_t i = 0; i < pulses; i++)
+        d->bit_pulses[i] = tape_uint(d->tape, start + 2 * i, 2);
+}
+
+static bool send_pzx_data(t_decoder *d, t_pulse_sink *s)
+{
+    t_block_desc *blk = &d->blk;
+
+    // Get to the level the data starts at
+    if (d->phase == PH_PILOT)
+    {
+        if (pulse_space(s) == 0)
+            return false;
+        pzx_flip(d, s);
+        d->phase = PH_DATA;
+    }
+
+    // Whole bytes from the nibble table - 16 words, so no change of level
+    if (d->bit_pulses == NULL)
+    {
+        uint32_t room = pulse_space(s) / 16;
+        while ((d->bit_left == 0) && (d->count >= 8) && (room-- > 0))
+        {
+            uint8_t data = tape_byte(d->tape, d->addr++);
+            pulse_t *out = &s->buf[s->pos];
+            memcpy(out, d->nibble[data >> 4], 8 * sizeof(pulse_t));
+            memcpy(out + 8, d->nibble[data & 0x0F], 8 * sizeof(pulse_t));
+            s->pos += 16;
+            d->count -= 8;
+        }
+    }
+
+    // The rest a bit at a time, MSB first
+    uint32_t most = (blk->pulses_0 > blk->pulses_1) ? blk->pulses_0 : blk->pulses_1;
+    while (d->count > 0)
+    {
+        // Room for the sequence, and a level change
+        if (pulse_space(s) < most + 1)
+            return false;
+
+        if (d->bit_left == 0)
+        {
+            d->bit_cache = tape_byte(d->tape, d->addr++);
+            d->bit_left = 8;
+        }
+        d->bit_left--;
+        uint8_t bit = (d->bit_cache >> d->bit_left) & 0x1;
+        d->count--;
+
+        if (d->bit_pulses == NULL)
+        {
+            send_words(s, d->nibble[bit ? 15 : 0], 2);
+            continue;
+        }
+        const uint16_t *seq = bit ? &d->bit_pulses[blk->pulses_0] : d->bit_pulses;
+        for (uint8_t i = 0; i < (bit ? blk->pulses_1 : blk->pulses_0); i++)
+            pzx_pulse(d, s, seq[i]);
+    }
+
+    if (blk->tail > 0)
+    {
+        if (pulse_space(s) < 2)
+            return false;
+        pzx_pulse(d, s, blk->tail);
+        blk->tail = 0;
+    }
+    return true;
+}
+
+// PZX pause (PAUS): the level given, for the time given - the change of level is part of it
+static bool send_pzx_pause(t_decoder *d, t_pulse_sink *s)
+{
+    if (d->phase == PH_PILOT)
+    {
+        if ((d->hold > 0) && (s->level != d->want))
+        {
+            if (pulse_space(s) == 0)
+                return false;
+            send_pulse(s, 0);
+            d->hold -= (d->hold > ASM_FLIP) ? ASM_FLIP : d->hold;
+        }
+        d->phase = PH_DATA;
+    }
+    return send_hold(d, s);
+}
+
+void block_begin(t_decoder *d, const t_block_desc *blk, t_tape *t, uint32_t addr)
+{
+    memset(d, 0, sizeof(*d));
+    d->blk = *blk;
+    d->tape = t;
+    d->addr = addr;
+    d->end = addr + blk->len;
+
+    switch (blk->type)
+    {
+    case BLK_STD:
+    case BLK_TURBO:
+        d->phase = PH_PILOT;
+        d->count = blk->p_total;
+        begin_standard_block(d);
+        break;
+    case BLK_PDATA:
+        // Pure Data has no pilot or sync
+        d->phase = PH_DATA;
+        begin_standard_block(d);
+        break;
+    case BLK_TONE:
+    case BLK_PULSES:
+        d->count = blk->len;
+        break;
+    case BLK_CSW:
+        begin_csw_block(d);
+        break;
+    case BLK_GENERAL:
+        begin_gen_block(d);
+        break;
+    case BLK_DIRECT:
+        // The first run is at the level of the first sample
+        if (d->addr < d->end)
+            d->prev_bit = tape_byte(t, addr) >> 7;
+        break;
+    case BLK_PZX_PULSES:
+        // Pulses start low
+        d->want = 0;
+        break;
+    case BLK_PZX_DATA:
+        begin_pzx_data(d);
+        break;
+    case BLK_PZX_PAUSE:
+        d->phase = PH_PILOT;
+        d->want = blk->level;
+        d->hold = (uint64_t)blk->d_total * PULSE_SCALE;
+        break;
+    default:
+        break;
+    }
+}
+
+// A short pilot and the sync from here, odd or even as the pilot pulses left, so the data keeps its level
+static void restart_pilot(t_decoder *d, uint32_t left)
+{
+    d->count = (d->blk.p_total < SPEED_PILOT_MIN) ? d->blk.p_total : SPEED_PILOT_MIN;
+    if ((d->count & 1) != (left & 1))
+        d->count = d->count ? d->count - 1 : 1;
+    d->phase = PH_PILOT;
+}
+
+bool block_seek(t_decoder *d, t_pulse_sink *s, uint64_t *cycles)
+{
+    if ((d->blk.type != BLK_STD) && (d->blk.type != BLK_TURBO) && (d->blk.type != BLK_PDATA))
+        return false;
+
+    // The pilot and sync, or what is left of them - if it lands in them, the pilot starts again
+    if ((d->phase == PH_PILOT) || (d->phase == PH_SYNC))
+    {
+        uint32_t pilot = (d->phase == PH_PILOT) ? d->count : 0;
+        uint64_t lead = (uint64_t)pilot * pulse_cycles(pulse_word(d->blk.p_pulse)) +
+                        pulse_cycles(pulse_word(d->blk.sync_a)) + pulse_cycles(pulse_word(d->blk.sync_b));
+        if (lead > *cycles)
+        {
+            restart_pilot(d, pilot);
+            *cycles = 0;
+            return true;
+        }
+
+        // Past them, at the level they leave
+        *cycles -= lead;
+        s->level ^= pilot & 1;
+        d->phase = PH_DATA;
+    }
+    if (d->phase != PH_DATA)
+        return false;
+
+    // Whole bytes, with no need to decode them - each is 16 words, so the level is the same after
+    uint32_t whole = (d->blk.used_bits != 8) ? d->end - 1 : d->end;
+    uint32_t bit_0 = 2 * pulse_cycles(d->nibble[0][0]);
+    uint32_t bit_1 = 2 * pulse_cycles(d->nibble[15][0]);
+    while (d->addr < whole)
+    {
+        uint8_t ones = __builtin_popcount(tape_byte(d->tape, d->addr));
+        uint32_t byte = ones * bit_1 + (8 - ones) * bit_0;
+        if (byte > *cycles)
+            break;
+        *cycles -= byte;
+        d->addr++;
+    }
+    if (d->addr == whole)
+        return false;
+
+    // Lands in this byte - it starts again from here, after a short pilot and the sync
+    *cycles = 0;
+    if (d->blk.type != BLK_PDATA)
+        restart_pilot(d, 0);
+    return true;
+}
+
+bool block_fill(t_decoder *d, t_pulse_sink *s)
+{
+    bool done = true;
+
+    if (d->phase < PH_PAUSE)
+    {
+        switch (d->blk.type)
+        {
+        case BLK_STD:
+        case BLK_TURBO:
+        case BLK_PDATA:
+            done = send_standard_block(d, s);
+            break;
+        case BLK_TONE:
+            done = send_pure_tone(d, s, d->blk.bit_0);
+            break;
+        case BLK_PULSES:
+            done = send_pulse_array(d, s);
+            break;
+        case BLK_DIRECT:
+            done = send_raw_block(d, s);
+            break;
+        case BLK_CSW:
+            done = send_csw_block(d, s);
+            break;
+        case BLK_GENERAL:
+            done = send_gen_block(d, s);
+            break;
+        case BLK_PZX_PULSES:
+            done = send_pzx_pulses(d, s);
+            break;
+        case BLK_PZX_DATA:
+            done = send_pzx_data(d, s);
+            break;
+        case BLK_PZX_PAUSE:
+            done = send_pzx_pause(d, s);
+            break;
+        default:
+            break;
+        }
+
+        if (!done)
+            return false;
+
+        // Data is out, the pause follows
+        d->phase = PH_PAUSE;
+    }
+
+    if (!send_pause(d, s))
+        return false;
+
+    block_end(d);
+    return true;
+}
+
+void block_end(t_decoder *d)
+{
+    if (d->zinf != NULL)
+        zinf_end(d->zinf);
+    free(d->zinf);
+    free(d->syms);
+    free(d->sym_words);
+    free(d->run_words);
+    free(d->bit_pulses);
+    d->zinf = NULL;
+    d->syms = NULL;
+    d->sym_words = NULL;
+    d->run_words = NULL;
+    d->bit_pulses = NULL;
+}
+
+/*
+ * Block header layouts
+ *
+ * Every block is a fixed header (including the ID) followed by a variable
+ * part, whose length is a field in the header counted in units of bytes.
+ * The table is indexed by ID, so an unknown ID has a size of 0.
+ */
+typedef struct t_block_fmt
+{
+    uint8_t size;      // Fixed header, including the ID
+    uint8_t len_at;    // Length of the variable part - where it is,
+    uint8_t len_width; // how wide it is (0 if there is none)
+    uint8_t len_unit;  // and how many bytes each one counts for
+} t_block_fmt;
+
+static const t_block_fmt block_fmts[256] = {
+    [BLK_TAP] = {2, 0, 2, 1},
+
+    // Data blocks
+    [BLK_STD] = {5, 3, 2, 1},
+    [BLK_TURBO] = {19, 16, 3, 1},
+    [BLK_TONE] = {5, 0, 0, 0},
+    [BLK_PULSES] = {2, 1, 1, 2},
+    [BLK_PDATA] = {11, 8, 3, 1},
+    [BLK_DIRECT] = {9, 6, 3, 1},
+    [BLK_CSW] = {5, 1, 4, 1},
+    [BLK_GENERAL] = {5, 1, 4, 1},
+
+    // Behaviour blocks
+    [BLK_PAUSE] = {3, 0, 0, 0},
+    [BLK_GROUP_START] = {2, 1, 1, 1},
+    [BLK_GROUP_END] = {1, 0, 0, 0},
+    [BLK_JUMP] = {3, 0, 0, 0},
+    [BLK_LOOP_START] = {3, 0, 0, 0},
+    [BLK_LOOP_END] = {1, 0, 0, 0},
+    [BLK_SEQ_CALL] = {3, 1, 2, 2},      // Array is word-based
+    [BLK_SEQ_RET] = {1, 0, 0, 0},
+    [BLK_SEL] = {3, 1, 2, 1},           // Length of BLOCK, not SELECTIONS
+    [BLK_STOP_48K] = {5, 1, 4, 1},
+    [BLK_SIG_LEVEL] = {5, 1, 4, 1},
+
+    // Info blocks
+    [BLK_TEXT] = {2, 1, 1, 1},
+    [BLK_MSG] = {3, 2, 1, 1},
+    [BLK_INFO] = {3, 1, 2, 1},          // Length of BLOCK, not TEXT
+    [BLK_HARDWARE] = {2, 1, 1, 3},      // Array of 3 bytes
+    [BLK_CUSTOM] = {21, 17, 4, 1},
+
+    // Glue block (concatenation)
+    [BLK_GLUE] = {10, 0, 0, 0},
+};
+
+uint32_t block_size(uint8_t id, uint8_t hdr[])
+{
+    const t_block_fmt *fmt = &block_fmts[id];
+
+    if (fmt->size == 0)
+        return 0;
+
+    return fmt->size + parse_uint(hdr + fmt->len_at, fmt->len_width) * fmt->len_unit;
+}
+
+uint32_t pzx_block_size(uint8_t hdr[])
+{
+    // PZX blocks all give their length the same way
+    uint32_t len = parse_uint(hdr + 4, 4);
+    return (len <= UINT32_MAX - PZX_HDR_SIZE) ? PZX_HDR_SIZE + len : 0;
+}
+
+uint8_t pzx_block_id(const uint8_t hdr[])
+{
+    static const char tags[][4] = {"PZXT", "PULS", "DATA", "PAUS", "BRWS", "STOP"};
+
+    for (uint8_t i = 0; i < sizeof(tags) / sizeof(tags[0]); i++)
+    {
+        if (!memcmp(hdr, tags[i], 4))
+            return BLK_PZX_HEADER + i;
+    }
+    // Anything else is skipped, as the format asks
+    return BLK_PZX_UNKNOWN;
+}
+
+uint8_t block_parse(uint8_t id, uint8_t hdr[], t_block_desc *blk)
+{
+    // Set block defaults
+    *blk = (t_block_desc){.type = BLK_STD, .p_pulse = 2168, .sync_a = 667, .sync_b = 735,
+                          .bit_0 = 855, .bit_1 = 1710, .used_bits = 8};
+
+    switch (id)
+    {
+    // TAP - First two bytes are the size, with a default pause
+    case BLK_TAP:
+        blk->len = parse_uint(hdr, 2);
+        blk->pause = 1000;
+
+        // Third marker byte dictates the pilot length
+        blk->p_total = (hdr[2] >= 0x80) ? 3223 : 8063;
+        return 2;
+
+    case BLK_STD:
+        // Next four bytes contain the pause and data length
+        blk->pause = parse_uint(hdr+1, 2);
+        blk->len = parse_uint(hdr+3, 2);
+
+        // Sixth marker byte dictates the pilot length
+        if (hdr[5] >= 0x80)
+            blk->p_total = 3223; // Data block (0xFF)
+        else
+            blk->p_total = 8063; // Header block (0x00)
+        return 5;
+
+    // Turbo Speed - have to define everything from the file
+    case BLK_TURBO:
+        blk->type = id;
+        blk->p_pulse = parse_uint(hdr+1, 2);
+        blk->sync_a = parse_uint(hdr+3, 2);
+        blk->sync_b = parse_uint(hdr+5, 2);
+        blk->bit_0 = parse_uint(hdr+7, 2);
+        blk->bit_1 = parse_uint(hdr+9, 2);
+        blk->p_total = parse_uint(hdr+11, 2);
+        blk->used_bits = hdr[13];
+        blk->pause = parse_uint(hdr+14, 2);
+        blk->len = parse_uint(hdr+16, 3);
+        return 19;
+
+    // Pure Tone
+    case BLK_TONE:
+        blk->type = id;
+        blk->bit_0 = parse_uint(hdr+1, 2);
+        blk->len = parse_uint(hdr+3, 2);
+        return 5;
+
+    // Pulse Sequence
+    case BLK_PULSES:
+        blk->type = id;
+        blk->len = hdr[1];
+        return 2;
+
+    // Pure Data
+    case BLK_PDATA:
+        blk->type = id;
+        blk->bit_0 = parse_uint(hdr+1, 2);
+        blk->bit_1 = parse_uint(hdr+3, 2);
+        blk->used_bits = hdr[5];
+        blk->pause = parse_uint(hdr+6, 2);
+        blk->len = parse_uint(hdr+8, 3);
+        return 11;
+
+    // Direct Recording (Sampled)
+    case BLK_DIRECT:
+        blk->type = id;
+        blk->sample_ticks = parse_uint(hdr+1, 2);
+        blk->pause = parse_uint(hdr+3, 2);
+        blk->used_bits = hdr[5];
+        blk->len = parse_uint(hdr+6, 3);
+        return 9;
+
+    // Compressed Square Wave
+    case BLK_CSW:
+        // Block length covers the 10 bytes of header that follow it - shorter than that is not a CSW block
+        if (parse_uint(hdr+1, 4) < 10)
+            return 0;
+        blk->type = id;
+        blk->len = parse_uint(hdr+1, 4) - 10;
+        blk->pause = parse_uint(hdr+5, 2);
+
+        // Sample Hz - t-states are worked out per pulse
+        blk->sample_rate = parse_uint(hdr+7, 3);
+
+        // RLE or Z-RLE, then the number of samples
+        blk->compression = hdr[10];
+        blk->d_total = parse_uint(hdr+11, 4);
+        return 15;
+
+    // Generalised - horrible mix of everything
+    case BLK_GENERAL:
+        blk->type = id;
+        blk->len = parse_uint(hdr+1, 4);
+        blk->pause = parse_uint(hdr+5, 2);
+
+        // Pilot / Sync
+        blk->p_total = parse_uint(hdr+7, 4);
+        blk->p_max_pulses = hdr[11];
+        blk->p_symbols = hdr[12];
+
+        // Data
+        blk->d_total = parse_uint(hdr+13, 4);
+        blk->d_max_pulses = hdr[17];
+        blk->d_symbols = hdr[18];
+        return 19;
+
+    // Nothing but a pause - the decoder holds it in the pulse stream
+    case BLK_PAUSE:
+        blk->type = id;
+        blk->pause = parse_uint(hdr+1, 2);
+        return 3;
+
+    // Hold the tape while the message is shown
+    case BLK_MSG:
+        blk->type = BLK_PAUSE;
+        blk->pause = hdr[1] * 1000;
+        return 2;
+
+    // PZX pulses - the payload is all pulses
+    case BLK_PZX_PULSES:
+        blk->type = id;
+        blk->len = parse_uint(hdr+4, 4);
+        return PZX_HDR_SIZE;
+
+    // PZX data - bit count and level, tail pulse, pulses in a 0 and a 1
+    case BLK_PZX_DATA:
+        blk->type = id;
+        blk->len = parse_uint(hdr+4, 4);
+        if (blk->len < 8)
+        {
+            // Too short for its own fields
+            blk->len = 0;
+            return PZX_HDR_SIZE;
+        }
+        blk->len -= 8;
+        blk->d_total = parse_uint(hdr+8, 4) & 0x7FFFFFFF;
+        blk->level = hdr[11] >> 7;
+        blk->tail = parse_uint(hdr+12, 2);
+        blk->pulses_0 = hdr[14];
+        blk->pulses_1 = hdr[15];
+        return PZX_HDR_SIZE + 8;
+
+    // PZX pause - duration in t-states, and level
+    case BLK_PZX_PAUSE:
+        blk->type = id;
+        if (parse_uint(hdr+4, 4) < 4)
+            return PZX_HDR_SIZE;
+        blk->d_total = parse_uint(hdr+8, 4) & 0x7FFFFFFF;
+        blk->level = hdr[11] >> 7;
+        return PZX_HDR_SIZE + 4;
+
+    default:
+        return 0;
+    }
+}
+
+/*
+ * Speed presets - factors for pilot, pulse, bits, pause
+ *
+ * The ROM loader reads a bit as 1 when its two edges take more than about
+ * 2300 t-states, so 80% of 3420 still reads as a 1. Turbo loaders set
+ * their own thresholds, so only their pilots and pauses are touched.
+ */
+const t_speed speed_presets[SPEED_PRESETS] = {
+    [SPEED_NORMAL] = {"normal", {
+        [SPD_ROM] = {256, 256, 256, 256},
+        [SPD_TURBO] = {256, 256, 256, 256},
+        [SPD_GAP] = {256, 256, 256, 256},
+    }},
+    [SPEED_FAST] = {"fast", {
+        [SPD_ROM] = {64, 256, 256, 64},
+        [SPD_TURBO] = {128, 256, 256, 128},
+        [SPD_GAP] = {256, 256, 256, 64},
+    }},
+    [SPEED_FASTER] = {"faster", {
+        [SPD_ROM] = {64, 256, 205, 32},
+        [SPD_TURBO] = {128, 256, 256, 128},
+        [SPD_GAP] = {256, 256, 256, 32},
+    }},
+};
+
+// value * factor / 256, rounded
+static uint32_t scale(uint32_t value, uint16_t factor)
+{
+    return ((uint64_t)value * factor + 128) >> 8;
+}
+
+// Scale a count or time, but not below floor (or the original, if less)
+static uint32_t scale_floor(uint32_t value, uint16_t factor, uint32_t floor)
+{
+    uint32_t scaled = scale(value, factor);
+    if (floor > value)
+        floor = value;
+
+    return (scaled < floor) ? floor : scaled;
+}
+
+void block_scale(uint8_t id, t_block_desc *blk, const t_speed *speed)
+{
+    const t_speed_scale *f;
+
+    switch (id)
+    {
+    case BLK_TAP:
+    case BLK_STD:
+        f = &speed->scale[SPD_ROM];
+        break;
+    case BLK_TURBO:
+    case BLK_TONE:
+    case BLK_PDATA:
+        f = &speed->scale[SPD_TURBO];
+        break;
+    case BLK_PAUSE:
+    case BLK_MSG:
+        f = &speed->scale[SPD_GAP];
+        break;
+    default:
+        return;
+    }
+
+    if (blk->type == BLK_TONE)
+    {
+        // A tone is a pilot on its own - its length is in len
+        uint32_t count = scale_floor(blk->len, f->pilot, SPEED_PILOT_MIN);
+        blk->len = count + ((count ^ blk->len) & 1);
+        blk->bit_0 = scale(blk->bit_0, f->pulse);
+        return;
+    }
+
+    // Keep the pilot odd or even, so the sync starts on the same level
+    uint32_t count = scale_floor(blk->p_total, f->pilot, SPEED_PILOT_MIN);
+    blk->p_total = count + ((count ^ blk->p_total) & 1);
+
+    blk->p_pulse = scale(blk->p_pulse, f->pulse);
+    blk->sync_a = scale(blk->sync_a, f->pulse);
+    blk->sync_b = scale(blk->sync_b, f->pulse);
+    blk->bit_0 = scale(blk->bit_0, f->bits);
+    blk->bit_1 = scale(blk->bit_1, f->bits);
+    blk->pause = scale_floor(blk->pause, f->pause, SPEED_PAUSE_MIN);
+}
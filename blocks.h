@@ -0,0 +1,278 @@
+#ifndef BLOCKS_H
+#define BLOCKS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "pulse.h"
+#include "tapeio.h"
+
+enum blocks
+{
+    // A TAP has no IDs - each of its blocks is a length then the data
+    BLK_TAP = 0x00,
+    // Data blocks
+    BLK_STD = 0x10,
+    BLK_TURBO,
+    BLK_TONE,
+    BLK_PULSES,
+    BLK_PDATA,
+    BLK_DIRECT,
+    BLK_CSW = 0x18,
+    BLK_GENERAL,
+    // Behaviour blocks
+    BLK_PAUSE = 0x20,
+    BLK_GROUP_START,
+    BLK_GROUP_END,
+    BLK_JUMP,
+    BLK_LOOP_START,
+    BLK_LOOP_END,
+    BLK_SEQ_CALL,
+    BLK_SEQ_RET,
+    BLK_SEL,
+    BLK_STOP_48K = 0x2A,
+    BLK_SIG_LEVEL,
+    // Informational blocks
+    BLK_TEXT = 0x30,
+    BLK_MSG,
+    BLK_INFO,
+    BLK_HARDWARE,
+    BLK_CUSTOM = 0x35,
+    // Concatentation block
+    BLK_GLUE = 0x5A,
+    // PZX blocks have tags rather than IDs - these are not TZX IDs, just for the index
+    BLK_PZX_HEADER = 0xE0,
+    BLK_PZX_PULSES,
+    BLK_PZX_DATA,
+    BLK_PZX_PAUSE,
+    BLK_PZX_BROWSE,
+    BLK_PZX_STOP,
+    BLK_PZX_UNKNOWN
+};
+
+// Longest fixed block header, including the ID (BLK_CUSTOM)
+#define TZX_HDR_MAX 21
+
+/*
+ * PZX blocks are a 4 byte tag and a 4 byte length, then that many bytes.
+ * The fixed part of the longest (DATA) is 8 more, so it fits in the same
+ * header as a TZX block.
+ */
+#define PZX_HDR_SIZE 8
+
+// Contains all the possible data block metadata
+typedef struct t_block_desc
+{
+    // Common data
+    uint8_t type;
+    uint32_t pause; // ms
+
+    // For standard blocks
+    uint16_t p_pulse;
+    uint16_t sync_a;
+    uint16_t sync_b;
+    uint16_t bit_0;
+    uint16_t bit_1;
+    uint8_t used_bits;
+
+    // For pulses
+    uint32_t p_total;
+    uint8_t p_max_pulses;
+    uint8_t p_symbols;
+
+    // For data
+    uint32_t d_total;
+    uint8_t d_max_pulses;
+    uint8_t d_symbols;
+
+    // Direct Recording
+    uint32_t sample_ticks;
+
+    // CSW
+    uint32_t sample_rate;
+    uint8_t compression;
+
+    // PZX data and pauses: the level they start at. Data also has the
+    // pulses in a 0 and a 1 bit, and the one after the last bit
+    uint8_t level;
+    uint8_t pulses_0;
+    uint8_t pulses_1;
+    uint16_t tail;
+
+    // Length (data or block)
+    uint32_t len;
+} t_block_desc;
+
+/*
+ * Accelerated playback
+ *
+ * Scale factors in 1/256ths (256 = as recorded) for the pilot length, the
+ * pilot / sync pulse widths, the data bit widths and the pause, for each
+ * class of block. Generalised, CSW, Direct Recording and Pulse Sequence
+ * blocks spell out every pulse, and are never scaled.
+ *
+ * Pilots keep at least SPEED_PILOT_MIN pulses (the ROM wants 256 pairs
+ * before it trusts a leader) and the same odd / even count, so the sync
+ * still starts on the same level. Pauses keep at least SPEED_PAUSE_MIN ms,
+ * for BASIC to get to the next LOAD.
+ */
+enum speed_classes
+{
+    SPD_ROM,   // Standard speed data, and TAP blocks
+    SPD_TURBO, // Turbo speed data, pure tones and pure data
+    SPD_GAP,   // Pauses and messages
+    SPD_CLASSES
+};
+
+typedef struct t_speed_scale
+{
+    uint16_t pilot;
+    uint16_t pulse;
+    uint16_t bits;
+    uint16_t pause;
+} t_speed_scale;
+
+typedef struct t_speed
+{
+    const char *name;
+    t_speed_scale scale[SPD_CLASSES];
+} t_speed;
+
+enum speed_presets
+{
+    SPEED_NORMAL, // As recorded
+    SPEED_FAST,   // Shorter pilots and pauses only
+    SPEED_FASTER, // Also ROM data bits at 80%, well clear of its 0/1 threshold
+    SPEED_PRESETS
+};
+
+#define SPEED_PILOT_MIN 1024
+#define SPEED_PAUSE_MIN 100
+
+extern const t_speed speed_presets[SPEED_PRESETS];
+
+// A Generalised symbol: how it changes the level, then its pulse words
+typedef struct t_gen_sym
+{
+    uint8_t flags;
+    uint8_t len;
+    uint32_t at; // Two alphabets of 256 symbols of 255 pulses are more than 65535 words
+} t_gen_sym;
+
+// Pulse words for one nibble of Generalised data
+typedef struct t_gen_run
+{
+    uint16_t at;
+    uint16_t len;
+} t_gen_run;
+
+// Most words kept for the nibble runs of a Generalised block
+#define GEN_RUN_WORDS 512
+
+/*
+ * Data block decoder
+ *
+ * Decoding is resumable: block_fill() stops when the sink runs short of
+ * space and carries on where it left off on the next call, so blocks are
+ * turned into pulses a chunk at a time rather than a pulse at a time.
+ *
+ * The pause after a block is part of the block, sent as timed hold words,
+ * so a block with no data (e.g. BLK_PAUSE) is just its pause.
+ */
+typedef struct t_decoder
+{
+    t_block_desc blk;
+    t_tape *tape;
+
+    // Payload read position and end
+    uint32_t addr;
+    uint32_t end;
+
+    // Progress through the block
+    uint8_t phase;
+    uint32_t count;
+
+    // PIO cycles of a hold still to send (pauses, CSW pulses)
+    uint64_t hold;
+
+    // Standard data: the 8 words for each nibble, MSB first
+    pulse_t nibble[16][8];
+
+    // Direct Recording: samples in the run so far, at level prev_bit, and
+    // the samples loaded but not looked at yet (MSB first)
+    uint32_t ticks;
+    uint8_t prev_bit;
+    uint32_t raw_word;
+    uint8_t raw_left;
+
+    // CSW: Z-RLE inflater, and cycles left over from rounding (x sample rate)
+    struct t_zinflate *zinf;
+    uint32_t frac;
+
+    // Generalised symbols, compiled into runs of pulse words
+    t_gen_sym *syms;
+    t_gen_sym *p_syms;
+    t_gen_sym *d_syms;
+    pulse_t *sym_words;
+    uint8_t symdef;
+    uint16_t repeat;
+    uint8_t bit_size;
+    uint16_t bit_cache;
+    uint8_t bit_left;
+
+    // Generalised data a nibble at a time, if it can be (run_words not NULL)
+    t_gen_run runs[16];
+    pulse_t *run_words;
+    uint16_t run_max;
+
+    // PZX: the level the next pulse is played at - a pulse of no length
+    // just changes it, and a word to flip to it is only sent if another
+    // pulse follows. The pulses being repeated, and for data the pulses
+    // of a 0 bit then a 1 bit (t-states), unless the nibble table is used
+    uint8_t want;
+    uint32_t duration;
+    uint16_t *bit_pulses;
+} t_decoder;
+
+uint32_t parse_uint(uint8_t ptr[], int width);
+
+// Bytes taken by a TZX or TAP block, from its fixed header - 0 if the ID is unknown
+uint32_t block_size(uint8_t id, uint8_t hdr[]);
+
+// Bytes taken by a PZX block, whatever its tag - 0 if too long to be one
+uint32_t pzx_block_size(uint8_t hdr[]);
+
+// ID given to a PZX block, from its tag
+uint8_t pzx_block_id(const uint8_t hdr[]);
+
+/*
+ * Fill in the descriptor for a block that goes to the decoder, from its
+ * fixed header. Returns where the payload starts within the block, or 0 if
+ * the block is not one for the decoder (jumps, loops, info etc.), or is too
+ * short to be the block its ID says
+ */
+uint8_t block_parse(uint8_t id, uint8_t hdr[], t_block_desc *blk);
+
+// Apply the speed's scale factors to a parsed block, if its class has them
+void block_scale(uint8_t id, t_block_desc *blk, const t_speed *speed);
+
+// Start decoding a data block whose payload starts at addr
+void block_begin(t_decoder *d, const t_block_desc *blk, t_tape *t, uint32_t addr);
+
+// Decode as much as fits in the sink, true once the block is complete
+bool block_fill(t_decoder *d, t_pulse_sink *s);
+
+/*
+ * Skip ahead through a standard, turbo or pure data block, taking the
+ * pilot, sync and whole bytes that fit off the cycles given, and changing
+ * the sink's level as the pulses skipped would. True if the cycles run out
+ * inside the block: it starts again with a short pilot and the sync (none
+ * for pure data) - before the data if they ran out in the pilot or sync,
+ * else from the byte they ran out in - and the cycles are 0. False if the
+ * data runs out first, or the block is not one of those
+ */
+bool block_seek(t_decoder *d, t_pulse_sink *s, uint64_t *cycles);
+
+// Release anything held by a block abandoned part way through
+void block_end(t_decoder *d);
+
+#endif
@@ -0,0 +1,352 @@
+#include <string.h> // memcpy, memset, memcmp
+#include "flashcache.h"
+
+// Header page layout
+#define HDR_SEQ 8
+#define HDR_SIZE 12
+#define HDR_CRC 16
+#define HDR_BYTES 20
+#define HDR_WORDS 24
+
+// Stream opcodes
+#define OP_RUN 0x80
+#define OP_LITERAL 0xC0
+#define OP_NEW 0xC1
+#define OP_END 0xFF
+
+// A cache header found in the region, and the sectors it covers
+typedef struct t_cache_hdr
+{
+    uint32_t start;
+    uint32_t end;
+    uint32_t seq;
+    bool done;
+} t_cache_hdr;
+
+static uint32_t get_uint(const uint8_t *ptr)
+{
+    return ptr[0] | ptr[1] << 8 | ptr[2] << 16 | (uint32_t)ptr[3] << 24;
+}
+
+static void put_uint(uint8_t *ptr, uint32_t value)
+{
+    for (int x = 0; x < 4; x++)
+        ptr[x] = (value >> (x * 8)) & 0xFF;
+}
+
+// Header at the start of a sector, if there is one
+static bool read_header(t_flash *f, uint32_t start, t_cache_hdr *h)
+{
+    const uint8_t *hdr = f->mem + start;
+    if ((memcmp(hdr, CACHE_MAGIC, 4) != 0) || (hdr[4] != CACHE_VERSION))
+        return false;
+
+    uint32_t bytes = get_uint(hdr + HDR_BYTES);
+    h->start = start;
+    h->seq = get_uint(hdr + HDR_SEQ);
+    h->done = (bytes != 0xFFFFFFFF);
+
+    // One cut short may have got as far as the end of the region
+    h->end = f->size;
+    if (h->done && (bytes <= f->size - start - FLASH_PAGE))
+        h->end = start + (FLASH_PAGE + bytes + FLASH_SECTOR - 1) / FLASH_SECTOR * FLASH_SECTOR;
+    return true;
+}
+
+// Has a newer cache been written over any of this one
+static bool overwritten(t_flash *f, const t_cache_hdr *h)
+{
+    t_cache_hdr n;
+    for (uint32_t at = 0; at < f->size; at += FLASH_SECTOR)
+    {
+        if (read_header(f, at, &n) && (n.seq > h->seq) && (n.start < h->end) && (h->start < n.end))
+            return true;
+    }
+    return false;
+}
+
+bool flashcache_open(t_flashcache *c, t_flash *flash, t_tape *t, uint8_t speed)
+{
+    c->flash = flash;
+    c->tape_size = t->size;
+    c->tape_crc = tape_crc32(t, t->size);
+    c->speed = speed;
+
+    t_cache_hdr h, newest = {0, 0, 0, false}, found = {0, 0, 0, false};
+    for (uint32_t at = 0; at < flash->size; at += FLASH_SECTOR)
+    {
+        if (!read_header(flash, at, &h))
+            continue;
+        if (h.seq >= newest.seq)
+            newest = h;
+
+        const uint8_t *hdr = flash->mem + at;
+        if (h.done && (h.seq > found.seq) && (hdr[5] == sizeof(pulse_t)) && (hdr[6] == speed) &&
+            (get_uint(hdr + HDR_SIZE) == c->tape_size) && (get_uint(hdr + HDR_CRC) == c->tape_crc) &&
+            !overwritten(flash, &h))
+            found = h;
+    }
+
+    // A new cache goes after the newest one
+    c->seq = newest.seq + 1;
+    c->start = (newest.end < flash->size) ? newest.end : 0;
+    if (found.seq == 0)
+        return false;
+
+    c->start = found.start;
+    c->seq = found.seq;
+    c->bytes = get_uint(flash->mem + found.start + HDR_BYTES);
+    c->words = get_uint(flash->mem + found.start + HDR_WORDS);
+    flashcache_rewind(c);
+    return true;
+}
+
+// Program a page, and read it back
+static bool program_page(t_flashcache *c, uint32_t offset, const uint8_t *data)
+{
+    t_flash *f = c->flash;
+    return f->program(f->ctx, offset, data, FLASH_PAGE) &&
+           (memcmp(f->mem + offset, data, FLASH_PAGE) == 0);
+}
+
+// The page is full, or the stream has ended - erase the sector first if it is a new one
+static void write_page(t_flashcache *c)
+{
+    t_flash *f = c->flash;
+
+    memset(c->page + c->fill, 0xFF, FLASH_PAGE - c->fill);
+    c->fill = 0;
+    if (c->failed)
+        return;
+
+    if (c->pos + FLASH_PAGE > f->size)
+    {
+        c->failed = true;
+        return;
+    }
+    if ((c->pos % FLASH_SECTOR == 0) && !f->erase(f->ctx, c->pos, FLASH_SECTOR))
+    {
+        c->failed = true;
+        return;
+    }
+    if (!program_page(c, c->pos, c->page))
+        c->failed = true;
+    c->pos += FLASH_PAGE;
+}
+
+static void put_byte(t_flashcache *c, uint8_t value)
+{
+    c->bytes++;
+    if (c->sizing)
+        return;
+
+    c->page[c->fill++] = value;
+    if (c->fill == FLASH_PAGE)
+        write_page(c);
+}
+
+// Code the word waiting, and its repeats
+static void put_word(t_flashcache *c)
+{
+    uint32_t left = c->repeat;
+    int n = c->table_len;
+    while ((--n >= 0) && (c->table[n] != c->word))
+        ;
+
+    if ((n >= 0) && (left >= 2))
+    {
+        put_byte(c, 0x40 | n);
+        left -= 2;
+    }
+    else if (n >= 0)
+    {
+        put_byte(c, n);
+        left--;
+    }
+    else
+    {
+        // Not seen before - it goes in the table while there is room
+        if (c->table_len < CACHE_TABLE)
+        {
+            put_byte(c, OP_NEW);
+            c->table[c->table_len++] = c->word;
+        }
+        else
+            put_byte(c, OP_LITERAL);
+        for (uint32_t x = 0; x < sizeof(pulse_t); x++)
+            put_byte(c, c->word >> (x * 8));
+        left--;
+    }
+
+    while (left > 0)
+    {
+        uint32_t run = (left < CACHE_RUN) ? left : CACHE_RUN;
+        put_byte(c, OP_RUN | (run - 1) >> 8);
+        put_byte(c, (run - 1) & 0xFF);
+        left -= run;
+    }
+    c->repeat = 0;
+}
+
+static void code_word(t_flashcache *c, pulse_t word)
+{
+    if ((c->repeat > 0) && (word == c->word))
+    {
+        c->repeat++;
+        return;
+    }
+    if (c->repeat > 0)
+        put_word(c);
+
+    c->word = word;
+    c->repeat = 1;
+}
+
+// Code the whole tape into the stream
+static void code_tape(t_flashcache *c, t_player *p, t_pulse_sink *s)
+{
+    c->fill = 0;
+    c->failed = false;
+    c->bytes = 0;
+    c->words = 0;
+    c->table_len = 0;
+    c->repeat = 0;
+
+    bool done;
+    player_rewind(p);
+    do
+    {
+        done = player_fill(p, s);
+        for (uint32_t i = 0; i < s->pos; i++)
+            code_word(c, s->buf[i]);
+        c->words += s->pos;
+        s->pos = 0;
+    } while (!done && !c->failed && (c->bytes < c->flash->size));
+
+    if (c->repeat > 0)
+        put_word(c);
+    put_byte(c, OP_END);
+    if (c->fill > 0)
+        write_page(c);
+}
+
+// Render the whole tape into a cache at c->start
+static bool write_cache(t_flashcache *c, t_player *p, t_pulse_sink *s)
+{
+    t_flash *f = c->flash;
+
+    // Header first, with the length left erased until the stream is done
+    memset(c->page, 0xFF, FLASH_PAGE);
+    memcpy(c->page, CACHE_MAGIC, 4);
+    c->page[4] = CACHE_VERSION;
+    c->page[5] = sizeof(pulse_t);
+    c->page[6] = c->speed;
+    c->page[7] = 0;
+    put_uint(c->page + HDR_SEQ, c->seq);
+    put_uint(c->page + HDR_SIZE, c->tape_size);
+    put_uint(c->page + HDR_CRC, c->tape_crc);
+    if (!f->erase(f->ctx, c->start, FLASH_SECTOR) || !program_page(c, c->start, c->page))
+        return false;
+
+    c->pos = c->start + FLASH_PAGE;
+    code_tape(c, p, s);
+    if (c->failed)
+        return false;
+
+    // Now it can be played
+    memset(c->page, 0xFF, FLASH_PAGE);
+    put_uint(c->page + HDR_BYTES, c->bytes);
+    put_uint(c->page + HDR_WORDS, c->words);
+    return f->program(f->ctx, c->start, c->page, FLASH_PAGE) &&
+           (memcmp(f->mem + c->start + HDR_BYTES, c->page + HDR_BYTES, 8) == 0);
+}
+
+bool flashcache_build(t_flashcache *c, t_player *p, t_pulse_sink *s)
+{
+    uint8_t level = s->level;
+    t_telemetry *telem = p->telem;
+
+    // Not a real play, so not timed
+    player_set_telemetry(p, NULL);
+
+    // Size it first - after the newest cache if it fits there, else from the start
+    c->sizing = true;
+    code_tape(c, p, s);
+    c->sizing = false;
+    s->level = level;
+
+    uint64_t need = FLASH_PAGE + (uint64_t)c->bytes;
+    bool ok = (need <= c->flash->size);
+    if (ok)
+    {
+        if (c->start + need > c->flash->size)
+            c->start = 0;
+        ok = write_cache(c, p, s);
+    }
+
+    // Leave it as it was found
+    player_rewind(p);
+    player_set_telemetry(p, telem);
+    s->level = level;
+
+    if (ok)
+        flashcache_rewind(c);
+    return ok;
+}
+
+void flashcache_rewind(t_flashcache *c)
+{
+    c->pos = 0;
+    c->repeat = 0;
+    c->table_len = 0;
+}
+
+bool flashcache_fill(t_flashcache *c, t_pulse_sink *s)
+{
+    const uint8_t *data = c->flash->mem + c->start + FLASH_PAGE;
+
+    while (true)
+    {
+        // Copies of the current word, as many as fit
+        uint32_t n = pulse_space(s);
+        if (n > c->repeat)
+            n = c->repeat;
+        for (uint32_t x = 0; x < n; x++)
+            s->buf[s->pos++] = c->word;
+        s->level ^= n & 1;
+        c->repeat -= n;
+        if (c->repeat > 0)
+            return false;
+
+        if (c->pos >= c->bytes)
+            return true;
+
+        uint8_t op = data[c->pos++];
+        if (op < OP_RUN)
+        {
+            // A table word, once or twice
+            if ((op & 0x3F) >= c->table_len)
+                return true;
+            c->word = c->table[op & 0x3F];
+            c->repeat = (op & 0x40) ? 2 : 1;
+        }
+        else if (op < OP_LITERAL)
+        {
+            c->repeat = ((op & 0x3F) << 8 | data[c->pos++]) + 1;
+        }
+        else if ((op == OP_LITERAL) || (op == OP_NEW))
+        {
+            c->word = 0;
+            for (uint32_t x = 0; x < sizeof(pulse_t); x++)
+                c->word |= (pulse_t)data[c->pos++] << (x * 8);
+            if ((op == OP_NEW) && (c->table_len < CACHE_TABLE))
+                c->table[c->table_len++] = c->word;
+            c->repeat = 1;
+        }
+        else
+        {
+            // OP_END, or nothing we know
+            return true;
+        }
+    }
+}
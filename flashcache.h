@@ -0,0 +1,121 @@
+#ifndef FLASHCACHE_H
+#define FLASHCACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "player.h"
+#include "pulse.h"
+#include "tapeio.h"
+
+/*
+ * Flash pulse cache
+ *
+ * A tape's pulse stream is the same every time it plays, so it can be
+ * rendered once into spare flash and streamed back out on later plays,
+ * with no decoding at all - CSW inflate, Generalised symbols and Direct
+ * Recording runs are only worked out the first time.
+ *
+ * The stream is run-length coded, one opcode byte at a time:
+ *  00nnnnnn      word n from the table, once
+ *  01nnnnnn      word n from the table, twice (a bit of standard data)
+ *  10cccccc cccc the last word, 1-16384 more times (c + 1)
+ *  11000000 w    a word not in the table (sizeof(pulse_t) bytes)
+ *  11000001 w    a word that goes in the table next (up to CACHE_TABLE)
+ *  11111111      end
+ * The table is built as the stream is, so nothing is stored up front. A
+ * pilot tone is 3 bytes, and standard data a byte for each bit.
+ *
+ * The flash region is used as a ring of caches. Each one starts on a
+ * sector of its own, with a header page giving the tape it is for (size,
+ * CRC-32, speed preset and word size) and a sequence number. A new cache
+ * goes after the newest one, wrapping to the start of the region when it
+ * will not fit, so every sector is erased as often as every other one. An
+ * older cache stays usable until a newer one is written over any of it.
+ *
+ * The tape is coded once without writing anything, to size the stream, so
+ * a tape too big for the region never costs an erase. The header page is
+ * programmed before the stream, with the stream length
+ * left erased, and that is programmed last - a cache cut short by a reset
+ * has no length, so it is never played, but it still marks the older ones
+ * it overwrote as gone.
+ */
+#define CACHE_MAGIC "TPFC"
+#define CACHE_VERSION 1
+
+#define FLASH_PAGE 256
+#define FLASH_SECTOR 4096
+
+// Words kept in the table
+#define CACHE_TABLE 64
+// Longest run in one opcode
+#define CACHE_RUN 16384
+
+// Speed key for a tape played as recorded
+#define CACHE_AS_RECORDED 0xFF
+
+// A region of flash, readable as memory, programmed through callbacks
+typedef struct t_flash
+{
+    const uint8_t *mem;
+    uint32_t size; // Whole sectors
+
+    // Offsets are within the region: whole sectors to erase, whole pages to program
+    bool (*erase)(void *ctx, uint32_t offset, uint32_t len);
+    bool (*program)(void *ctx, uint32_t offset, const uint8_t *data, uint32_t len);
+    void *ctx;
+} t_flash;
+
+typedef struct t_flashcache
+{
+    t_flash *flash;
+
+    // What the cache is for
+    uint32_t tape_size;
+    uint32_t tape_crc;
+    uint8_t speed;
+
+    // The cache found or written: where it starts, the stream's length
+    uint32_t start;
+    uint32_t bytes;
+    uint32_t words;
+    uint32_t seq;
+
+    // Table of words, built as the stream is read or written
+    pulse_t table[CACHE_TABLE];
+    uint8_t table_len;
+
+    // Reading: next byte of the stream, the word repeating and how many
+    // more times. Writing: next page to program, and the word not coded
+    // yet and how many times it came
+    uint32_t pos;
+    pulse_t word;
+    uint32_t repeat;
+
+    // Writing: the page being filled - or just counting bytes, when sizing
+    uint8_t page[FLASH_PAGE];
+    uint32_t fill;
+    bool failed;
+    bool sizing;
+} t_flashcache;
+
+/*
+ * Look for a cache of the tape at the speed given (a speed preset, or
+ * CACHE_AS_RECORDED), true if there is one ready to play. If not, the
+ * tape's key is kept for flashcache_build()
+ */
+bool flashcache_open(t_flashcache *c, t_flash *flash, t_tape *t, uint8_t speed);
+
+/*
+ * Render the player's tape (at the speed it is set to, which must be the
+ * one given to flashcache_open) into a new cache, through the (empty) sink.
+ * False if it does not fit in the region, or the flash fails
+ */
+bool flashcache_build(t_flashcache *c, t_player *p, t_pulse_sink *s);
+
+// Go back to the start of the cached stream
+void flashcache_rewind(t_flashcache *c);
+
+// Stream as much as fits into the sink, true once the tape has ended
+bool flashcache_fill(t_flashcache *c, t_pulse_sink *s);
+
+#endif
@@ -0,0 +1,374 @@
+/*
+ * tappioca-wav - render a whole collection of tapes to WAVs, on every core
+ *
+ * Each tape given, and every TZX, PZX and TAP under each directory given,
+ * is played through the same player and decoders as the firmware and
+ * written to the output directory as a WAV (see wavout.h) - a tape in a
+ * directory keeps its path under it, and its name with .wav after it, so
+ * GAME.TZX and GAME.TAP are GAME.TZX.wav and GAME.TAP.wav. Two tapes that
+ * would still be the same WAV, such as two given of the same name from
+ * different directories, are refused before anything is rendered. The WAV
+ * is the same, byte for byte, as tappioca-render -f wav makes.
+ *
+ * The tapes are shared out between a pool of threads (-j, one per core by
+ * default), each taking the next tape not yet started. Tapes are mapped
+ * into memory and played in place, rather than read through a window, and
+ * samples go out a run per pulse word into a buffer written a block at a
+ * time. Nothing is shared between tapes but the list, so the WAVs are the
+ * same whatever the number of threads - -j 1 renders on the main thread,
+ * one tape after the other.
+ *
+ * A tape that goes round forever is rendered once round, up to where it
+ * goes back.
+ *
+ * With -r, the WAVs are at that sample rate, and with -s at a speed preset.
+ */
+#define _GNU_SOURCE    // nftw, strdup, madvise
+#include <stdio.h>     // printf
+#include <stdlib.h>    // atoi, malloc, qsort
+#include <string.h>    // strcmp, strrchr, strdup
+#include <strings.h>   // strcasecmp
+#include <stdatomic.h> // atomic_fetch_add
+#include <pthread.h>   // pthread_create
+#include <unistd.h>    // sysconf, close
+#include <fcntl.h>     // open
+#include <ftw.h>       // nftw
+#include <sys/mman.h>  // mmap
+#include <sys/stat.h>  // fstat, mkdir
+#include <time.h>      // clock_gettime
+#include "player.h"
+#include "wavout.h"
+
+// Samples buffered before each write
+#define WAV_BUFFER (256 * 1024)
+
+// Most threads, and the longest path
+#define THREADS_MAX 256
+#define PATH_MAX_LEN 4096
+
+typedef struct t_job
+{
+    char *in;
+    char *out;
+
+    // Filled in once rendered
+    bool ok;
+    bool forever;
+    const char *error;
+    uint64_t cycles;
+    uint64_t samples;
+} t_job;
+
+static t_job *jobs;
+static uint32_t n_jobs, jobs_size;
+
+// The next job not yet started, shared by the threads
+static atomic_uint next_job;
+
+static const char *out_dir;
+static uint32_t rate = 44100;
+static const t_speed *speed;
+
+static void add_job(const char *in, const char *rel)
+{
+    if (n_jobs == jobs_size)
+    {
+        jobs_size = 2 * jobs_size + 64;
+        jobs = realloc(jobs, jobs_size * sizeof(t_job));
+    }
+
+    // The output keeps the path and the extension, with .wav after
+    char out[PATH_MAX_LEN];
+    snprintf(out, sizeof(out), "%s/%s.wav", out_dir, rel);
+
+    jobs[n_jobs++] = (t_job){strdup(in), strdup(out), false, false, NULL, 0, 0};
+}
+
+static int compare_out(const void *a, const void *b)
+{
+    return strcmp((*(const t_job *const *)a)->out, (*(const t_job *const *)b)->out);
+}
+
+// A WAV more than one tape would be written to, or NULL if each has its own
+static const char *same_out(void)
+{
+    const char *dup = NULL;
+    t_job **sorted = malloc(n_jobs * sizeof(t_job *));
+    if (sorted == NULL)
+        return NULL;
+    for (uint32_t x = 0; x < n_jobs; x++)
+        sorted[x] = &jobs[x];
+    qsort(sorted, n_jobs, sizeof(t_job *), compare_out);
+    for (uint32_t x = 1; (x < n_jobs) && (dup == NULL); x++)
+    {
+        if (!strcmp(sorted[x - 1]->out, sorted[x]->out))
+            dup = sorted[x]->out;
+    }
+    free(sorted);
+    return dup;
+}
+
+// Only .tzx, .pzx and .tap, in any case
+static bool is_tape(const char *name)
+{
+    const char *ext = strrchr(name, '.');
+    return (ext != NULL) && (!strcasecmp(ext, ".tzx") || !strcasecmp(ext, ".pzx") || !strcasecmp(ext, ".tap"));
+}
+
+// Directory being walked, for the path under it
+static size_t walk_root;
+
+static int walk_entry(const char *path, const struct stat *st, int type, struct FTW *ftw)
+{
+    (void)st;
+    (void)ftw;
+    if ((type == FTW_F) && is_tape(path))
+        add_job(path, path + walk_root);
+    return 0;
+}
+
+// Make the directories above a path
+static void make_dirs(const char *path)
+{
+    char dir[PATH_MAX_LEN];
+    snprintf(dir, sizeof(dir), "%s", path);
+    for (char *p = dir + 1; *p; p++)
+    {
+        if (*p == '/')
+        {
+            *p = '\0';
+            mkdir(dir, 0777);
+            *p = '/';
+        }
+    }
+}
+
+/*
+ * Play a tape into its WAV. The header goes first with no length, and is
+ * written again at the end with the length in.
+ */
+static const char *render(t_job *j, uint8_t *buf)
+{
+    int fd = open(j->in, O_RDONLY);
+    if (fd < 0)
+        return "cannot open";
+    struct stat st;
+    if ((fstat(fd, &st) != 0) || (st.st_size == 0) || (st.st_size > UINT32_MAX))
+    {
+        close(fd);
+        return "not a tape that can be played";
+    }
+    const uint8_t *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return "cannot map";
+    madvise((void *)data, st.st_size, MADV_SEQUENTIAL);
+
+    const char *error = NULL;
+    t_tape tape;
+    t_player player;
+    tape_open_mem(&tape, data, st.st_size);
+    if (!player_open(&player, &tape))
+        error = "not a tape that can be played";
+    else
+    {
+        player_set_speed(&player, speed);
+
+        j->forever = player_play_once(&player);
+
+        make_dirs(j->out);
+        FILE *out = fopen(j->out, "wb");
+        if (out == NULL)
+            error = "cannot create the WAV";
+        else
+        {
+            pulse_t chunk[PULSE_CHUNK];
+            t_pulse_sink sink;
+            t_wav wav;
+            uint32_t pos = 0;
+            bool done;
+
+            pulse_sink_init(&sink, chunk, PULSE_CHUNK);
+            wav_init(&wav, rate);
+            wav_header(&wav, buf);
+            fwrite(buf, 1, WAV_HEADER, out);
+            do
+            {
+                uint8_t level = sink.level ^ (sink.pos & 1);
+                done = player_fill(&player, &sink);
+                for (uint32_t i = 0; i < sink.pos; i++, level ^= 1)
+                {
+                    // A word is a run of samples all the same - a long pause can be more than the buffer
+                    for (uint64_t n = wav_word(&wav, chunk[i]); n > 0;)
+                    {
+                        uint32_t run = (n < WAV_BUFFER - pos) ? n : WAV_BUFFER - pos;
+                        memset(buf + pos, level ? WAV_HIGH : WAV_LOW, run);
+                        pos += run;
+                        n -= run;
+                        if (pos == WAV_BUFFER)
+                        {
+                            fwrite(buf, 1, pos, out);
+                            pos = 0;
+                        }
+                    }
+                }
+                sink.pos = 0;
+            } while (!done);
+            fwrite(buf, 1, pos, out);
+
+            wav_header(&wav, buf);
+            fseek(out, 0, SEEK_SET);
+            fwrite(buf, 1, WAV_HEADER, out);
+            int err = ferror(out);
+            if ((fclose(out) != 0) || err)
+            {
+                error = "cannot write the WAV";
+                remove(j->out);
+            }
+            j->cycles = wav.cycles;
+            j->samples = wav.samples;
+        }
+        player_close(&player);
+    }
+
+    munmap((void *)data, st.st_size);
+    return error;
+}
+
+// A thread of the pool - takes jobs until there are none left
+static void *worker(void *arg)
+{
+    (void)arg;
+    uint8_t *buf = malloc(WAV_BUFFER);
+    if (buf == NULL)
+        return NULL;
+
+    for (uint32_t x; (x = atomic_fetch_add(&next_job, 1)) < n_jobs;)
+    {
+        jobs[x].error = render(&jobs[x], buf);
+        jobs[x].ok = (jobs[x].error == NULL);
+    }
+
+    free(buf);
+    return NULL;
+}
+
+static double now_secs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int usage(void)
+{
+    printf("Usage: tappioca-wav [-j threads] [-r rate] [-s speed] <outdir> <tape or dir>...\n");
+    printf("Speeds:");
+    for (int x = 0; x < SPEED_PRESETS; x++)
+        printf(" %s", speed_presets[x].name);
+    printf("\n");
+    return 2;
+}
+
+int main(int argc, char *argv[])
+{
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int first = 0;
+
+    for (int i = 1; (i < argc) && !first; i++)
+    {
+        if (!strcmp(argv[i], "-j") && (i + 1 < argc))
+            threads = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-r") && (i + 1 < argc))
+            rate = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-s") && (i + 1 < argc))
+        {
+            i++;
+            for (int x = 0; x < SPEED_PRESETS; x++)
+            {
+                if (!strcmp(argv[i], speed_presets[x].name))
+                    speed = &speed_presets[x];
+            }
+            if (speed == NULL)
+                return usage();
+        }
+        else
+            first = i;
+    }
+    if ((first == 0) || (first + 1 >= argc) || (rate == 0) || (threads < 1) || (threads > THREADS_MAX))
+        return usage();
+
+    out_dir = argv[first];
+    mkdir(out_dir, 0777);
+    for (int i = first + 1; i < argc; i++)
+    {
+        struct stat st;
+        if (stat(argv[i], &st) != 0)
+        {
+            printf("Cannot open %s\n", argv[i]);
+            return 1;
+        }
+        if (S_ISDIR(st.st_mode))
+        {
+            walk_root = strlen(argv[i]);
+            while ((walk_root > 0) && (argv[i][walk_root - 1] == '/'))
+                walk_root--;
+            walk_root++;
+            nftw(argv[i], walk_entry, 16, FTW_PHYS);
+        }
+        else
+        {
+            const char *base = strrchr(argv[i], '/');
+            add_job(argv[i], base ? base + 1 : argv[i]);
+        }
+    }
+    const char *dup = same_out();
+    if (dup != NULL)
+    {
+        printf("%s: more than one tape would be written to it\n", dup);
+        return 1;
+    }
+    if (threads > (int)n_jobs)
+        threads = n_jobs ? n_jobs : 1;
+
+    double start = now_secs();
+    if (threads == 1)
+        worker(NULL);
+    else
+    {
+        pthread_t pool[THREADS_MAX];
+        for (int t = 0; t < threads; t++)
+            pthread_create(&pool[t], NULL, worker, NULL);
+        for (int t = 0; t < threads; t++)
+            pthread_join(pool[t], NULL);
+    }
+    double secs = now_secs() - start;
+
+    // Only failures are listed, in the order given
+    uint32_t ok = 0, forever = 0;
+    uint64_t cycles = 0, samples = 0;
+    for (uint32_t x = 0; x < n_jobs; x++)
+    {
+        if (jobs[x].ok)
+        {
+            ok++;
+            forever += jobs[x].forever;
+            cycles += jobs[x].cycles;
+            samples += jobs[x].samples;
+        }
+        else
+            printf("%s: %s\n", jobs[x].in, jobs[x].error ? jobs[x].error : "not rendered");
+        free(jobs[x].in);
+        free(jobs[x].out);
+    }
+    free(jobs);
+
+    printf("%u of %u tapes rendered, %.3f secs of tape, %llu samples at %u Hz\n", ok, n_jobs,
+           (double)cycles / PULSE_SCALE / FREQ, (unsigned long long)samples, rate);
+    if (forever > 0)
+        printf("%u go round forever, and were rendered once round\n", forever);
+    if (secs > 0)
+        printf("%d threads, %.3f secs: %.1f files/sec, %.0fx real time\n", threads, secs, n_jobs / secs,
+               (double)cycles / PULSE_SCALE / FREQ / secs);
+    return (ok == n_jobs) ? 0 : 1;
+}
@@ -0,0 +1,80 @@
+/*
+ * tappioca-library - build and search the tape catalogue of a "card"
+ *
+ * The directory given stands in for the root of the SD card. Its catalogue
+ * is brought up to date just as the firmware does on boot, then either every
+ * tape is listed, or the one asked for (by number or path) is looked up.
+ */
+#include <stdio.h>  // printf
+#include <stdlib.h> // strtoul
+#include <time.h>   // clock
+#include <unistd.h> // chdir
+#include "ff.h"
+#include "library.h"
+
+static void show(t_library *lib, uint32_t n)
+{
+    t_lib_entry e;
+    char path[LIB_PATH];
+
+    if (!library_get(lib, n, &e, path))
+        return;
+
+    uint32_t secs = e.duration / FREQ;
+    printf("%5u: %-40s %8u bytes %5u blocks %3u:%02u  %s\n",
+           n, path, e.size, e.blocks, secs / 60, secs % 60, e.title);
+}
+
+int main(int argc, char *argv[])
+{
+    if ((argc < 2) || (argc > 3))
+    {
+        printf("Usage: tappioca-library <card directory> [tape number or path]\n");
+        return 1;
+    }
+    if (chdir(argv[1]) != 0)
+    {
+        printf("Cannot open %s\n", argv[1]);
+        return 1;
+    }
+
+    static uint8_t window[2][TAPE_CHUNK];
+    static pulse_t chunk[PULSE_CHUNK];
+    t_pulse_sink sink;
+    pulse_sink_init(&sink, chunk, PULSE_CHUNK);
+
+    t_library lib;
+    clock_t start = clock();
+    if (!library_open(&lib, window, &sink))
+    {
+        printf("Cannot update %s\n", LIB_FILE);
+        return 1;
+    }
+    printf("%u tapes in %u directories, %u indexed, in %.3f msecs\n", lib.count, lib.dir_count,
+           lib.scanned, (double)(clock() - start) * 1000 / CLOCKS_PER_SEC);
+
+    if (argc == 3)
+    {
+        // A number, or else a path
+        char *end;
+        int32_t n = strtoul(argv[2], &end, 10);
+        if (*end != '\0')
+        {
+            start = clock();
+            n = library_find(&lib, argv[2]);
+            printf("Found in %.3f msecs\n", (double)(clock() - start) * 1000 / CLOCKS_PER_SEC);
+        }
+        if ((n < 0) || ((uint32_t)n >= lib.count))
+            printf("%s is not in the catalogue\n", argv[2]);
+        else
+            show(&lib, n);
+    }
+    else
+    {
+        for (uint32_t n = 0; n < lib.count; n++)
+            show(&lib, n);
+    }
+
+    library_close(&lib);
+    return 0;
+}
@@ -0,0 +1,121 @@
+/*
+ * tappioca-embed - turn a tape into a header to build into the firmware
+ *
+ * The header holds the tape, and what the player would otherwise work out
+ * at boot - the block index, the playlist and the running time - as const
+ * tables, so they all stay in flash (see player_open_built()). The build
+ * runs this through EMBED_TAPE in CMakeLists.txt.
+ *
+ * The tape is opened and played through without output on the way, just
+ * as the firmware would: a tape that does not index, or whose control flow
+ * does not compile, fails here and so fails the build, rather than failing
+ * on the board.
+ *
+ * With -n, the tables are named after that instead of "embedded_tape".
+ */
+#include <stdio.h>  // printf
+#include <string.h> // strcmp
+#include "ff.h"
+#include "player.h"
+
+static int usage(void)
+{
+    printf("Usage: tappioca-embed [-n name] <tape> <header.h>\n");
+    return 2;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *name = "embedded_tape";
+    char *in_name = NULL, *out_name = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-n") && (i + 1 < argc))
+            name = argv[++i];
+        else if (in_name == NULL)
+            in_name = argv[i];
+        else if (out_name == NULL)
+            out_name = argv[i];
+        else
+            return usage();
+    }
+    if (out_name == NULL)
+        return usage();
+
+    static uint8_t window[2][TAPE_CHUNK];
+    static pulse_t chunk[PULSE_CHUNK];
+    t_pulse_sink sink;
+    FIL fh;
+    t_tape tape;
+    t_player player;
+
+    if (f_open(&fh, in_name, FA_READ) != FR_OK)
+    {
+        printf("Cannot open %s\n", in_name);
+        return 1;
+    }
+    tape_open(&tape, tape_read_fatfs, &fh, f_size(&fh), window);
+    if (!player_open(&player, &tape))
+    {
+        printf("%s: not a tape that can be played\n", in_name);
+        return 1;
+    }
+    if ((player.blocks == 0) || (player.steps == 0))
+    {
+        printf("%s: nothing to play\n", in_name);
+        return 1;
+    }
+    pulse_sink_init(&sink, chunk, PULSE_CHUNK);
+    uint64_t duration = player_duration(&player, &sink);
+
+    FILE *out = fopen(out_name, "w");
+    if (out == NULL)
+    {
+        printf("Cannot create %s\n", out_name);
+        return 1;
+    }
+
+    fprintf(out, "/*\n * %s, built in by tappioca-embed - do not edit\n */\n#include \"player.h\"\n\n", in_name);
+
+    fprintf(out, "static const uint8_t %s_data[] = {", name);
+    for (uint32_t i = 0; i < tape.size; i++)
+        fprintf(out, "%s0x%02x,", (i % 16) ? " " : "\n\t", tape_byte(&tape, i));
+    fprintf(out, "\n};\n\n");
+
+    fprintf(out, "static const t_block_entry %s_index[] = {", name);
+    for (uint16_t b = 0; b < player.blocks; b++)
+        fprintf(out, "%s{%u, 0x%02x},", (b % 6) ? " " : "\n\t", player.index[b].addr, player.index[b].id);
+    fprintf(out, "\n};\n\n");
+
+    fprintf(out, "static const t_play_step %s_list[] = {", name);
+    for (uint16_t x = 0; x < player.steps; x++)
+    {
+        const t_play_step *st = &player.list[x];
+        fprintf(out, "%s{%u, %u, %u},", (x % 6) ? " " : "\n\t", st->first, st->count, st->repeat);
+    }
+    fprintf(out, "\n};\n\n");
+
+    fprintf(out, "static const t_built_tape %s = {\n", name);
+    fprintf(out, "\t%s_data, %u, %u,\n", name, tape.size, player.format);
+    fprintf(out, "\t%s_index, %u,\n", name, player.blocks);
+    fprintf(out, "\t%s_list, %u,\n", name, player.steps);
+    fprintf(out, "\t%lluULL, // Running time in t-states, 0 if not known\n};\n", (unsigned long long)duration);
+
+    int err = ferror(out);
+    if ((fclose(out) != 0) || err)
+    {
+        printf("Cannot write %s\n", out_name);
+        remove(out_name);
+        return 1;
+    }
+
+    printf("%s: %u blocks, %u playlist steps", out_name, player.blocks, player.steps);
+    if (duration)
+        printf(", running time %.3f secs", (double)duration / FREQ);
+    printf("\n");
+
+    player_close(&player);
+    f_close(&fh);
+    return 0;
+}
@@ -0,0 +1,168 @@
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// FatFs has its own DIR, so the host's is renamed out of the way
+typedef DIR host_dir;
+#define DIR FF_DIR
+#include "ff.h"
+
+// Skip a FatFs drive prefix, e.g. "0:", the card is the current directory
+static const TCHAR *host_path(const TCHAR *path)
+{
+    if ((path[0] != '\0') && (path[1] == ':'))
+        path += 2;
+    if ((path[0] == '/') && (path[1] == '\0'))
+        path++;
+
+    return (path[0] == '\0') ? "." : path;
+}
+
+FRESULT f_open(FIL *fp, const TCHAR *path, BYTE mode)
+{
+    memset(fp, 0, sizeof(*fp));
+    path = host_path(path);
+
+    fp->fp = fopen(path, (mode & FA_WRITE) ? "w+b" : "rb");
+    if (fp->fp == NULL)
+        return FR_NO_FILE;
+
+    fseek(fp->fp, 0, SEEK_END);
+    fp->obj.objsize = ftell(fp->fp);
+    fseek(fp->fp, 0, SEEK_SET);
+
+    return FR_OK;
+}
+
+FRESULT f_close(FIL *fp)
+{
+    if (fp->fp == NULL)
+        return FR_INVALID_OBJECT;
+
+    fclose(fp->fp);
+    fp->fp = NULL;
+
+    return FR_OK;
+}
+
+FRESULT f_read(FIL *fp, void *buff, UINT btr, UINT *br)
+{
+    if (fp->fp == NULL)
+        return FR_INVALID_OBJECT;
+
+    *br = fread(buff, 1, btr, fp->fp);
+    fp->fptr += *br;
+
+    return ferror(fp->fp) ? FR_DISK_ERR : FR_OK;
+}
+
+FRESULT f_write(FIL *fp, const void *buff, UINT btw, UINT *bw)
+{
+    if (fp->fp == NULL)
+        return FR_INVALID_OBJECT;
+
+    *bw = fwrite(buff, 1, btw, fp->fp);
+    fp->fptr += *bw;
+    if (fp->fptr > fp->obj.objsize)
+        fp->obj.objsize = fp->fptr;
+
+    return ferror(fp->fp) ? FR_DISK_ERR : FR_OK;
+}
+
+FRESULT f_lseek(FIL *fp, FSIZE_t ofs)
+{
+    if (fp->fp == NULL)
+        return FR_INVALID_OBJECT;
+
+    if (fseek(fp->fp, ofs, SEEK_SET) != 0)
+        return FR_DISK_ERR;
+    fp->fptr = ofs;
+
+    return FR_OK;
+}
+
+FRESULT f_stat(const TCHAR *path, FILINFO *fno)
+{
+    struct stat st;
+    const TCHAR *name = host_path(path);
+
+    if (stat(name, &st) != 0)
+        return FR_NO_FILE;
+
+    // Local time, packed as FAT has it: 2 second steps from 1980
+    struct tm tm;
+    localtime_r(&st.st_mtime, &tm);
+    fno->fsize = st.st_size;
+    fno->fdate = ((tm.tm_year - 80) << 9) | ((tm.tm_mon + 1) << 5) | tm.tm_mday;
+    fno->ftime = (tm.tm_hour << 11) | (tm.tm_min << 5) | (tm.tm_sec / 2);
+    fno->fattrib = S_ISDIR(st.st_mode) ? AM_DIR : 0;
+
+    // Just the name, no directories
+    const TCHAR *base = strrchr(name, '/');
+    base = base ? base + 1 : name;
+    strncpy(fno->fname, base, sizeof(fno->fname) - 1);
+    fno->fname[sizeof(fno->fname) - 1] = '\0';
+
+    return FR_OK;
+}
+
+FRESULT f_unlink(const TCHAR *path)
+{
+    return (unlink(host_path(path)) == 0) ? FR_OK : FR_NO_FILE;
+}
+
+FRESULT f_rename(const TCHAR *path_old, const TCHAR *path_new)
+{
+    // FatFs will not replace a file
+    if (access(host_path(path_new), F_OK) == 0)
+        return FR_EXIST;
+
+    return (rename(host_path(path_old), host_path(path_new)) == 0) ? FR_OK : FR_NO_FILE;
+}
+
+FRESULT f_opendir(DIR *dp, const TCHAR *path)
+{
+    path = host_path(path);
+    dp->dir = opendir(path);
+    if (dp->dir == NULL)
+        return FR_NO_PATH;
+
+    strncpy(dp->path, path, sizeof(dp->path) - 1);
+    dp->path[sizeof(dp->path) - 1] = '\0';
+    return FR_OK;
+}
+
+FRESULT f_closedir(DIR *dp)
+{
+    if (dp->dir == NULL)
+        return FR_INVALID_OBJECT;
+
+    closedir((host_dir *)dp->dir);
+    dp->dir = NULL;
+    return FR_OK;
+}
+
+// Like FatFs, an empty name marks the end, and dot entries are skipped
+FRESULT f_readdir(DIR *dp, FILINFO *fno)
+{
+    struct dirent *de;
+    char path[512];
+
+    if (dp->dir == NULL)
+        return FR_INVALID_OBJECT;
+
+    do
+    {
+        de = readdir((host_dir *)dp->dir);
+        if (de == NULL)
+        {
+            fno->fname[0] = '\0';
+            return FR_OK;
+        }
+    } while (!strcmp(de->d_name, ".") || !strcmp(de->d_name, ".."));
+
+    snprintf(path, sizeof(path), "%s/%s", dp->path, de->d_name);
+    return f_stat(path, fno);
+}
@@ -0,0 +1,88 @@
+#ifndef FF_H
+#define FF_H
+
+/*
+ * Host stand-in for the FatFs API (http://elm-chan.org/fsw/ff/)
+ *
+ * Just enough of ff.h for the tape code to build and run on Linux, backed
+ * by plain stdio files in a host directory, which stands in for the card.
+ * Signatures and types match FatFs R0.14.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+typedef unsigned int UINT;
+typedef uint8_t BYTE;
+typedef uint16_t WORD;
+typedef uint32_t DWORD;
+typedef char TCHAR;
+typedef DWORD FSIZE_t;
+
+typedef enum
+{
+    FR_OK = 0,
+    FR_DISK_ERR,
+    FR_INT_ERR,
+    FR_NOT_READY,
+    FR_NO_FILE,
+    FR_NO_PATH,
+    FR_INVALID_NAME,
+    FR_DENIED,
+    FR_EXIST,
+    FR_INVALID_OBJECT
+} FRESULT;
+
+// Mode flags
+#define FA_READ 0x01
+#define FA_WRITE 0x02
+#define FA_OPEN_EXISTING 0x00
+#define FA_CREATE_ALWAYS 0x08
+
+typedef struct
+{
+    FSIZE_t objsize;
+} FFOBJID;
+
+typedef struct
+{
+    FFOBJID obj;
+    FSIZE_t fptr;
+    FILE *fp;
+} FIL;
+
+// File information - dates and times are packed as FAT stores them
+typedef struct
+{
+    FSIZE_t fsize;
+    WORD fdate;
+    WORD ftime;
+    BYTE fattrib;
+    TCHAR fname[256];
+} FILINFO;
+
+#define AM_DIR 0x10
+
+// Open directory - a host directory stream
+typedef struct
+{
+    void *dir;
+    TCHAR path[256];
+} DIR;
+
+#define f_size(fp) ((fp)->obj.objsize)
+#define f_tell(fp) ((fp)->fptr)
+
+FRESULT f_open(FIL *fp, const TCHAR *path, BYTE mode);
+FRESULT f_close(FIL *fp);
+FRESULT f_read(FIL *fp, void *buff, UINT btr, UINT *br);
+FRESULT f_write(FIL *fp, const void *buff, UINT btw, UINT *bw);
+FRESULT f_lseek(FIL *fp, FSIZE_t ofs);
+FRESULT f_stat(const TCHAR *path, FILINFO *fno);
+FRESULT f_unlink(const TCHAR *path);
+FRESULT f_rename(const TCHAR *path_old, const TCHAR *path_new);
+FRESULT f_opendir(DIR *dp, const TCHAR *path);
+FRESULT f_closedir(DIR *dp);
+FRESULT f_readdir(DIR *dp, FILINFO *fno);
+
+#endif
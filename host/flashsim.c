@@ -0,0 +1,95 @@
+#include <stdio.h>  // fopen
+#include <stdlib.h> // malloc
+#include <string.h> // memset
+#include "flashsim.h"
+
+static bool sim_erase(void *ctx, uint32_t offset, uint32_t len)
+{
+    t_flash_sim *sim = ctx;
+    if ((offset % FLASH_SECTOR) || (len % FLASH_SECTOR) || (offset + len > sim->size))
+        return false;
+
+    memset(sim->mem + offset, 0xFF, len);
+    for (uint32_t at = offset; at < offset + len; at += FLASH_SECTOR)
+        sim->erases[at / FLASH_SECTOR]++;
+    return true;
+}
+
+static bool sim_program(void *ctx, uint32_t offset, const uint8_t *data, uint32_t len)
+{
+    t_flash_sim *sim = ctx;
+    if ((offset % FLASH_PAGE) || (len % FLASH_PAGE) || (offset + len > sim->size))
+        return false;
+
+    // Bits can only be cleared
+    for (uint32_t x = 0; x < len; x++)
+        sim->mem[offset + x] &= data[x];
+    return true;
+}
+
+bool flash_sim_open(t_flash *f, t_flash_sim *sim, const char *path, uint32_t size)
+{
+    uint32_t sectors = size / FLASH_SECTOR;
+
+    snprintf(sim->path, sizeof(sim->path), "%s", path);
+    sim->size = sectors * FLASH_SECTOR;
+    sim->mem = malloc(sim->size);
+    sim->erases = calloc(sectors, sizeof(uint32_t));
+    if ((sim->mem == NULL) || (sim->erases == NULL))
+        return false;
+    memset(sim->mem, 0xFF, sim->size);
+
+    FILE *fh = fopen(path, "rb");
+    if (fh != NULL)
+    {
+        fseek(fh, 0, SEEK_END);
+        if (ftell(fh) == (long)(sim->size + sectors * sizeof(uint32_t)))
+        {
+            fseek(fh, 0, SEEK_SET);
+            if ((fread(sim->mem, 1, sim->size, fh) != sim->size) ||
+                (fread(sim->erases, sizeof(uint32_t), sectors, fh) != sectors))
+            {
+                memset(sim->mem, 0xFF, sim->size);
+                memset(sim->erases, 0, sectors * sizeof(uint32_t));
+            }
+        }
+        fclose(fh);
+    }
+
+    f->mem = sim->mem;
+    f->size = sim->size;
+    f->erase = sim_erase;
+    f->program = sim_program;
+    f->ctx = sim;
+    return true;
+}
+
+void flash_sim_wear(t_flash_sim *sim, uint32_t *least, uint32_t *most)
+{
+    *least = UINT32_MAX;
+    *most = 0;
+    for (uint32_t x = 0; x < sim->size / FLASH_SECTOR; x++)
+    {
+        if (sim->erases[x] < *least)
+            *least = sim->erases[x];
+        if (sim->erases[x] > *most)
+            *most = sim->erases[x];
+    }
+}
+
+bool flash_sim_close(t_flash_sim *sim)
+{
+    uint32_t sectors = sim->size / FLASH_SECTOR;
+    bool ok = false;
+
+    FILE *fh = fopen(sim->path, "wb");
+    if (fh != NULL)
+    {
+        ok = (fwrite(sim->mem, 1, sim->size, fh) == sim->size) &&
+             (fwrite(sim->erases, sizeof(uint32_t), sectors, fh) == sectors);
+        fclose(fh);
+    }
+    free(sim->mem);
+    free(sim->erases);
+    return ok;
+}
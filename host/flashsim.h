@@ -0,0 +1,34 @@
+#ifndef FLASHSIM_H
+#define FLASHSIM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "flashcache.h"
+
+/*
+ * Host stand-in for the Pico's flash
+ *
+ * A region of NOR flash kept in a host file, so caches last from one run to
+ * the next as they do across reboots. It behaves like the real thing: erase
+ * works on whole sectors and sets every bit, program works on whole pages
+ * and can only clear bits. The erases of each sector are counted, and kept
+ * in the file after the region, to show how evenly they are spread.
+ */
+typedef struct t_flash_sim
+{
+    char path[256];
+    uint8_t *mem;
+    uint32_t size;
+    uint32_t *erases;
+} t_flash_sim;
+
+// Open the file (a fresh, erased region if it is missing or the wrong size)
+bool flash_sim_open(t_flash *f, t_flash_sim *sim, const char *path, uint32_t size);
+
+// Fewest and most erases of any sector
+void flash_sim_wear(t_flash_sim *sim, uint32_t *least, uint32_t *most);
+
+// Save the region back to its file
+bool flash_sim_close(t_flash_sim *sim);
+
+#endif
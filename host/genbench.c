@@ -0,0 +1,304 @@
+/*
+ * tappioca-genbench - time the Generalised (0x19) block decoder
+ *
+ * Generalised blocks are played from symbol tables compiled once per block
+ * (see begin_gen_block() in blocks.c), and with 1 or 2 bit alphabets a
+ * byte of data at a time. This times that against a plain decoder that
+ * goes a symbol at a time, reading each symbol's pulses from the tape
+ * copy of its table and skipping the zeros - the way the blocks were
+ * played before they were compiled.
+ *
+ * Each block is a pilot and sync, then data of random bytes: 1 and 2 bit
+ * alphabets, one with a symbol that holds the level, and a 4 bit one that
+ * still goes a symbol at a time. The last is an 8 bit alphabet after a
+ * pilot alphabet of 256 symbols of 255 pulses, so the compiled tables run
+ * past 65535 words - it is there to check the symbols past that play
+ * right, more than for its timing, as compiling that many is most of the
+ * work. Both decoders have to play every block word for word the same, or
+ * it exits with 1 before timing anything.
+ *
+ * With -k, each block has that many K of data, and with -n each is played
+ * that many times for the timing.
+ */
+#include <stdio.h>  // printf
+#include <stdlib.h> // atoi, malloc
+#include <string.h> // strcmp
+#include <time.h>   // clock
+#include "blocks.h"
+
+typedef struct t_buf
+{
+    uint8_t *data;
+    uint32_t len;
+    uint32_t size;
+} t_buf;
+
+static void put(t_buf *b, uint32_t value, int width)
+{
+    if (b->len + width > b->size)
+    {
+        b->size = 2 * b->size + width;
+        b->data = realloc(b->data, b->size);
+    }
+    for (int x = 0; x < width; x++)
+        b->data[b->len++] = (value >> (x * 8)) & 0xFF;
+}
+
+/*
+ * A Generalised block: a pilot of 2168s and a two pulse sync, then data of
+ * symbols max pulses long - 0 ends a short one. A wide one has 256 data
+ * symbols of max pulses all the same length, a different one for each,
+ * and 254 pilot symbols of 255 pulses that are never played, as well as
+ * the pilot and sync
+ */
+typedef struct t_gen_test
+{
+    const char *name;
+    uint8_t symbols;
+    uint8_t max_pulses;
+    uint8_t flags[16];
+    uint16_t pulses[16][2];
+    bool wide;
+} t_gen_test;
+
+static const t_gen_test tests[] = {
+    {"1 bit, as ROM data", 2, 2, {0}, {{855, 855}, {1710, 1710}}, false},
+    {"2 bit, short symbols", 4, 2, {0}, {{600, 600}, {900, 0}, {1200, 1200}, {300, 0}}, false},
+    {"1 bit, one holds the level", 2, 2, {0, 1}, {{700, 700}, {1400, 0}}, false},
+    {"4 bit", 16, 2, {0},
+     {{500, 500}, {550, 550}, {600, 600}, {650, 650}, {700, 700}, {750, 750}, {800, 800}, {850, 850},
+      {900, 900}, {950, 950}, {1000, 1000}, {1050, 1050}, {1100, 1100}, {1150, 1150}, {1200, 1200}, {1250, 0}}, false},
+    {"8 bit, past 65535 words", 0, 4, {0}, {{0}}, true},
+};
+#define TESTS (sizeof(tests) / sizeof(tests[0]))
+
+static void make_block(t_buf *b, const t_gen_test *g, uint32_t bytes)
+{
+    static const uint16_t pilot[2] = {2168, 0};
+    static const uint16_t sync[2] = {667, 735};
+    uint16_t symbols = g->symbols ? g->symbols : 256;
+    uint8_t p_max = g->wide ? 255 : 2;
+    uint8_t bits = 0;
+    while ((1u << bits) < symbols)
+        bits++;
+
+    b->len = 0;
+    put(b, BLK_GENERAL, 1);
+    put(b, 0, 4);
+    put(b, 0, 2); // No pause, so only the block's own words are compared
+    put(b, 2, 4); // Pilot RLE entries
+    put(b, p_max, 1);
+    put(b, g->wide ? 0 : 2, 1);
+    put(b, 8 * bytes / bits, 4);
+    put(b, g->max_pulses, 1);
+    put(b, g->symbols, 1);
+
+    put(b, 0, 1);
+    for (int i = 0; i < p_max; i++)
+        put(b, (i < 2) ? pilot[i] : 0, 2);
+    put(b, 0, 1);
+    for (int i = 0; i < p_max; i++)
+        put(b, (i < 2) ? sync[i] : 0, 2);
+    for (int x = 2; g->wide && (x < 256); x++)
+    {
+        put(b, 0, 1);
+        for (int i = 0; i < p_max; i++)
+            put(b, 100 + x + i, 2);
+    }
+    put(b, 0, 1); // Pilot x 3223
+    put(b, 3223, 2);
+    put(b, 1, 1); // Sync x 1
+    put(b, 1, 2);
+
+    for (int x = 0; x < symbols; x++)
+    {
+        put(b, g->wide ? 0 : g->flags[x], 1);
+        for (int i = 0; i < g->max_pulses; i++)
+            put(b, g->wide ? 500 + 2 * x : g->pulses[x][i], 2);
+    }
+    uint32_t seed = 1;
+    for (uint32_t i = 0; i < bytes; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        put(b, seed >> 16, 1);
+    }
+    uint32_t len = b->len - 5;
+    for (int x = 0; x < 4; x++)
+        b->data[1 + x] = (len >> (x * 8)) & 0xFF;
+}
+
+// The whole block through the player's decoder
+static uint32_t play_compiled(t_tape *t, pulse_t *words, uint32_t size)
+{
+    static pulse_t chunk[PULSE_CHUNK];
+    static t_decoder dec;
+    t_pulse_sink sink;
+    t_block_desc blk;
+    uint8_t hdr[TZX_HDR_MAX];
+
+    tape_read(t, 0, hdr, TZX_HDR_MAX);
+    uint8_t data = block_parse(BLK_GENERAL, hdr, &blk);
+    block_begin(&dec, &blk, t, data);
+    pulse_sink_init(&sink, chunk, PULSE_CHUNK);
+
+    uint32_t len = 0;
+    bool done;
+    do
+    {
+        done = block_fill(&dec, &sink);
+        for (uint32_t i = 0; (i < sink.pos) && (len < size); i++)
+            words[len++] = chunk[i];
+        sink.pos = 0;
+    } while (!done);
+    block_end(&dec);
+    return len;
+}
+
+// A symbol from its place in the tape: flags, then pulses
+static void send_symbol(t_tape *t, t_pulse_sink *s, uint32_t at, uint8_t max_pulses)
+{
+    switch (tape_byte(t, at))
+    {
+    case 0x01:
+        send_pulse(s, 0);
+        break;
+    case 0x02:
+        if (s->level == 1)
+            send_pulse(s, 0);
+        break;
+    case 0x03:
+        if (s->level == 0)
+            send_pulse(s, 0);
+        break;
+    default:
+        break;
+    }
+    for (uint8_t y = 0; y < max_pulses; y++)
+    {
+        uint16_t duration = tape_uint(t, at + 1 + 2 * y, 2);
+        if (duration == 0)
+            break;
+        send_pulse(s, duration);
+    }
+}
+
+// The whole block a symbol at a time, the sink big enough for all of it
+static uint32_t play_symbols(t_tape *t, t_pulse_sink *s)
+{
+    uint8_t hdr[TZX_HDR_MAX];
+    t_block_desc blk;
+    tape_read(t, 0, hdr, TZX_HDR_MAX);
+    uint32_t addr = block_parse(BLK_GENERAL, hdr, &blk);
+    s->pos = 0;
+    s->level = 1;
+
+    uint32_t p_size = 1 + 2 * blk.p_max_pulses;
+    uint32_t p_syms = addr;
+    addr += (blk.p_symbols ? blk.p_symbols : 256) * p_size;
+    for (uint32_t e = 0; e < blk.p_total; e++, addr += 3)
+    {
+        uint8_t sym = tape_byte(t, addr);
+        for (uint16_t n = tape_uint(t, addr + 1, 2); n > 0; n--)
+            send_symbol(t, s, p_syms + sym * p_size, blk.p_max_pulses);
+    }
+
+    uint16_t d_symbols = blk.d_symbols ? blk.d_symbols : 256;
+    uint8_t bits = 0;
+    while ((1u << bits) < d_symbols)
+        bits++;
+    uint32_t d_size = 1 + 2 * blk.d_max_pulses;
+    uint32_t d_syms = addr;
+    addr += d_symbols * d_size;
+
+    uint32_t cache = 0;
+    uint8_t left = 0;
+    for (uint32_t n = 0; n < blk.d_total; n++)
+    {
+        if (left < bits)
+        {
+            cache = (cache << 8) | tape_byte(t, addr++);
+            left += 8;
+        }
+        left -= bits;
+        uint8_t sym = (cache >> left) & ((1 << bits) - 1);
+        if (sym < d_symbols)
+            send_symbol(t, s, d_syms + sym * d_size, blk.d_max_pulses);
+    }
+    return s->pos;
+}
+
+static int usage(void)
+{
+    printf("Usage: tappioca-genbench [-k K of data] [-n times]\n");
+    return 2;
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t kbytes = 64, times = 20;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-k") && (i + 1 < argc))
+            kbytes = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-n") && (i + 1 < argc))
+            times = atoi(argv[++i]);
+        else
+            return usage();
+    }
+    if ((kbytes == 0) || (times == 0))
+        return usage();
+
+    // The most words a block can be: a pilot and sync, then a level change and two pulses a data bit
+    uint32_t size = 2 * 3223 + 2 + 3 * 8 * 1024 * kbytes;
+    pulse_t *compiled = malloc(size * sizeof(pulse_t));
+    pulse_t *symbols = malloc(size * sizeof(pulse_t));
+    t_buf b = {0};
+    if ((compiled == NULL) || (symbols == NULL))
+        return 1;
+
+    int failed = 0;
+    printf("%-28s %12s %14s %14s %8s\n", "Alphabet", "Words", "Symbols w/s", "Compiled w/s", "Speedup");
+    for (uint32_t x = 0; x < TESTS; x++)
+    {
+        t_tape tape;
+        t_pulse_sink sink;
+        make_block(&b, &tests[x], 1024 * kbytes);
+        tape_open_mem(&tape, b.data, b.len);
+        pulse_sink_init(&sink, symbols, size);
+
+        uint32_t n_sym = play_symbols(&tape, &sink);
+        uint32_t n_comp = play_compiled(&tape, compiled, size);
+        uint32_t diff = 0;
+        while ((diff < n_sym) && (diff < n_comp) && (symbols[diff] == compiled[diff]))
+            diff++;
+        if ((n_sym != n_comp) || (diff != n_sym))
+        {
+            printf("%s: %u words a symbol at a time, %u compiled, differing from word %u\n", tests[x].name, n_sym,
+                   n_comp, diff);
+            failed++;
+            continue;
+        }
+
+        clock_t start = clock();
+        for (uint32_t n = 0; n < times; n++)
+            play_symbols(&tape, &sink);
+        double sym_secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+        start = clock();
+        for (uint32_t n = 0; n < times; n++)
+            play_compiled(&tape, compiled, size);
+        double comp_secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+        double words = (double)n_comp * times;
+        if ((sym_secs > 0) && (comp_secs > 0))
+            printf("%-28s %12u %14.0f %14.0f %7.2fx\n", tests[x].name, n_comp, words / sym_secs, words / comp_secs,
+                   sym_secs / comp_secs);
+        else
+            printf("%-28s %12u %14s %14s\n", tests[x].name, n_comp, "-", "-");
+    }
+
+    free(compiled);
+    free(symbols);
+    free(b.data);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,228 @@
+/*
+ * tappioca-multi - play several tapes at once, as the firmware does with MORE_PINS
+ *
+ * Each tape given is an output of its own (-n plays each one on that many
+ * outputs), and they are all fed by the scheduler in outputs.h from the one
+ * thread, into modelled DMA rings (see ringsim.h). Every ring plays out in
+ * real time while each chunk is decoded, whichever output it is for, so the
+ * headroom and underruns of each output are what a player this fast would
+ * see driving all of them. -t scales the decoding time, as for
+ * tappioca-render, to see how many outputs a slower CPU could keep fed.
+ *
+ * Every output is checked word for word against its tape rendered on its
+ * own, through a player and window of its own, so outputs sharing a core -
+ * or a tape - are shown not to get in each other's way. The exit status is
+ * 1 if any output differs.
+ */
+#include <stdio.h>  // printf
+#include <stdlib.h> // atoi, atof, calloc
+#include <string.h> // strcmp
+#include "ff.h"
+#include "tapeio.h"
+#include "player.h"
+#include "outputs.h"
+#include "ringsim.h"
+
+// Most outputs, as a uint8_t for outputs_service()
+#define OUTPUTS_MAX 255
+
+// Time let go by when no output has room for a chunk
+#define WAIT_US 1000
+
+// A tape rendered on its own, to check an output against
+typedef struct t_check
+{
+    FIL fh;
+    uint8_t window[2][TAPE_CHUNK];
+    t_tape tape;
+    t_player player;
+    t_pulse_sink sink;
+    pulse_t chunk[PULSE_CHUNK];
+    uint32_t pos;
+    bool done;
+} t_check;
+
+typedef struct t_sim_out
+{
+    const char *name;
+    FIL fh;
+    uint8_t window[2][TAPE_CHUNK];
+    t_ring_model ring;
+
+    // The chunk handed over - queued once the time taken to decode it has played out, but counted already
+    const pulse_t *pending;
+    uint32_t count;
+
+    t_check check;
+    uint64_t words;
+    int64_t bad_at;
+} t_sim_out;
+
+static uint32_t sim_level(void *ctx)
+{
+    t_sim_out *s = ctx;
+    return s->ring.queued + s->count;
+}
+
+static uint32_t sim_space(void *ctx)
+{
+    t_sim_out *s = ctx;
+    return RING_WORDS - s->ring.queued - s->count;
+}
+
+// Next word of the reference render, false once it has ended
+static bool check_next(t_check *c, pulse_t *word)
+{
+    while (c->pos == c->sink.pos)
+    {
+        if (c->done)
+            return false;
+        c->sink.pos = 0;
+        c->pos = 0;
+        c->done = player_fill(&c->player, &c->sink);
+    }
+    *word = c->chunk[c->pos++];
+    return true;
+}
+
+static void sim_write(void *ctx, const pulse_t *words, uint32_t count)
+{
+    t_sim_out *s = ctx;
+    pulse_t word;
+
+    for (uint32_t i = 0; i < count; i++, s->words++)
+    {
+        if ((s->bad_at < 0) && (!check_next(&s->check, &word) || (word != words[i])))
+            s->bad_at = s->words;
+    }
+    s->pending = words;
+    s->count = count;
+}
+
+static bool open_tape(const char *name, FIL *fh, t_tape *t, uint8_t (*window)[TAPE_CHUNK], t_player *p)
+{
+    if (f_open(fh, name, FA_READ) != FR_OK)
+    {
+        printf("Cannot open %s\n", name);
+        return false;
+    }
+    tape_open(t, tape_read_fatfs, fh, f_size(fh), window);
+    if (!player_open(p, t))
+    {
+        printf("%s: not a tape that can be played\n", name);
+        return false;
+    }
+    return true;
+}
+
+static int usage(void)
+{
+    printf("Usage: tappioca-multi [-n copies] [-t slowdown] <tape>...\n");
+    return 2;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *names[OUTPUTS_MAX];
+    int tapes = 0, copies = 1;
+    double slowdown = 1;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-n") && (i + 1 < argc))
+            copies = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-t") && (i + 1 < argc))
+            slowdown = atof(argv[++i]);
+        else if (tapes < OUTPUTS_MAX)
+            names[tapes++] = argv[i];
+        else
+            return usage();
+    }
+    if ((tapes == 0) || (copies < 1) || (slowdown <= 0) || (tapes * copies > OUTPUTS_MAX))
+        return usage();
+
+    uint8_t n = tapes * copies;
+    t_output *outs = calloc(n, sizeof(t_output));
+    t_sim_out *sims = calloc(n, sizeof(t_sim_out));
+    if ((outs == NULL) || (sims == NULL))
+        return 1;
+
+    for (uint8_t i = 0; i < n; i++)
+    {
+        t_sim_out *s = &sims[i];
+        t_check *c = &s->check;
+        t_out_queue q = {sim_level, sim_space, sim_write, s};
+
+        s->name = names[i % tapes];
+        s->bad_at = -1;
+        output_init(&outs[i], &q);
+        if (!open_tape(s->name, &s->fh, &outs[i].tape, s->window, &outs[i].player) ||
+            !open_tape(s->name, &c->fh, &c->tape, c->window, &c->player))
+            return 1;
+        pulse_sink_init(&c->sink, c->chunk, PULSE_CHUNK);
+        output_rewind(&outs[i]);
+    }
+
+    // Simulated time, and the part of it spent decoding
+    uint64_t sim_us = 0, busy_us = 0;
+    while (!outputs_done(outs, n))
+    {
+        uint64_t before = ring_clock_us(slowdown);
+        int x = outputs_service(outs, n);
+        uint64_t us = ring_clock_us(slowdown) - before;
+        if (x < 0)
+        {
+            // Every ring is full - wait for one to play out
+            outputs_prefetch(outs, n);
+            us = WAIT_US;
+        }
+        else
+            busy_us += us;
+        sim_us += us;
+
+        for (uint8_t i = 0; i < n; i++)
+            ring_play(&sims[i].ring, us);
+        if (x >= 0)
+        {
+            ring_push(&sims[x].ring, sims[x].pending, sims[x].count);
+            sims[x].count = 0;
+            if (outs[x].done)
+                ring_drain(&sims[x].ring);
+        }
+    }
+
+    int status = 0;
+    for (uint8_t i = 0; i < n; i++)
+    {
+        t_sim_out *s = &sims[i];
+        pulse_t word;
+
+        // Anything left in the reference is missing from the output
+        if ((s->bad_at < 0) && check_next(&s->check, &word))
+            s->bad_at = s->words;
+
+        printf("%3u %-24s %10llu words, %5u chunks, queued %4u-%4u of %u, %u underruns, ", i, s->name,
+               (unsigned long long)s->words, outs[i].chunks, (outs[i].chunks > 1) ? outs[i].lo_water : 0,
+               outs[i].hi_water, RING_WORDS, s->ring.stalls);
+        if (s->bad_at < 0)
+            printf("matches\n");
+        else
+        {
+            printf("differs at word %lld\n", (long long)s->bad_at);
+            status = 1;
+        }
+
+        player_close(&outs[i].player);
+        player_close(&s->check.player);
+        f_close(&s->fh);
+        f_close(&s->check.fh);
+    }
+
+    if (sim_us > 0)
+        printf("%u outputs played in %.3f secs, decoding for %.3f secs (%.1f%% of one core)\n", n,
+               (double)sim_us / 1000000, (double)busy_us / 1000000, (double)busy_us * 100 / sim_us);
+
+    free(outs);
+    free(sims);
+    return status;
+}
@@ -0,0 +1,741 @@
+/*
+ * tappioca-pack - pack tapes into one compressed archive for the flash
+ *
+ * Each tape is cut into TAPE_CHUNK byte chunks, and each chunk deflated on
+ * its own (see tapepack.h), with a hash-chained LZ77 search and whichever
+ * of the fixed or its own Huffman codes comes out shorter. A chunk that
+ * will not shrink is stored as it is. Any zlib stream with a window of
+ * TAPE_CHUNK or less would do, so a better compressor could be swapped in
+ * without touching the firmware.
+ *
+ * An output name ending in ".h" gets a header to build into the firmware
+ * (see USE_PACK in main.c), anything else gets the archive as it is.
+ *
+ * The archive is then read back through the same code as the firmware:
+ * every tape is checked against the original, and timed inflating the way
+ * playback reads it, a window half at a time. Each tape is also opened and
+ * decoded without playing, to find where playback reads it fastest - so the
+ * output shows how far ahead of the PIO the inflating keeps.
+ */
+#include <stdio.h>  // printf
+#include <stdlib.h> // malloc, realloc
+#include <string.h> // strlen, strrchr
+#include <time.h>   // clock
+#include "player.h"
+#include "tapepack.h"
+
+// Candidates looked at for each match, and the hash over three bytes
+#define CHAIN_MAX 256
+#define HASH_BITS 12
+
+// Time spent inflating, for a steady figure with small tapes
+#define BENCH_SECS 0.5
+
+typedef struct t_buf
+{
+    uint8_t *data;
+    uint32_t len;
+    uint32_t size;
+
+    // Bits not yet written out, LSB first
+    uint32_t bitbuf;
+    uint8_t bitcnt;
+} t_buf;
+
+static void put(t_buf *b, uint32_t value, int width)
+{
+    if (b->len + width > b->size)
+    {
+        b->size = 2 * b->size + width;
+        b->data = realloc(b->data, b->size);
+    }
+    for (int x = 0; x < width; x++)
+        b->data[b->len++] = (value >> (x * 8)) & 0xFF;
+}
+
+static void put_bytes(t_buf *b, const uint8_t *data, uint32_t len)
+{
+    for (uint32_t i = 0; i < len; i++)
+        put(b, data[i], 1);
+}
+
+static void patch(t_buf *b, uint32_t at, uint32_t value, int width)
+{
+    for (int x = 0; x < width; x++)
+        b->data[at + x] = (value >> (x * 8)) & 0xFF;
+}
+
+/*
+ * Deflate
+ */
+static const uint16_t len_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t len_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t dist_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const uint8_t dist_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+// Order the code length code lengths are sent in
+static const uint8_t clen_order[19] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+// A literal (len 0), or a match of len bytes dist back
+typedef struct t_token
+{
+    uint16_t len;
+    uint16_t value;
+} t_token;
+
+// A Huffman code: the length of each symbol's code, and the code
+typedef struct t_code
+{
+    uint8_t len[288];
+    uint16_t code[288];
+} t_code;
+
+static void put_bits(t_buf *b, uint32_t value, uint8_t n)
+{
+    b->bitbuf |= value << b->bitcnt;
+    b->bitcnt += n;
+    while (b->bitcnt >= 8)
+    {
+        put(b, b->bitbuf & 0xFF, 1);
+        b->bitbuf >>= 8;
+        b->bitcnt -= 8;
+    }
+}
+
+static void flush_bits(t_buf *b)
+{
+    if (b->bitcnt > 0)
+        put(b, b->bitbuf & 0xFF, 1);
+    b->bitbuf = 0;
+    b->bitcnt = 0;
+}
+
+// Huffman codes go out MSB first
+static void put_code(t_buf *b, const t_code *c, uint16_t sym)
+{
+    uint32_t rev = 0;
+    for (uint8_t x = 0; x < c->len[sym]; x++)
+        rev |= ((c->code[sym] >> x) & 1) << (c->len[sym] - 1 - x);
+    put_bits(b, rev, c->len[sym]);
+}
+
+static int len_code(uint16_t len)
+{
+    int code = 28;
+    while (len_base[code] > len)
+        code--;
+    return code;
+}
+
+static int dist_code(uint16_t dist)
+{
+    int code = 29;
+    while (dist_base[code] > dist)
+        code--;
+    return code;
+}
+
+// Canonical codes from the lengths, as RFC 1951 3.2.2
+static void make_codes(t_code *c, int n)
+{
+    uint16_t count[16] = {0}, next[16];
+
+    for (int sym = 0; sym < n; sym++)
+        count[c->len[sym]]++;
+    count[0] = 0;
+    next[0] = 0;
+    for (int len = 1; len < 16; len++)
+        next[len] = (next[len - 1] + count[len - 1]) << 1;
+    for (int sym = 0; sym < n; sym++)
+        c->code[sym] = c->len[sym] ? next[c->len[sym]]++ : 0;
+}
+
+/*
+ * Huffman code lengths for the symbol counts, none longer than limit. Too
+ * long a code is rare enough that halving the counts until it fits costs
+ * next to nothing.
+ */
+static void make_lengths(t_code *c, const uint32_t *count, int n, uint8_t limit)
+{
+    uint32_t weight[2 * 288];
+    int16_t parent[2 * 288];
+    uint32_t scaled[288];
+
+    memcpy(scaled, count, n * sizeof(uint32_t));
+    while (true)
+    {
+        // Leaves first, then each merge of the two lightest nodes left
+        int nodes = 0, used = 0;
+        for (int sym = 0; sym < n; sym++)
+        {
+            weight[sym] = scaled[sym];
+            parent[sym] = -1;
+            used += (scaled[sym] > 0);
+        }
+        nodes = n;
+
+        memset(c->len, 0, n);
+        if (used < 2)
+        {
+            // One code still needs a bit
+            for (int sym = 0; sym < n; sym++)
+                c->len[sym] = (scaled[sym] > 0);
+            return;
+        }
+
+        for (int merges = 0; merges < used - 1; merges++)
+        {
+            int lo[2] = {-1, -1};
+            for (int x = 0; x < nodes; x++)
+            {
+                if ((weight[x] == 0) || (parent[x] >= 0))
+                    continue;
+                if ((lo[0] < 0) || (weight[x] < weight[lo[0]]))
+                {
+                    lo[1] = lo[0];
+                    lo[0] = x;
+                }
+                else if ((lo[1] < 0) || (weight[x] < weight[lo[1]]))
+                    lo[1] = x;
+            }
+            weight[nodes] = weight[lo[0]] + weight[lo[1]];
+            parent[nodes] = -1;
+            parent[lo[0]] = parent[lo[1]] = nodes++;
+        }
+
+        uint8_t longest = 0;
+        for (int sym = 0; sym < n; sym++)
+        {
+            for (int x = sym; (scaled[sym] > 0) && (parent[x] >= 0); x = parent[x])
+                c->len[sym]++;
+            if (c->len[sym] > longest)
+                longest = c->len[sym];
+        }
+        if (longest <= limit)
+            return;
+
+        for (int sym = 0; sym < n; sym++)
+            scaled[sym] = (scaled[sym] + 1) / 2;
+    }
+}
+
+static void put_tokens(t_buf *b, const t_token *t, uint32_t n, const t_code *lit, const t_code *dist)
+{
+    for (uint32_t i = 0; i < n; i++)
+    {
+        if (t[i].len == 0)
+        {
+            put_code(b, lit, t[i].value);
+            continue;
+        }
+        int code = len_code(t[i].len);
+        put_code(b, lit, 257 + code);
+        put_bits(b, t[i].len - len_base[code], len_extra[code]);
+
+        code = dist_code(t[i].value);
+        put_code(b, dist, code);
+        put_bits(b, t[i].value - dist_base[code], dist_extra[code]);
+    }
+    put_code(b, lit, 256);
+}
+
+static uint32_t hash3(const uint8_t *p)
+{
+    return ((p[0] << 16 | p[1] << 8 | p[2]) * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// Longest earlier match for the bytes at pos, 0 if under 3
+static uint16_t find_match(const uint8_t *data, uint32_t len, uint32_t pos, const int16_t *head,
+                           const int16_t *prev, uint16_t *dist)
+{
+    uint16_t best = 0;
+    uint32_t most = len - pos;
+    if (most > 258)
+        most = 258;
+    if (most < 3)
+        return 0;
+
+    int32_t at = head[hash3(data + pos)];
+    for (int chain = 0; (at >= 0) && (chain < CHAIN_MAX); chain++, at = prev[at])
+    {
+        uint16_t n = 0;
+        while ((n < most) && (data[at + n] == data[pos + n]))
+            n++;
+        if (n > best)
+        {
+            best = n;
+            *dist = pos - at;
+            if (n == most)
+                break;
+        }
+    }
+    return (best >= 3) ? best : 0;
+}
+
+// Literals and matches for a chunk, matching as lazily as zlib does
+static uint32_t find_tokens(const uint8_t *data, uint32_t len, t_token *t)
+{
+    static int16_t head[1 << HASH_BITS];
+    static int16_t prev[TAPE_CHUNK];
+    memset(head, 0xFF, sizeof(head));
+
+    uint32_t n = 0, pos = 0, hashed = 0;
+    while (pos < len)
+    {
+        // Everything before pos can be matched against
+        for (; (hashed < pos) && (hashed + 3 <= len); hashed++)
+        {
+            uint32_t h = hash3(data + hashed);
+            prev[hashed] = head[h];
+            head[h] = hashed;
+        }
+
+        uint16_t dist = 0, next_dist = 0;
+        uint16_t match = find_match(data, len, pos, head, prev, &dist);
+        if (match > 0)
+        {
+            // If the next byte starts a longer match, this one goes out as a literal
+            if (hashed + 3 <= len)
+            {
+                uint32_t h = hash3(data + hashed);
+                prev[hashed] = head[h];
+                head[h] = hashed;
+                hashed++;
+            }
+            if (find_match(data, len, pos + 1, head, prev, &next_dist) <= match)
+            {
+                t[n++] = (t_token){match, dist};
+                pos += match;
+                continue;
+            }
+        }
+        t[n++] = (t_token){0, data[pos++]};
+    }
+    return n;
+}
+
+static void deflate_fixed(t_buf *b, const t_token *t, uint32_t n)
+{
+    t_code lit, dist;
+    int sym = 0;
+
+    for (; sym < 144; sym++)
+        lit.len[sym] = 8;
+    for (; sym < 256; sym++)
+        lit.len[sym] = 9;
+    for (; sym < 280; sym++)
+        lit.len[sym] = 7;
+    for (; sym < 288; sym++)
+        lit.len[sym] = 8;
+    memset(dist.len, 5, 30);
+    make_codes(&lit, 288);
+    make_codes(&dist, 30);
+
+    put_bits(b, 1, 1); // Last block
+    put_bits(b, 1, 2); // Fixed codes
+    put_tokens(b, t, n, &lit, &dist);
+    flush_bits(b);
+}
+
+static void deflate_dynamic(t_buf *b, const t_token *t, uint32_t n)
+{
+    uint32_t lit_count[288] = {0}, dist_count[30] = {0}, clen_count[19] = {0};
+    t_code lit, dist, clen;
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        if (t[i].len == 0)
+            lit_count[t[i].value]++;
+        else
+        {
+            lit_count[257 + len_code(t[i].len)]++;
+            dist_count[dist_code(t[i].value)]++;
+        }
+    }
+    lit_count[256] = 1;
+
+    // A distance code is sent even with no matches
+    if (n == 0 || memcmp(dist_count, (uint32_t[30]){0}, sizeof(dist_count)) == 0)
+        dist_count[0] = 1;
+
+    make_lengths(&lit, lit_count, 286, 15);
+    make_lengths(&dist, dist_count, 30, 15);
+    make_codes(&lit, 286);
+    make_codes(&dist, 30);
+
+    int nlit = 286, ndist = 30;
+    while (lit.len[nlit - 1] == 0)
+        nlit--;
+    while ((ndist > 1) && (dist.len[ndist - 1] == 0))
+        ndist--;
+
+    // Both sets of lengths, run-length coded: 16 repeats the last, 17 and 18 are zeros
+    uint8_t lengths[286 + 30], runs[286 + 30][2];
+    int total = 0, nruns = 0;
+    memcpy(lengths, lit.len, nlit);
+    memcpy(lengths + nlit, dist.len, ndist);
+    total = nlit + ndist;
+    for (int i = 0; i < total;)
+    {
+        int run = 1;
+        while ((i + run < total) && (lengths[i + run] == lengths[i]))
+            run++;
+
+        if ((lengths[i] == 0) && (run >= 3))
+        {
+            run = (run > 138) ? 138 : run;
+            runs[nruns][0] = (run >= 11) ? 18 : 17;
+            runs[nruns++][1] = run;
+        }
+        else if ((i > 0) && (lengths[i] == lengths[i - 1]) && (run >= 3))
+        {
+            run = (run > 6) ? 6 : run;
+            runs[nruns][0] = 16;
+            runs[nruns++][1] = run;
+        }
+        else
+        {
+            run = 1;
+            runs[nruns][0] = lengths[i];
+            runs[nruns++][1] = 1;
+        }
+        clen_count[runs[nruns - 1][0]]++;
+        i += run;
+    }
+    make_lengths(&clen, clen_count, 19, 7);
+    make_codes(&clen, 19);
+
+    int nclen = 19;
+    while ((nclen > 4) && (clen.len[clen_order[nclen - 1]] == 0))
+        nclen--;
+
+    put_bits(b, 1, 1); // Last block
+    put_bits(b, 2, 2); // Dynamic codes
+    put_bits(b, nlit - 257, 5);
+    put_bits(b, ndist - 1, 5);
+    put_bits(b, nclen - 4, 4);
+    for (int i = 0; i < nclen; i++)
+        put_bits(b, clen.len[clen_order[i]], 3);
+    for (int i = 0; i < nruns; i++)
+    {
+        put_code(b, &clen, runs[i][0]);
+        if (runs[i][0] == 16)
+            put_bits(b, runs[i][1] - 3, 2);
+        else if (runs[i][0] == 17)
+            put_bits(b, runs[i][1] - 3, 3);
+        else if (runs[i][0] == 18)
+            put_bits(b, runs[i][1] - 11, 7);
+    }
+    put_tokens(b, t, n, &lit, &dist);
+    flush_bits(b);
+}
+
+static uint32_t adler32(const uint8_t *data, uint32_t len)
+{
+    uint32_t a = 1, s = 0;
+    for (uint32_t i = 0; i < len; i++)
+    {
+        a = (a + data[i]) % 65521;
+        s = (s + a) % 65521;
+    }
+    return (s << 16) | a;
+}
+
+// A chunk as a zlib stream, with a window of TAPE_CHUNK - whichever block type is shortest
+static void put_chunk(t_buf *b, const uint8_t *data, uint32_t len)
+{
+    static t_token tokens[TAPE_CHUNK];
+    static t_buf fixed;
+
+    uint8_t cmf = 0x08 | ((__builtin_ctz(TAPE_CHUNK) - 8) << 4);
+    put(b, cmf, 1);
+    put(b, 31 - (cmf << 8) % 31, 1);
+
+    uint32_t n = find_tokens(data, len, tokens);
+    fixed.len = 0;
+    deflate_fixed(&fixed, tokens, n);
+
+    uint32_t start = b->len;
+    deflate_dynamic(b, tokens, n);
+    if (b->len - start > fixed.len)
+    {
+        b->len = start;
+        put_bytes(b, fixed.data, fixed.len);
+    }
+
+    // Stored instead, if that is shorter still
+    if (b->len - start > len + 5)
+    {
+        b->len = start;
+        put(b, 1, 1); // Last block, stored
+        put(b, len, 2);
+        put(b, ~len & 0xFFFF, 2);
+        put_bytes(b, data, len);
+    }
+
+    uint32_t adler = adler32(data, len);
+    for (int x = 3; x >= 0; x--)
+        put(b, (adler >> (x * 8)) & 0xFF, 1);
+}
+
+static uint8_t *load(const char *name, uint32_t *size)
+{
+    FILE *fh = fopen(name, "rb");
+    if (fh == NULL)
+        return NULL;
+    fseek(fh, 0, SEEK_END);
+    *size = ftell(fh);
+    fseek(fh, 0, SEEK_SET);
+
+    uint8_t *data = malloc(*size ? *size : 1);
+    if ((data != NULL) && (fread(data, 1, *size, fh) != *size))
+    {
+        free(data);
+        data = NULL;
+    }
+    fclose(fh);
+    return data;
+}
+
+static bool save(const char *name, const t_buf *b, int tapes, char *paths[])
+{
+    FILE *out = fopen(name, "wb");
+    if (out == NULL)
+        return false;
+
+    uint32_t len = strlen(name);
+    if ((len > 2) && !strcmp(name + len - 2, ".h"))
+    {
+        // As the samples are, but const so it stays in flash
+        fprintf(out, "/*\n * Tapes packed by tappioca-pack:\n");
+        for (int x = 0; x < tapes; x++)
+            fprintf(out, " * %s\n", paths[x]);
+        fprintf(out, " */\n\nstatic const uint8_t pack_data[] = {");
+        for (uint32_t i = 0; i < b->len; i++)
+            fprintf(out, "%s0x%02x,", (i % 16) ? " " : "\n\t", b->data[i]);
+        fprintf(out, "\n};\n");
+    }
+    else
+        fwrite(b->data, 1, b->len, out);
+
+    return fclose(out) == 0;
+}
+
+static const char *base_name(const char *path)
+{
+    const char *slash = strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
+
+/*
+ * Reading it back
+ */
+
+// Every tape read through the window as playback does, false if any differs
+static bool check(t_pack *pack, uint8_t *tapes[])
+{
+    static uint8_t window[2][TAPE_CHUNK];
+    t_pack_reader reader;
+    t_tape tape;
+
+    for (uint16_t n = 0; n < pack->count; n++)
+    {
+        if (!pack_tape_open(pack, n, &reader, &tape, window))
+            return false;
+        for (uint32_t addr = 0; addr < tape.size; addr++)
+        {
+            if (tape_byte(&tape, addr) != tapes[n][addr])
+            {
+                printf("Tape %u differs at %u\n", n, addr);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Bytes per second inflated, a window half at a time
+static double bench(t_pack *pack)
+{
+    static uint8_t window[2][TAPE_CHUNK];
+    t_pack_reader reader;
+    t_tape tape;
+    uint64_t bytes = 0;
+
+    clock_t start = clock();
+    do
+    {
+        for (uint16_t n = 0; n < pack->count; n++)
+        {
+            pack_tape_open(pack, n, &reader, &tape, window);
+            for (uint32_t addr = 0; addr < tape.size; addr += TAPE_CHUNK)
+                bytes += tape_read_pack(&reader, addr, window[0], TAPE_CHUNK);
+        }
+    } while ((bytes > 0) && (clock() - start < BENCH_SECS * CLOCKS_PER_SEC));
+
+    return bytes * (double)CLOCKS_PER_SEC / (clock() - start + 1);
+}
+
+// When play first reaches block b, in PIO cycles - the end of the tape past the last one
+static uint64_t reached(const t_player *p, uint16_t b)
+{
+    if (b < p->blocks)
+        return p->seek[b].at;
+    return p->duration ? p->duration * PULSE_SCALE : SEEK_NEVER;
+}
+
+/*
+ * The most bytes per second a window half's worth of a tape is read at as
+ * it plays: from each block, the blocks up to a TAPE_CHUNK on, timed from
+ * when play reaches the first to when it reaches the one after the last.
+ * A chunk has to inflate quicker than that, to be ready in time.
+ */
+static double fastest_read(t_pack *pack, uint16_t n, uint64_t *duration)
+{
+    static uint8_t window[2][TAPE_CHUNK];
+    static pulse_t chunk[PULSE_CHUNK];
+    t_pulse_sink sink;
+    t_pack_reader reader;
+    t_tape tape;
+    t_player player;
+    double fastest = 0;
+
+    pulse_sink_init(&sink, chunk, PULSE_CHUNK);
+    *duration = 0;
+    if (!pack_tape_open(pack, n, &reader, &tape, window) || !player_open(&player, &tape))
+        return 0;
+
+    *duration = player_duration(&player, &sink);
+    for (uint16_t b = 0; (player.seek != NULL) && (b < player.blocks); b++)
+    {
+        uint16_t end = b + 1;
+        while ((end < player.blocks) && (player.index[end].addr - player.index[b].addr < TAPE_CHUNK))
+            end++;
+        uint32_t bytes = ((end < player.blocks) ? player.index[end].addr : tape.size) - player.index[b].addr;
+
+        // Only where play runs straight through, not round a loop or jump
+        uint64_t from = reached(&player, b), to = reached(&player, end);
+        if ((from == SEEK_NEVER) || (to == SEEK_NEVER) || (to <= from))
+            continue;
+
+        double rate = bytes / ((double)(to - from) / PULSE_SCALE / FREQ);
+        if (rate > fastest)
+            fastest = rate;
+    }
+    player_close(&player);
+    return fastest;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3)
+    {
+        printf("Usage: tappioca-pack <output> <tape>...\n");
+        return 1;
+    }
+    int count = argc - 2;
+    char **paths = argv + 2;
+    if (count > UINT16_MAX)
+    {
+        printf("Too many tapes\n");
+        return 1;
+    }
+
+    uint8_t **tapes = calloc(count, sizeof(uint8_t *));
+    uint32_t *sizes = calloc(count, sizeof(uint32_t));
+    uint32_t chunks = 0, total = 0;
+    for (int x = 0; x < count; x++)
+    {
+        if (strlen(base_name(paths[x])) >= PACK_NAME)
+        {
+            printf("%s: the name is too long\n", paths[x]);
+            return 1;
+        }
+        if ((tapes[x] = load(paths[x], &sizes[x])) == NULL)
+        {
+            printf("Cannot read %s\n", paths[x]);
+            return 1;
+        }
+        chunks += (sizes[x] + TAPE_CHUNK - 1) / TAPE_CHUNK;
+        total += sizes[x];
+    }
+
+    // Header, then the directory
+    t_buf b = {0};
+    put_bytes(&b, (const uint8_t *)PACK_MAGIC, 4);
+    put(&b, PACK_VERSION, 2);
+    put(&b, count, 2);
+    put(&b, chunks, 4);
+
+    uint32_t chunk = 0;
+    for (int x = 0; x < count; x++)
+    {
+        char name[PACK_NAME] = {0};
+        strcpy(name, base_name(paths[x]));
+        put_bytes(&b, (const uint8_t *)name, PACK_NAME);
+        put(&b, sizes[x], 4);
+        put(&b, chunk, 4);
+        chunk += (sizes[x] + TAPE_CHUNK - 1) / TAPE_CHUNK;
+    }
+
+    // The chunks, with their offsets filled in as they go
+    uint32_t table = b.len;
+    for (uint32_t i = 0; i <= chunks; i++)
+        put(&b, 0, 4);
+
+    chunk = 0;
+    for (int x = 0; x < count; x++)
+    {
+        for (uint32_t addr = 0; addr < sizes[x]; addr += TAPE_CHUNK)
+        {
+            uint32_t len = sizes[x] - addr;
+            if (len > TAPE_CHUNK)
+                len = TAPE_CHUNK;
+            patch(&b, table + chunk++ * 4, b.len, 4);
+            put_chunk(&b, tapes[x] + addr, len);
+        }
+    }
+    patch(&b, table + chunk * 4, b.len, 4);
+
+    printf("%d tapes, %u bytes packed into %u (%.1f%%), %u chunks\n", count, total, b.len,
+           total ? 100.0 * b.len / total : 0, chunks);
+    if (!save(argv[1], &b, count, paths))
+    {
+        printf("Cannot write %s\n", argv[1]);
+        return 1;
+    }
+
+    // Read back as the firmware would
+    t_pack pack;
+    if (!pack_open(&pack, b.data, b.len) || !check(&pack, tapes))
+    {
+        printf("The archive does not read back\n");
+        return 1;
+    }
+    double rate = bench(&pack);
+    printf("Inflates at %.1f MB/sec\n", rate / 1e6);
+
+    double need = 0;
+    for (uint16_t n = 0; n < count; n++)
+    {
+        uint64_t duration;
+        double fastest = fastest_read(&pack, n, &duration);
+        printf("%5u: %-32s %8u bytes %7.1f secs, read at up to %.0f bytes/sec\n", n, base_name(paths[n]), sizes[n],
+               (double)duration / FREQ, fastest);
+        if (fastest > need)
+            need = fastest;
+    }
+    if (need > 0)
+        printf("Inflating keeps %.0fx ahead of the fastest read\n", rate / need);
+
+    return 0;
+}
@@ -0,0 +1,533 @@
+#include <ctype.h>  // isspace, tolower
+#include <stdio.h>  // fopen, printf
+#include <stdlib.h> // strtoul
+#include <string.h> // strcmp, strstr
+#include "piosim.h"
+
+#define LINE_MAX_LEN 256
+
+typedef struct t_label
+{
+    char name[32];
+    uint8_t at;
+} t_label;
+
+// Source of the program's instructions, kept for the second pass
+typedef struct t_source
+{
+    char lines[PIO_PROG_MAX][LINE_MAX_LEN];
+    int line_no[PIO_PROG_MAX];
+    t_label labels[PIO_PROG_MAX];
+    uint8_t label_count;
+} t_source;
+
+static char *trim(char *s)
+{
+    while (isspace((unsigned char)*s))
+        s++;
+    char *end = s + strlen(s);
+    while ((end > s) && isspace((unsigned char)end[-1]))
+        *--end = '\0';
+    return s;
+}
+
+static bool parse_number(const char *s, uint32_t *value)
+{
+    char *end;
+    if (!strncmp(s, "0b", 2))
+        *value = strtoul(s + 2, &end, 2);
+    else
+        *value = strtoul(s, &end, 0);
+    return (*s != '\0') && (*end == '\0');
+}
+
+static int find_arg(const char *s, const char *const names[], const uint8_t args[], int count)
+{
+    for (int x = 0; x < count; x++)
+    {
+        if (!strcmp(s, names[x]))
+            return args[x];
+    }
+    return -1;
+}
+
+// Operands, split on spaces and commas
+static int split(char *s, char *tok[], int max)
+{
+    int n = 0;
+    for (char *t = strtok(s, " \t,"); t && (n < max); t = strtok(NULL, " \t,"))
+        tok[n++] = t;
+    return n;
+}
+
+static bool parse_instr(t_pio_instr *i, char *text, const t_source *src)
+{
+    static const char *const conds[] = {"!x", "x--", "!y", "y--", "x!=y", "!osre"};
+    static const uint8_t cond_args[] = {ARG_NOT_X, ARG_X_DEC, ARG_NOT_Y, ARG_Y_DEC, ARG_X_NE_Y, ARG_NOT_OSRE};
+    static const char *const outs[] = {"pins", "x", "y", "null", "pindirs", "pc"};
+    static const uint8_t out_args[] = {ARG_PINS, ARG_X, ARG_Y, ARG_NULL, ARG_PINDIRS, ARG_PC};
+    static const char *const movs[] = {"pins", "x", "y", "null", "pc", "osr", "isr"};
+    static const uint8_t mov_args[] = {ARG_PINS, ARG_X, ARG_Y, ARG_NULL, ARG_PC, ARG_OSR, ARG_ISR};
+    char *tok[6];
+    uint32_t value;
+
+    memset(i, 0, sizeof(*i));
+
+    // Delay, e.g. "[3]"
+    char *delay = strchr(text, '[');
+    if (delay != NULL)
+    {
+        *delay++ = '\0';
+        char *close = strchr(delay, ']');
+        if ((close == NULL) || (*close = '\0', !parse_number(trim(delay), &value)) || (value > 31))
+            return false;
+        i->delay = value;
+    }
+
+    for (char *c = text; *c; c++)
+        *c = tolower((unsigned char)*c);
+    int n = split(text, tok, 6);
+    if (n == 0)
+        return false;
+
+    if (!strcmp(tok[0], "nop") && (n == 1))
+    {
+        i->op = PIO_MOV;
+        i->dest = ARG_Y;
+        i->src = ARG_Y;
+        return true;
+    }
+    if (!strcmp(tok[0], "jmp") && ((n == 2) || (n == 3)))
+    {
+        i->op = PIO_JMP;
+        i->dest = ARG_ALWAYS;
+        if (n == 3)
+        {
+            int cond = find_arg(tok[1], conds, cond_args, 6);
+            if (cond < 0)
+                return false;
+            i->dest = cond;
+        }
+
+        const char *target = tok[n - 1];
+        for (int x = 0; x < src->label_count; x++)
+        {
+            if (!strcmp(target, src->labels[x].name))
+            {
+                i->value = src->labels[x].at;
+                return true;
+            }
+        }
+        return parse_number(target, &i->value) && (i->value < PIO_PROG_MAX);
+    }
+    if (!strcmp(tok[0], "out") && (n == 3))
+    {
+        int dest = find_arg(tok[1], outs, out_args, 6);
+        i->op = PIO_OUT;
+        i->dest = dest;
+        return (dest >= 0) && parse_number(tok[2], &i->value) && (i->value >= 1) && (i->value <= 32);
+    }
+    if (!strcmp(tok[0], "set") && (n == 3))
+    {
+        int dest = find_arg(tok[1], outs, out_args, 5);
+        i->op = PIO_SET;
+        i->dest = dest;
+        return (dest >= 0) && (dest != ARG_NULL) && parse_number(tok[2], &i->value) && (i->value < 32);
+    }
+    if (!strcmp(tok[0], "pull"))
+    {
+        i->op = PIO_PULL;
+        i->block = true;
+        for (int x = 1; x < n; x++)
+        {
+            if (!strcmp(tok[x], "ifempty"))
+                i->if_empty = true;
+            else if (!strcmp(tok[x], "noblock"))
+                i->block = false;
+            else if (strcmp(tok[x], "block"))
+                return false;
+        }
+        return true;
+    }
+    if (!strcmp(tok[0], "mov") && (n == 3))
+    {
+        char *from = tok[2];
+        if ((from[0] == '!') || (from[0] == '~'))
+        {
+            i->invert = 1;
+            from++;
+        }
+        else if (!strncmp(from, "::", 2))
+        {
+            i->invert = 2;
+            from += 2;
+        }
+
+        int dest = find_arg(tok[1], movs, mov_args, 7);
+        int source = find_arg(from, movs, mov_args, 7);
+        i->op = PIO_MOV;
+        i->dest = dest;
+        i->src = source;
+        return (dest >= 0) && (dest != ARG_NULL) && (dest != ARG_ISR) && (source >= 0) && (source != ARG_PC);
+    }
+    return false;
+}
+
+// The OUT shift and FIFO join the c-sdk block sets up
+static void parse_sdk(t_pio_prog *p, const char *line)
+{
+    const char *call = strstr(line, "sm_config_set_out_shift(");
+    if (call != NULL)
+    {
+        char args[LINE_MAX_LEN];
+        char *tok[6];
+        snprintf(args, sizeof(args), "%s", strchr(call, '(') + 1);
+        *strchr(args, ')') = '\0';
+        if (split(args, tok, 6) == 4)
+        {
+            p->shift_right = !strcmp(tok[1], "true");
+            p->autopull = !strcmp(tok[2], "true");
+            p->threshold = atoi(tok[3]);
+        }
+    }
+    if (strstr(line, "PIO_FIFO_JOIN_TX") != NULL)
+        p->fifo_depth = 8;
+}
+
+bool pio_assemble(t_pio_prog *p, const char *path, const char *name)
+{
+    static t_source src;
+    char buf[LINE_MAX_LEN];
+    bool in_prog = false, in_sdk = false, found = false, wrap = false;
+    int line_no = 0;
+
+    FILE *fh = fopen(path, "r");
+    if (fh == NULL)
+    {
+        printf("Cannot open %s\n", path);
+        return false;
+    }
+
+    // SDK defaults
+    memset(p, 0, sizeof(*p));
+    memset(&src, 0, sizeof(src));
+    snprintf(p->name, sizeof(p->name), "%s", name);
+    p->shift_right = true;
+    p->threshold = 32;
+    p->fifo_depth = 4;
+
+    // First pass: labels, directives and the c-sdk block
+    while (fgets(buf, sizeof(buf), fh) != NULL)
+    {
+        line_no++;
+        if (in_sdk)
+        {
+            if (!strncmp(trim(buf), "%}", 2))
+                in_sdk = false;
+            else if (in_prog)
+                parse_sdk(p, buf);
+            continue;
+        }
+
+        char *cut = strchr(buf, ';');
+        if (cut != NULL)
+            *cut = '\0';
+        if ((cut = strstr(buf, "//")) != NULL)
+            *cut = '\0';
+        char *line = trim(buf);
+        if (*line == '\0')
+            continue;
+
+        if (line[0] == '%')
+        {
+            in_sdk = true;
+            continue;
+        }
+        if (!strncmp(line, ".program", 8))
+        {
+            in_prog = !strcmp(trim(line + 8), name);
+            found |= in_prog;
+            continue;
+        }
+        if (!in_prog)
+            continue;
+
+        if (!strcmp(line, ".wrap_target"))
+            p->wrap_target = p->len;
+        else if (!strcmp(line, ".wrap"))
+        {
+            p->wrap = p->len - 1;
+            wrap = true;
+        }
+        else if (line[0] == '.')
+        {
+            // Side-set, defines and the like change what instructions mean
+            if (strncmp(line, ".pio_version", 12) && strncmp(line, ".origin", 7))
+            {
+                printf("%s:%d: %s is not supported\n", path, line_no, line);
+                fclose(fh);
+                return false;
+            }
+        }
+        else
+        {
+            // Labels, then maybe an instruction
+            char *colon;
+            while ((colon = strchr(line, ':')) != NULL && (colon[1] != ':') &&
+                   (src.label_count < PIO_PROG_MAX))
+            {
+                *colon = '\0';
+                char *label = trim(line);
+                if (!strncmp(label, "public ", 7))
+                    label = trim(label + 7);
+                snprintf(src.labels[src.label_count].name, 32, "%s", label);
+                src.labels[src.label_count++].at = p->len;
+                line = trim(colon + 1);
+            }
+            if (*line == '\0')
+                continue;
+
+            if (p->len == PIO_PROG_MAX)
+            {
+                printf("%s:%d: program is too long\n", path, line_no);
+                fclose(fh);
+                return false;
+            }
+            snprintf(src.lines[p->len], LINE_MAX_LEN, "%s", line);
+            src.line_no[p->len++] = line_no;
+        }
+    }
+    fclose(fh);
+
+    if (!found || (p->len == 0))
+    {
+        printf("%s: no program %s\n", path, name);
+        return false;
+    }
+    if (!wrap)
+        p->wrap = p->len - 1;
+
+    // Second pass: the instructions, now all the labels are known
+    for (int x = 0; x < p->len; x++)
+    {
+        char text[LINE_MAX_LEN];
+        snprintf(text, sizeof(text), "%s", src.lines[x]);
+        if (!parse_instr(&p->code[x], text, &src))
+        {
+            printf("%s:%d: cannot assemble \"%s\"\n", path, src.line_no[x], src.lines[x]);
+            return false;
+        }
+    }
+    return true;
+}
+
+void pio_sm_reset(t_pio_sm *sm, const t_pio_prog *p)
+{
+    memset(sm, 0, sizeof(*sm));
+    sm->prog = p;
+    sm->osr_count = 32;
+}
+
+void pio_sm_put(t_pio_sm *sm, uint32_t word)
+{
+    sm->fifo[(sm->fifo_head + sm->fifo_len++) % PIO_FIFO_MAX] = word;
+}
+
+static uint32_t pop(t_pio_sm *sm)
+{
+    uint32_t word = sm->fifo[sm->fifo_head];
+    sm->fifo_head = (sm->fifo_head + 1) % PIO_FIFO_MAX;
+    sm->fifo_len--;
+    return word;
+}
+
+static uint32_t reverse(uint32_t v)
+{
+    uint32_t r = 0;
+    for (int x = 0; x < 32; x++, v >>= 1)
+        r = (r << 1) | (v & 1);
+    return r;
+}
+
+// Write to a destination, false if it is the PC (the caller jumps)
+static bool write_dest(t_pio_sm *sm, uint8_t dest, uint32_t value)
+{
+    switch (dest)
+    {
+    case ARG_PINS:
+        sm->pins = value & 1;
+        break;
+    case ARG_X:
+        sm->x = value;
+        break;
+    case ARG_Y:
+        sm->y = value;
+        break;
+    case ARG_OSR:
+        sm->osr = value;
+        sm->osr_count = 0;
+        break;
+    case ARG_PC:
+        return false;
+    default:
+        break;
+    }
+    return true;
+}
+
+bool pio_sm_step(t_pio_sm *sm)
+{
+    const t_pio_prog *p = sm->prog;
+    uint8_t pins = sm->pins;
+
+    sm->cycle++;
+    sm->stalled = false;
+    if (sm->delay > 0)
+    {
+        sm->delay--;
+        return false;
+    }
+
+    const t_pio_instr *i = &p->code[sm->pc];
+    uint8_t next = (sm->pc == p->wrap) ? p->wrap_target : sm->pc + 1;
+
+    switch (i->op)
+    {
+    case PIO_JMP:
+    {
+        bool take = true;
+        switch (i->dest)
+        {
+        case ARG_NOT_X:
+            take = (sm->x == 0);
+            break;
+        case ARG_X_DEC:
+            take = (sm->x-- != 0);
+            break;
+        case ARG_NOT_Y:
+            take = (sm->y == 0);
+            break;
+        case ARG_Y_DEC:
+            take = (sm->y-- != 0);
+            break;
+        case ARG_X_NE_Y:
+            take = (sm->x != sm->y);
+            break;
+        case ARG_NOT_OSRE:
+            take = (sm->osr_count < p->threshold);
+            break;
+        }
+        if (take)
+            next = i->value;
+        break;
+    }
+
+    case PIO_OUT:
+    {
+        // Autopull: refill an empty OSR, or wait for the FIFO
+        if (p->autopull && (sm->osr_count >= p->threshold))
+        {
+            if (sm->fifo_len == 0)
+            {
+                sm->stalled = sm->txstall = true;
+                return false;
+            }
+            sm->osr = pop(sm);
+            sm->osr_count = 0;
+        }
+
+        uint32_t bits = i->value;
+        uint32_t data;
+        if (p->shift_right)
+        {
+            data = (bits == 32) ? sm->osr : sm->osr & ((1u << bits) - 1);
+            sm->osr = (bits == 32) ? 0 : sm->osr >> bits;
+        }
+        else
+        {
+            data = sm->osr >> (32 - bits);
+            sm->osr = (bits == 32) ? 0 : sm->osr << bits;
+        }
+        sm->osr_count = (sm->osr_count + bits > 32) ? 32 : sm->osr_count + bits;
+
+        if (!write_dest(sm, i->dest, data))
+            next = data % PIO_PROG_MAX;
+        break;
+    }
+
+    case PIO_PULL:
+        if (i->if_empty && (sm->osr_count < p->threshold))
+            break;
+        if (sm->fifo_len > 0)
+            sm->osr = pop(sm);
+        else if (i->block)
+        {
+            sm->stalled = sm->txstall = true;
+            return false;
+        }
+        else
+            sm->osr = sm->x;
+        sm->osr_count = 0;
+        break;
+
+    case PIO_MOV:
+    {
+        uint32_t value = 0;
+        switch (i->src)
+        {
+        case ARG_PINS:
+            value = sm->pins;
+            break;
+        case ARG_X:
+            value = sm->x;
+            break;
+        case ARG_Y:
+            value = sm->y;
+            break;
+        case ARG_OSR:
+            value = sm->osr;
+            break;
+        default:
+            break;
+        }
+        if (i->invert == 1)
+            value = ~value;
+        else if (i->invert == 2)
+            value = reverse(value);
+
+        if (!write_dest(sm, i->dest, value))
+            next = value % PIO_PROG_MAX;
+        break;
+    }
+
+    case PIO_SET:
+        write_dest(sm, i->dest, i->value);
+        break;
+    }
+
+    sm->pc = next;
+    sm->delay = i->delay;
+    return sm->pins != pins;
+}
+
+uint32_t pio_sm_skip(t_pio_sm *sm)
+{
+    const t_pio_instr *i = &sm->prog->code[sm->pc];
+    if ((sm->delay > 0) || (i->op != PIO_JMP) || (i->value != sm->pc) || (i->delay > 0))
+        return 0;
+
+    // Every pass but the last jumps back
+    uint32_t *reg;
+    if (i->dest == ARG_X_DEC)
+        reg = &sm->x;
+    else if (i->dest == ARG_Y_DEC)
+        reg = &sm->y;
+    else
+        return 0;
+
+    uint32_t passes = *reg;
+    *reg = 0;
+    sm->cycle += passes;
+    sm->stalled = false;
+    return passes;
+}
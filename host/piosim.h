@@ -0,0 +1,122 @@
+#ifndef PIOSIM_H
+#define PIOSIM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Host model of a PIO state machine, a cycle at a time
+ *
+ * Programs are assembled from the .pio source, so a new variant of
+ * pulsegen can be run as it is written. The instructions a TX-only program
+ * needs are here - jmp (all but PIN), out, pull, mov, set and nop, with
+ * delays and .wrap - but not in, push, wait, irq or side-set.
+ *
+ * The OUT shift (direction, autopull, threshold) and TX FIFO join are read
+ * from the program's % c-sdk block, the same as the firmware sets them.
+ *
+ * As on the RP2040, each instruction takes a cycle plus its delay, and an
+ * OUT with autopull (or a blocking PULL) stalls while the OSR and the TX
+ * FIFO are both empty - the cycles pass, but nothing happens until a word
+ * arrives. Each stall sets TXSTALL, as in FDEBUG.
+ */
+#define PIO_PROG_MAX 32
+#define PIO_FIFO_MAX 8
+
+enum pio_ops
+{
+    PIO_JMP,
+    PIO_OUT,
+    PIO_PULL,
+    PIO_MOV,
+    PIO_SET
+};
+
+// Operands: jmp conditions, then sources and destinations
+enum pio_args
+{
+    ARG_ALWAYS,
+    ARG_NOT_X,
+    ARG_X_DEC,
+    ARG_NOT_Y,
+    ARG_Y_DEC,
+    ARG_X_NE_Y,
+    ARG_NOT_OSRE,
+    ARG_PINS,
+    ARG_X,
+    ARG_Y,
+    ARG_NULL,
+    ARG_PINDIRS,
+    ARG_PC,
+    ARG_OSR,
+    ARG_ISR
+};
+
+typedef struct t_pio_instr
+{
+    uint8_t op;
+    uint8_t dest;     // Or jmp condition
+    uint8_t src;      // mov source
+    uint8_t invert;   // mov: 1 for !, 2 for ::
+    uint32_t value;   // set value, out bit count, jmp target
+    bool block;       // pull
+    bool if_empty;    // pull
+    uint8_t delay;
+} t_pio_instr;
+
+typedef struct t_pio_prog
+{
+    char name[32];
+    t_pio_instr code[PIO_PROG_MAX];
+    uint8_t len;
+    uint8_t wrap_target, wrap;
+
+    // From the c-sdk block
+    bool shift_right;
+    bool autopull;
+    uint8_t threshold;
+    uint8_t fifo_depth;
+} t_pio_prog;
+
+typedef struct t_pio_sm
+{
+    const t_pio_prog *prog;
+    uint8_t pc;
+    uint32_t x, y;
+    uint32_t osr;
+    uint8_t osr_count; // Bits shifted out, 32 when empty
+    uint32_t delay;
+    uint8_t pins;
+
+    uint32_t fifo[PIO_FIFO_MAX];
+    uint8_t fifo_len, fifo_head;
+
+    uint64_t cycle;
+    bool stalled;
+    bool txstall;
+} t_pio_sm;
+
+// Assemble one program from a .pio file, false (with a message) if it cannot be
+bool pio_assemble(t_pio_prog *p, const char *path, const char *name);
+
+// As pio_sm_init(): at the start of the program, OSR empty, pins low
+void pio_sm_reset(t_pio_sm *sm, const t_pio_prog *p);
+
+// Room in the TX FIFO, and put a word in it
+static inline bool pio_sm_tx_full(const t_pio_sm *sm)
+{
+    return sm->fifo_len == sm->prog->fifo_depth;
+}
+void pio_sm_put(t_pio_sm *sm, uint32_t word);
+
+// Run one cycle, true if the pins changed
+bool pio_sm_step(t_pio_sm *sm);
+
+/*
+ * Run a "jmp x--" or "jmp y--" to itself up to its last pass in one go, as
+ * pio_sm_step() would a cycle at a time - nothing else changes meanwhile.
+ * Returns the cycles run, 0 if the program is not at such a loop
+ */
+uint32_t pio_sm_skip(t_pio_sm *sm);
+
+#endif
@@ -0,0 +1,216 @@
+/*
+ * tappioca-pio - play a tape through a model of the pulsegen state machine
+ *
+ * The tape is decoded by the same player as the firmware, and its words are
+ * fed through a cycle-level model of the PIO program (see piosim.h), read
+ * from pulsegen.pio as it stands. Every edge on the pin is timed, and each
+ * level is checked against the time pulse_cycles() gives for its word - so
+ * ASM_OFFSET, ASM_FLIP, zero words and long holds are all checked on the
+ * host, against the program the firmware really runs.
+ *
+ * The FIFO is kept topped up, as the DMA does, a word at a time. With -l,
+ * each word takes that many cycles to arrive once there is room, so a slow
+ * feeder shows up as stalls: cycles where the program waited on an empty
+ * FIFO with words still to come, which stretch the level being held.
+ *
+ * Long holds are run in one go while the FIFO is full, as they change
+ * nothing but the loop counter.
+ *
+ * With -e, the edges are written out, one per line: "<cycle> <level>".
+ * The exit status is 1 if any level was the wrong length.
+ */
+#include <stdio.h>  // printf
+#include <stdlib.h> // atoi
+#include <string.h> // strcmp
+#include "ff.h"
+#include "tapeio.h"
+#include "player.h"
+#include "piosim.h"
+
+#ifdef PULSE_HIRES
+#define PROGRAM "pulsegen32"
+#else
+#define PROGRAM "pulsegen"
+#endif
+
+// Words in flight: in the FIFO and OSR, and the one playing
+#define CLAIMS 16
+
+// Mismatches listed before the rest are only counted
+#define SHOW_MAX 10
+
+static int usage(void)
+{
+    printf("Usage: tappioca-pio [-p program] [-f pio file] [-l latency] [-e edges] <tape>\n");
+    return 2;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *prog_name = PROGRAM, *pio_name = PULSEGEN_PIO;
+    char *in_name = NULL, *edge_name = NULL;
+    uint32_t latency = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-p") && (i + 1 < argc))
+            prog_name = argv[++i];
+        else if (!strcmp(argv[i], "-f") && (i + 1 < argc))
+            pio_name = argv[++i];
+        else if (!strcmp(argv[i], "-l") && (i + 1 < argc))
+            latency = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-e") && (i + 1 < argc))
+            edge_name = argv[++i];
+        else if (in_name == NULL)
+            in_name = argv[i];
+        else
+            return usage();
+    }
+    if (in_name == NULL)
+        return usage();
+
+    static t_pio_prog prog;
+    if (!pio_assemble(&prog, pio_name, prog_name))
+        return 2;
+    printf("%s: %u instructions, OUT shift %s, autopull %s at %u bits, %u-word FIFO\n", prog.name,
+           prog.len, prog.shift_right ? "right" : "left", prog.autopull ? "on" : "off", prog.threshold,
+           prog.fifo_depth);
+    if (prog.threshold != sizeof(pulse_t) * 8)
+        printf("Warning: words are %u bits\n", (uint32_t)sizeof(pulse_t) * 8);
+
+    static uint8_t window[2][TAPE_CHUNK];
+    FIL fh;
+    t_tape tape;
+    t_player player;
+    if (f_open(&fh, in_name, FA_READ) != FR_OK)
+    {
+        printf("Cannot open %s\n", in_name);
+        return 2;
+    }
+    tape_open(&tape, tape_read_fatfs, &fh, f_size(&fh), window);
+    if (!player_open(&player, &tape))
+        return 2;
+
+    FILE *edges = NULL;
+    if ((edge_name != NULL) && ((edges = fopen(edge_name, "w")) == NULL))
+    {
+        printf("Cannot create %s\n", edge_name);
+        return 2;
+    }
+
+    static pulse_t chunk[PULSE_CHUNK];
+    t_pulse_sink sink;
+    pulse_sink_init(&sink, chunk, PULSE_CHUNK);
+    uint32_t next = 0;
+    bool done = false;
+
+    // What each word in flight should hold for, oldest first
+    uint32_t claims[CLAIMS];
+    uint32_t claim_head = 0, claim_len = 0;
+
+    t_pio_sm sm;
+    pio_sm_reset(&sm, &prog);
+
+    uint64_t words = 0, edge_count = 0, last_edge = 0;
+    uint64_t stalls = 0, stall_cycles = 0, wrong = 0;
+    uint32_t wait = 0;
+    bool was_stalled = false, offset_shown = false, flip_shown = false;
+
+    while (true)
+    {
+        // Next chunk from the player, once this one is in the FIFO
+        if ((next == sink.pos) && !done)
+        {
+            sink.pos = 0;
+            next = 0;
+            done = player_fill(&player, &sink);
+        }
+        bool more = (next < sink.pos);
+
+        // DMA: a word into the FIFO when there is room, after the latency
+        // The FIFO is full before the program starts, as it is by the time core 1 queues a chunk
+        while (more && !pio_sm_tx_full(&sm) && ((wait >= latency) || (sm.cycle == 0)))
+        {
+            claims[(claim_head + claim_len++) % CLAIMS] = pulse_cycles(chunk[next]);
+            pio_sm_put(&sm, chunk[next++]);
+            words++;
+            wait = 0;
+            more = (next < sink.pos);
+            if (sm.cycle > 0)
+                break;
+        }
+        if (more && !pio_sm_tx_full(&sm))
+            wait++;
+        else if (pio_sm_skip(&sm) > 0)
+            continue;
+
+        bool edge = pio_sm_step(&sm);
+
+        if (sm.stalled)
+        {
+            // Waiting on the FIFO - the end of the tape, or an underrun
+            if (!more && done)
+                break;
+            if (!was_stalled)
+                stalls++;
+            stall_cycles++;
+        }
+        was_stalled = sm.stalled;
+
+        if (!edge)
+            continue;
+
+        // The level just ended belongs to the oldest word in flight
+        uint64_t at = sm.cycle - 1;
+        if (edges != NULL)
+            fprintf(edges, "%llu %u\n", (unsigned long long)at, sm.pins);
+        if (edge_count++ > 0)
+        {
+            uint32_t held = at - last_edge;
+            uint32_t claim = claims[claim_head];
+            claim_head = (claim_head + 1) % CLAIMS;
+            claim_len--;
+
+            if (held != claim)
+            {
+                if (wrong < SHOW_MAX)
+                    printf("Word %llu: held %u cycles, pulse_cycles() says %u\n",
+                           (unsigned long long)edge_count - 2, held, claim);
+                wrong++;
+            }
+
+            // What one of each kind of word costs
+            if (!offset_shown && (claim > ASM_FLIP))
+            {
+                printf("A word of n holds for n + %d cycles (ASM_OFFSET %d)\n", (int)(held - (claim - ASM_OFFSET)),
+                       ASM_OFFSET);
+                offset_shown = true;
+            }
+            if (!flip_shown && (claim == ASM_FLIP))
+            {
+                printf("A zero word holds for %u cycles (ASM_FLIP %d)\n", held, ASM_FLIP);
+                flip_shown = true;
+            }
+        }
+        last_edge = at;
+    }
+
+    if (edges != NULL)
+        fclose(edges);
+    player_close(&player);
+    f_close(&fh);
+
+    printf("%llu words, %llu edges in %llu cycles (%.3f secs)\n", (unsigned long long)words,
+           (unsigned long long)edge_count, (unsigned long long)last_edge,
+           (double)last_edge / PULSE_SCALE / FREQ);
+    printf("Stalls: %llu, for %llu cycles in all\n", (unsigned long long)stalls, (unsigned long long)stall_cycles);
+    if (claim_len > 0)
+        printf("%u words never played\n", claim_len);
+    if ((wrong > 0) || (claim_len > 0))
+    {
+        printf("%llu levels were the wrong length\n", (unsigned long long)wrong);
+        return 1;
+    }
+    printf("Every level is as long as pulse_cycles() says\n");
+    return 0;
+}
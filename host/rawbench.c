@@ -0,0 +1,297 @@
+/*
+ * tappioca-rawbench - time the Direct Recording (0x15) decoder
+ *
+ * Direct Recording blocks are played a word of 32 samples at a time (see
+ * send_raw_block() in blocks.c), finding each run by counting the leading
+ * zeros of the samples XORed with the level held. This times that against
+ * a plain decoder that goes a sample at a time, comparing each with the
+ * last - the way the blocks were played before, less the bugs that had it
+ * drop the last run and cut long runs short.
+ *
+ * Each block is a recording of a loader: random bytes as two runs a bit,
+ * with now and then a sample flipped by noise. They are sampled at 44.1
+ * and 22.05kHz, and the last has a silence too long for one word in the
+ * middle, so it has to be held across several, and only some of its last
+ * byte used. Both decoders have to play every block word for word the
+ * same, or it exits with 1 before timing anything.
+ *
+ * With -k, each block has that many K of samples, and with -n each is
+ * played that many times for the timing.
+ */
+#include <stdio.h>  // printf
+#include <stdlib.h> // atoi, realloc
+#include <string.h> // strcmp
+#include <time.h>   // clock
+#include "blocks.h"
+
+typedef struct t_buf
+{
+    uint8_t *data;
+    uint32_t len;
+    uint32_t size;
+    uint32_t bits;
+} t_buf;
+
+static void put(t_buf *b, uint32_t value, int width)
+{
+    if (b->len + width > b->size)
+    {
+        b->size = 2 * b->size + width;
+        b->data = realloc(b->data, b->size);
+    }
+    for (int x = 0; x < width; x++)
+        b->data[b->len++] = (value >> (x * 8)) & 0xFF;
+}
+
+// One sample, MSB first
+static void put_sample(t_buf *b, uint8_t level)
+{
+    if (b->bits == 0)
+        put(b, 0, 1);
+    if (level)
+        b->data[b->len - 1] |= 0x80 >> b->bits;
+    b->bits = (b->bits + 1) & 7;
+}
+
+// A recording sampled every so many t-states, maybe with a silence past the longest word in the middle
+typedef struct t_raw_test
+{
+    const char *name;
+    uint16_t sample_ticks;
+    bool silence;
+} t_raw_test;
+
+static const t_raw_test tests[] = {
+    {"Loader at 44.1kHz", 79, false},
+    {"Loader at 22.05kHz", 158, false},
+    {"Loader, a long silence", 79, true},
+};
+#define TESTS (sizeof(tests) / sizeof(tests[0]))
+
+// A loader's bits, as ROM timings would record them, until there are that many bytes of samples
+static void put_loader(t_buf *b, const t_raw_test *g, uint32_t bytes, uint32_t *seed, uint8_t *level)
+{
+    uint32_t zero = 855 / g->sample_ticks, one = 1710 / g->sample_ticks;
+    while (b->len < bytes)
+    {
+        *seed = *seed * 1103515245 + 12345;
+        uint32_t run = ((*seed >> 16) & 1) ? one : zero;
+        for (int half = 0; half < 2; half++)
+        {
+            for (uint32_t n = 0; n < run; n++)
+            {
+                // Now and then a sample is flipped by noise
+                *seed = *seed * 1103515245 + 12345;
+                put_sample(b, *level ^ (((*seed >> 16) & 63) == 0));
+            }
+            *level ^= 1;
+        }
+    }
+}
+
+// Returns the samples in the block
+static uint32_t make_block(t_buf *b, const t_raw_test *g, uint32_t bytes)
+{
+    b->len = 0;
+    b->bits = 0;
+    put(b, BLK_DIRECT, 1);
+    put(b, g->sample_ticks, 2);
+    put(b, 0, 2); // No pause, so only the block's own words are compared
+    put(b, 8, 1);
+    put(b, 0, 3);
+
+    uint32_t seed = 1;
+    uint8_t level = 0;
+    if (!g->silence)
+    {
+        put_loader(b, g, 9 + bytes, &seed, &level);
+        b->bits = 0;
+    }
+    else
+    {
+        put_loader(b, g, 9 + bytes / 2, &seed, &level);
+
+        // Long enough for two words of the longest and some over
+        uint64_t samples = 2 * PULSE_MAX / ((uint64_t)g->sample_ticks * PULSE_SCALE) + 100;
+        for (uint64_t n = 0; n < samples; n++)
+            put_sample(b, level);
+        level ^= 1;
+
+        // Ending part way into a byte
+        put_loader(b, g, b->len + bytes / 2, &seed, &level);
+        put_sample(b, level ^ 1);
+        while (b->bits != 3)
+            put_sample(b, level);
+    }
+    uint32_t len = b->len - 9;
+    b->data[5] = b->bits ? b->bits : 8;
+    for (int x = 0; x < 3; x++)
+        b->data[6 + x] = (len >> (x * 8)) & 0xFF;
+    return 8 * len - (8 - b->data[5]);
+}
+
+// The whole block through the player's decoder
+static uint32_t play_words(t_tape *t, pulse_t *words, uint32_t size)
+{
+    static pulse_t chunk[PULSE_CHUNK];
+    static t_decoder dec;
+    t_pulse_sink sink;
+    t_block_desc blk;
+    uint8_t hdr[TZX_HDR_MAX];
+
+    tape_read(t, 0, hdr, TZX_HDR_MAX);
+    uint8_t data = block_parse(BLK_DIRECT, hdr, &blk);
+    block_begin(&dec, &blk, t, data);
+    pulse_sink_init(&sink, chunk, PULSE_CHUNK);
+
+    uint32_t len = 0;
+    bool done;
+    do
+    {
+        done = block_fill(&dec, &sink);
+        for (uint32_t i = 0; (i < sink.pos) && (len < size); i++)
+            words[len++] = chunk[i];
+        sink.pos = 0;
+    } while (!done);
+    block_end(&dec);
+    return len;
+}
+
+// A run of cycles, held across words as the player's decoder does if it is too long for one
+static void send_run(t_pulse_sink *s, uint64_t hold)
+{
+    while (hold > PULSE_MAX)
+    {
+        uint64_t cycles = PULSE_MAX;
+        int64_t rest = (int64_t)(hold - cycles) - ASM_FLIP;
+        if (rest < ASM_OFFSET + 1)
+        {
+            cycles -= ASM_OFFSET + 1 - rest;
+            rest = ASM_OFFSET + 1;
+        }
+        send_cycles(s, cycles);
+        send_pulse(s, 0);
+        hold = rest;
+    }
+    if (hold > 0)
+        send_cycles(s, (hold > ASM_OFFSET) ? hold : ASM_OFFSET + 1);
+}
+
+// The whole block a sample at a time, the sink big enough for all of it
+static uint32_t play_samples(t_tape *t, t_pulse_sink *s)
+{
+    uint8_t hdr[TZX_HDR_MAX];
+    t_block_desc blk;
+    tape_read(t, 0, hdr, TZX_HDR_MAX);
+    uint32_t addr = block_parse(BLK_DIRECT, hdr, &blk);
+    uint32_t end = addr + blk.len;
+    uint64_t per_sample = (uint64_t)blk.sample_ticks * PULSE_SCALE;
+    uint32_t samples = 0;
+    uint8_t prev_bit = 0;
+    s->pos = 0;
+    s->level = 1;
+
+    while (addr < end)
+    {
+        int last_bit = ((addr == end - 1) && (blk.used_bits != 8)) ? 8 - blk.used_bits : 0;
+        uint8_t data = tape_byte(t, addr++);
+        for (int y = 8; --y >= last_bit;)
+        {
+            uint8_t this_bit = (data >> y) & 0x1;
+            if (samples == 0)
+            {
+                // Start the hold
+                samples = 1;
+                prev_bit = this_bit;
+            }
+            else if (this_bit != prev_bit)
+            {
+                // Send the hold, and start another at the new level
+                send_run(s, samples * per_sample);
+                samples = 1;
+                prev_bit = this_bit;
+            }
+            else
+                samples++;
+        }
+    }
+    send_run(s, samples * per_sample);
+    return s->pos;
+}
+
+static int usage(void)
+{
+    printf("Usage: tappioca-rawbench [-k K of samples] [-n times]\n");
+    return 2;
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t kbytes = 64, times = 20;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-k") && (i + 1 < argc))
+            kbytes = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-n") && (i + 1 < argc))
+            times = atoi(argv[++i]);
+        else
+            return usage();
+    }
+    if ((kbytes == 0) || (kbytes > 8192) || (times == 0))
+        return usage();
+
+    t_buf b = {0};
+    pulse_t *words = NULL, *samples = NULL;
+    int failed = 0;
+    printf("%-28s %12s %14s %14s %8s\n", "Recording", "Samples", "Sample s/s", "Word s/s", "Speedup");
+    for (uint32_t x = 0; x < TESTS; x++)
+    {
+        t_tape tape;
+        t_pulse_sink sink;
+        uint32_t count = make_block(&b, &tests[x], 1024 * kbytes);
+        tape_open_mem(&tape, b.data, b.len);
+
+        // At most a word a sample - a run held over several words is far more samples than words
+        uint32_t size = count + 16;
+        words = realloc(words, size * sizeof(pulse_t));
+        samples = realloc(samples, size * sizeof(pulse_t));
+        if ((words == NULL) || (samples == NULL))
+            return 1;
+        pulse_sink_init(&sink, samples, size);
+
+        uint32_t n_samples = play_samples(&tape, &sink);
+        uint32_t n_words = play_words(&tape, words, size);
+        uint32_t diff = 0;
+        while ((diff < n_samples) && (diff < n_words) && (samples[diff] == words[diff]))
+            diff++;
+        if ((n_samples != n_words) || (diff != n_samples))
+        {
+            printf("%s: %u words a sample at a time, %u a word at a time, differing from word %u\n",
+                   tests[x].name, n_samples, n_words, diff);
+            failed++;
+            continue;
+        }
+
+        clock_t start = clock();
+        for (uint32_t n = 0; n < times; n++)
+            play_samples(&tape, &sink);
+        double sample_secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+        start = clock();
+        for (uint32_t n = 0; n < times; n++)
+            play_words(&tape, words, size);
+        double word_secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+        double played = (double)count * times;
+        if ((sample_secs > 0) && (word_secs > 0))
+            printf("%-28s %12u %14.0f %14.0f %7.2fx\n", tests[x].name, count, played / sample_secs,
+                   played / word_secs, sample_secs / word_secs);
+        else
+            printf("%-28s %12u %14s %14s\n", tests[x].name, count, "-", "-");
+    }
+
+    free(words);
+    free(samples);
+    free(b.data);
+    return failed ? 1 : 0;
+}
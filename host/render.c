@@ -0,0 +1,399 @@
+/*
+ * tappioca-render - play a tape on the host, into a file
+ *
+ * Runs the same player and block decoders as the firmware, but the pulse
+ * sink is written to a file instead of the PIO:
+ *  text - one pulsegen word per line: "<level> <t-states>"
+ *  bin  - little-endian uint32_t PIO cycles per word, first word HIGH
+ *  wav  - 8-bit mono PCM, for a look in Audacity or loading in an emulator
+ *  none - nothing, to time the player and decoders on their own
+ *
+ * With -s, the tape is played at one of the speed presets (see blocks.h),
+ * and the tape time at the end is the time it takes at that speed.
+ *
+ * With -i, the tape is opened through its sidecar index (see sidecar.h), as
+ * the firmware does with tapes on the SD card.
+ *
+ * With -c, the tape is played from a pulse cache (see flashcache.h) in a
+ * simulated flash region kept in the file given, rendering it there first
+ * if the file has no cache of it. The output is the same either way.
+ *
+ * With -l, the playlist the tape's control flow compiles to is listed.
+ *
+ * With -b or -o, play starts from a block, or a time in seconds, instead of
+ * the start of the tape (see player.h). A render from a block is the same
+ * as the end of a full render from where that block starts, and from a
+ * time the same from that time on - unless the time falls in standard
+ * data, which starts again at the byte it falls in, after a short pilot.
+ * If play never gets there - past the end, or a block that is jumped over
+ * or only steers play - it says why, and exits with 1.
+ *
+ * With -t, the firmware's telemetry (see telemetry.h) is shown at the end.
+ * The DMA ring and PIO are modelled (see ringsim.h): each chunk is queued
+ * as the firmware does, and plays out in real time while the next is
+ * decoded, so the underruns and headroom are what a player this fast would
+ * see. The number given scales the time decoding takes - 1 for the host
+ * as it is, higher to see how a slower CPU would cope.
+ *
+ * Each word is counted as the cycles the PIO spends on it (see pulse.h), so
+ * a zero word still takes ASM_FLIP. In a PULSE_HIRES build a cycle is a
+ * fraction of a t-state, and text output shows t-states to 3 places.
+ */
+#include <stdio.h>  // printf
+#include <stdlib.h> // atoi, atof
+#include <string.h> // strcmp
+#include <time.h>   // clock
+#include "ff.h"
+#include "tapeio.h"
+#include "player.h"
+#include "sidecar.h"
+#include "telemetry.h"
+#include "flashcache.h"
+#include "flashsim.h"
+#include "ringsim.h"
+#include "wavout.h"
+
+// As CACHE_SIZE in the firmware
+#define FLASH_REGION (1024 * 1024)
+
+enum formats
+{
+    FMT_TEXT,
+    FMT_BIN,
+    FMT_WAV,
+    FMT_NONE
+};
+
+typedef struct t_render
+{
+    FILE *out;
+    uint8_t format;
+    t_wav wav;
+
+    // Totals so far
+    uint64_t words;
+    uint64_t cycles;
+} t_render;
+
+static void put_uint(FILE *f, uint32_t value, int width)
+{
+    for (int x = 0; x < width; x++)
+        fputc((value >> (x * 8)) & 0xFF, f);
+}
+
+static void put_wav_header(t_render *r)
+{
+    uint8_t hdr[WAV_HEADER];
+
+    wav_header(&r->wav, hdr);
+    fseek(r->out, 0, SEEK_SET);
+    fwrite(hdr, 1, WAV_HEADER, r->out);
+}
+
+// Write out one chunk of words, first played at level
+static void render_chunk(t_render *r, const pulse_t *words, uint32_t count, uint8_t level)
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t cycles = pulse_cycles(words[i]);
+        r->cycles += cycles;
+        r->words++;
+
+        switch (r->format)
+        {
+        case FMT_TEXT:
+#if PULSE_SCALE > 1
+            fprintf(r->out, "%u %.3f\n", level, (double)cycles / PULSE_SCALE);
+#else
+            fprintf(r->out, "%u %u\n", level, cycles);
+#endif
+            break;
+        case FMT_BIN:
+            put_uint(r->out, cycles, 4);
+            break;
+        case FMT_NONE:
+            break;
+        case FMT_WAV:
+            for (uint64_t n = wav_word(&r->wav, words[i]); n > 0; n--)
+                fputc(level ? WAV_HIGH : WAV_LOW, r->out);
+            break;
+        }
+        level ^= 1;
+    }
+}
+
+// Decoding time is multiplied by this with -t
+static double slowdown = 0;
+
+static uint64_t host_us(void)
+{
+    return ring_clock_us(slowdown);
+}
+
+// Why a seek found nothing - a control block only steers play, so play never stops on it
+static void never_there(t_player *p, int32_t block)
+{
+    const char *control = NULL;
+    if ((block >= 0) && (block < p->blocks))
+    {
+        switch (p->index[block].id)
+        {
+        case BLK_JUMP:
+            control = "jump";
+            break;
+        case BLK_LOOP_START:
+            control = "loop start";
+            break;
+        case BLK_LOOP_END:
+            control = "loop end";
+            break;
+        case BLK_SEQ_CALL:
+            control = "call sequence";
+            break;
+        case BLK_SEQ_RET:
+            control = "return from a call";
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (block < 0)
+        printf("Play never gets there - the tape ends at %.3f secs\n", (double)p->duration / FREQ);
+    else if (block >= p->blocks)
+        printf("Play never gets there - the tape has %u blocks\n", p->blocks);
+    else if (control != NULL)
+        printf("Play never gets there - block %d is a %s, which only steers play\n", block, control);
+    else
+        printf("Play never gets there - block %d is jumped over\n", block);
+}
+
+static int usage(void)
+{
+    printf("Usage: tappioca-render [-f text|bin|wav|none] [-r rate] [-i] [-s speed] [-t slowdown] [-c flash]\n"
+           "                      [-l] [-b block | -o secs] <tape> [output]\n");
+    printf("Speeds:");
+    for (int x = 0; x < SPEED_PRESETS; x++)
+        printf(" %s", speed_presets[x].name);
+    printf("\n");
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    t_render r = {NULL, FMT_TEXT, {44100, 0, 0}, 0, 0};
+    char *in_name = NULL, *out_name = NULL, *flash_name = NULL;
+    bool sidecar = false, list = false;
+    const t_speed *speed = NULL;
+    int32_t seek_block = -1;
+    double seek_secs = -1;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-f") && (i + 1 < argc))
+        {
+            i++;
+            if (!strcmp(argv[i], "text"))
+                r.format = FMT_TEXT;
+            else if (!strcmp(argv[i], "bin"))
+                r.format = FMT_BIN;
+            else if (!strcmp(argv[i], "wav"))
+                r.format = FMT_WAV;
+            else if (!strcmp(argv[i], "none"))
+                r.format = FMT_NONE;
+            else
+                return usage();
+        }
+        else if (!strcmp(argv[i], "-r") && (i + 1 < argc))
+            r.wav.rate = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-i"))
+            sidecar = true;
+        else if (!strcmp(argv[i], "-l"))
+            list = true;
+        else if (!strcmp(argv[i], "-c") && (i + 1 < argc))
+            flash_name = argv[++i];
+        else if (!strcmp(argv[i], "-b") && (i + 1 < argc))
+            seek_block = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-o") && (i + 1 < argc))
+            seek_secs = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-t") && (i + 1 < argc))
+        {
+            slowdown = atof(argv[++i]);
+            if (slowdown <= 0)
+                return usage();
+        }
+        else if (!strcmp(argv[i], "-s") && (i + 1 < argc))
+        {
+            i++;
+            for (int x = 0; x < SPEED_PRESETS; x++)
+            {
+                if (!strcmp(argv[i], speed_presets[x].name))
+                    speed = &speed_presets[x];
+            }
+            if (speed == NULL)
+                return usage();
+        }
+        else if (in_name == NULL)
+            in_name = argv[i];
+        else if (out_name == NULL)
+            out_name = argv[i];
+        else
+            return usage();
+    }
+    if ((in_name == NULL) || (r.wav.rate == 0))
+        return usage();
+    if ((out_name == NULL) && (r.format != FMT_NONE))
+        return usage();
+    // A cache only plays from the start
+    if (((seek_block >= 0) || (seek_secs >= 0)) && (flash_name != NULL))
+        return usage();
+
+    // Read the tape through the same window as the firmware does
+    static uint8_t window[2][TAPE_CHUNK];
+    FIL fh;
+    t_tape tape;
+    if (f_open(&fh, in_name, FA_READ) != FR_OK)
+    {
+        printf("Cannot open %s\n", in_name);
+        return 1;
+    }
+    tape_open(&tape, tape_read_fatfs, &fh, f_size(&fh), window);
+
+    static pulse_t chunk[PULSE_CHUNK];
+    t_pulse_sink sink;
+    pulse_sink_init(&sink, chunk, PULSE_CHUNK);
+
+    // Indexing is timed on its own, it is done once however many replays
+    t_player player;
+    clock_t start = clock();
+    if (!(sidecar ? sidecar_open(&player, &tape, &sink, in_name) : player_open(&player, &tape)))
+        return 1;
+    printf("Indexed in %.3f msecs\n", (double)(clock() - start) * 1000 / CLOCKS_PER_SEC);
+    if (player.duration)
+        printf("Running time %.3f secs\n", (double)player.duration / FREQ);
+    printf("Playlist: %u steps\n", player.steps);
+    for (uint16_t i = 0; list && (i < player.steps); i++)
+    {
+        const t_play_step *st = &player.list[i];
+        if ((st->count == 0) && (st->repeat == 0))
+            printf("  %u: back to step %u\n", i, st->first);
+        else if (st->count == 0)
+            printf("  %u: back to step %u, %u more times\n", i, st->first, st->repeat);
+        else
+            printf("  %u: blocks %u-%u, %u times\n", i, st->first, st->first + st->count - 1, st->repeat);
+    }
+    player_set_speed(&player, speed);
+
+    // From the cache, once it is there
+    t_flash flash;
+    t_flash_sim sim;
+    static t_flashcache cache;
+    bool cached = false;
+    if (flash_name != NULL)
+    {
+        if (!flash_sim_open(&flash, &sim, flash_name, FLASH_REGION))
+        {
+            printf("Cannot open %s\n", flash_name);
+            return 1;
+        }
+
+        uint8_t key = speed ? speed - speed_presets : CACHE_AS_RECORDED;
+        start = clock();
+        cached = flashcache_open(&cache, &flash, &tape, key);
+        if (cached)
+            printf("Cached at %u", cache.start);
+        else if ((cached = flashcache_build(&cache, &player, &sink)))
+            printf("Rendered into the cache at %u", cache.start);
+        else
+            printf("Cannot cache, playing from the tape\n");
+        if (cached)
+            printf(" in %.3f msecs: %u words in %u bytes\n", (double)(clock() - start) * 1000 / CLOCKS_PER_SEC,
+                   cache.words, cache.bytes);
+    }
+
+    // Seeking works out where the blocks are reached, the first time
+    if ((seek_block >= 0) || (seek_secs >= 0))
+    {
+        start = clock();
+        bool found = (seek_block >= 0) ? player_seek_block(&player, &sink, seek_block)
+                                       : player_seek_time(&player, &sink, seek_secs * FREQ + 0.5);
+        if (!found)
+        {
+            never_there(&player, seek_block);
+            return 1;
+        }
+        printf("Found in %.3f msecs\n", (double)(clock() - start) * 1000 / CLOCKS_PER_SEC);
+        if (seek_block >= 0)
+#if PULSE_SCALE > 1
+            printf("Block %d starts at %.3f t-states\n", seek_block,
+                   (double)player.seek[seek_block].at / PULSE_SCALE);
+#else
+            printf("Block %d starts at %llu t-states\n", seek_block,
+                   (unsigned long long)player.seek[seek_block].at);
+#endif
+    }
+
+    static t_ring_model ring;
+    t_telemetry telem;
+    if (slowdown > 0)
+    {
+        telem_init(&telem, host_us);
+        player_set_telemetry(&player, &telem);
+    }
+
+    r.out = fopen(out_name ? out_name : "/dev/null", "wb");
+    if (r.out == NULL)
+    {
+        printf("Cannot create %s\n", out_name);
+        return 1;
+    }
+    if (r.format == FMT_WAV)
+        put_wav_header(&r);
+
+    start = clock();
+    bool done;
+    do
+    {
+        // A seek can leave the first words in the sink
+        uint8_t level = sink.level ^ (sink.pos & 1);
+        uint64_t before = (slowdown > 0) ? host_us() : 0;
+        done = cached ? flashcache_fill(&cache, &sink) : player_fill(&player, &sink);
+        if (slowdown > 0)
+        {
+            ring_play(&ring, host_us() - before);
+            if (ring.started && (sink.pos > 0))
+                telem_queued(&telem, ring.queued);
+            ring_push(&ring, chunk, sink.pos);
+        }
+        render_chunk(&r, chunk, sink.pos, level);
+        sink.pos = 0;
+    } while (!done);
+    double secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    if (r.format == FMT_WAV)
+        put_wav_header(&r);
+    fclose(r.out);
+
+    printf("%llu words, %llu t-states (%.3f secs)\n", (unsigned long long)r.words,
+           (unsigned long long)(r.cycles / PULSE_SCALE), (double)r.cycles / PULSE_SCALE / FREQ);
+    if (secs > 0)
+        printf("Rendered in %.3f secs, %.0f words/sec, %.0fx real time\n", secs, r.words / secs,
+               (double)r.cycles / PULSE_SCALE / FREQ / secs);
+    if (slowdown > 0)
+    {
+        telem.stalls = ring.stalls;
+        telem_print(&telem);
+    }
+
+    if (flash_name != NULL)
+    {
+        uint32_t least, most;
+        flash_sim_wear(&sim, &least, &most);
+        printf("Flash sectors erased %u-%u times\n", least, most);
+        flash_sim_close(&sim);
+    }
+
+    player_close(&player);
+    f_close(&fh);
+    return 0;
+}
@@ -0,0 +1,60 @@
+#include <time.h> // clock_gettime
+#include "ringsim.h"
+
+uint64_t ring_clock_us(double slowdown)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((double)ts.tv_sec * 1000000000 + ts.tv_nsec) * slowdown / 1000;
+}
+
+void ring_play(t_ring_model *m, uint64_t us)
+{
+    uint64_t cycles = us * FREQ * PULSE_SCALE / 1000000;
+
+    while ((cycles > 0) && (m->tail != m->head))
+    {
+        uint32_t at = m->tail % RING_WORDS;
+        uint64_t left = m->cycles[at] - m->played;
+        if (left > cycles)
+        {
+            m->played += cycles;
+            return;
+        }
+
+        cycles -= left;
+        m->played = 0;
+        m->queued -= m->words[at];
+        m->tail++;
+    }
+
+    if ((cycles > 0) && m->started)
+        m->stalls++;
+}
+
+void ring_push(t_ring_model *m, const pulse_t *words, uint32_t count)
+{
+    if (count == 0)
+        return;
+
+    while (m->queued + count > RING_WORDS)
+    {
+        uint32_t at = m->tail % RING_WORDS;
+        m->queued -= m->words[at];
+        m->played = 0;
+        m->tail++;
+    }
+
+    uint32_t at = m->head++ % RING_WORDS;
+    m->words[at] = count;
+    m->cycles[at] = 0;
+    for (uint32_t i = 0; i < count; i++)
+        m->cycles[at] += pulse_cycles(words[i]);
+    m->queued += count;
+    m->started = true;
+}
+
+void ring_drain(t_ring_model *m)
+{
+    m->started = false;
+}
@@ -0,0 +1,46 @@
+#ifndef RINGSIM_H
+#define RINGSIM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "pulse.h"
+
+/*
+ * Host stand-in for the DMA ring and PIO
+ *
+ * Chunks are queued as the firmware queues them into a t_pioring, and play
+ * out at the speed the PIO would play them, for however long the decoding
+ * takes on the host. The PIO running dry while the tape is still playing
+ * counts as an underrun, as the TXSTALL flag does in the firmware - from
+ * the first chunk queued, until ring_drain().
+ */
+
+// As PIORING_WORDS in the firmware
+#define RING_WORDS 4096
+
+// Chunks queued, the oldest playing
+typedef struct t_ring_model
+{
+    uint32_t words[RING_WORDS];
+    uint64_t cycles[RING_WORDS];
+    uint32_t head, tail;
+
+    uint32_t queued; // Words, including the chunk playing
+    uint64_t played; // Cycles of the chunk playing that have gone
+    bool started;
+    uint32_t stalls;
+} t_ring_model;
+
+// Host time in microseconds, multiplied by slowdown to stand in for a slower CPU
+uint64_t ring_clock_us(double slowdown);
+
+// Play out the ring for the time given
+void ring_play(t_ring_model *m, uint64_t us);
+
+// Queue a chunk, waiting for the ring to play out if it is full
+void ring_push(t_ring_model *m, const pulse_t *words, uint32_t count);
+
+// The tape has all been queued - the ring running dry from now on is not an underrun
+void ring_drain(t_ring_model *m);
+
+#endif
@@ -0,0 +1,246 @@
+/*
+ * tappioca-stdbench - time the standard data decoder
+ *
+ * Standard, turbo and pure data blocks are played from a table of the
+ * words for each nibble, built once per block (see begin_standard_block()
+ * in blocks.c), so a whole byte of data is two copies. This times that
+ * against a plain decoder that goes a bit at a time, testing each bit and
+ * sending its two pulses - the way the blocks were played before the
+ * tables.
+ *
+ * Each block is of random bytes: ROM timings, the faster ones of a turbo
+ * loader, and pure data with only some of its last byte used. Both
+ * decoders have to play every block word for word the same, or it exits
+ * with 1 before timing anything.
+ *
+ * With -k, each block has that many K of data, and with -n each is played
+ * that many times for the timing.
+ */
+#include <stdio.h>  // printf
+#include <stdlib.h> // atoi, malloc
+#include <string.h> // strcmp
+#include <time.h>   // clock
+#include "blocks.h"
+
+typedef struct t_buf
+{
+    uint8_t *data;
+    uint32_t len;
+    uint32_t size;
+} t_buf;
+
+static void put(t_buf *b, uint32_t value, int width)
+{
+    if (b->len + width > b->size)
+    {
+        b->size = 2 * b->size + width;
+        b->data = realloc(b->data, b->size);
+    }
+    for (int x = 0; x < width; x++)
+        b->data[b->len++] = (value >> (x * 8)) & 0xFF;
+}
+
+// A block of data with these timings - the pilot is only for turbo blocks, as the others have their own or none
+typedef struct t_std_test
+{
+    const char *name;
+    uint8_t id;
+    uint16_t pilot;
+    uint16_t sync_a;
+    uint16_t sync_b;
+    uint16_t bit_0;
+    uint16_t bit_1;
+    uint16_t p_total;
+    uint8_t used_bits;
+} t_std_test;
+
+static const t_std_test tests[] = {
+    {"Standard, ROM timings", BLK_STD, 0, 0, 0, 0, 0, 0, 8},
+    {"Turbo, twice as fast", BLK_TURBO, 1800, 500, 600, 427, 855, 1500, 8},
+    {"Pure data, 5 bits of the last", BLK_PDATA, 0, 0, 0, 600, 1200, 0, 5},
+};
+#define TESTS (sizeof(tests) / sizeof(tests[0]))
+
+static void make_block(t_buf *b, const t_std_test *g, uint32_t bytes)
+{
+    b->len = 0;
+    put(b, g->id, 1);
+    switch (g->id)
+    {
+    case BLK_STD:
+        put(b, 0, 2); // No pause, so only the block's own words are compared
+        put(b, bytes, 2);
+        break;
+    case BLK_TURBO:
+        put(b, g->pilot, 2);
+        put(b, g->sync_a, 2);
+        put(b, g->sync_b, 2);
+        put(b, g->bit_0, 2);
+        put(b, g->bit_1, 2);
+        put(b, g->p_total, 2);
+        put(b, g->used_bits, 1);
+        put(b, 0, 2);
+        put(b, bytes, 3);
+        break;
+    default:
+        put(b, g->bit_0, 2);
+        put(b, g->bit_1, 2);
+        put(b, g->used_bits, 1);
+        put(b, 0, 2);
+        put(b, bytes, 3);
+        break;
+    }
+
+    // A data block, flag first, as a loader would have it
+    uint32_t seed = 1;
+    put(b, 0xFF, 1);
+    for (uint32_t i = 1; i < bytes; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        put(b, seed >> 16, 1);
+    }
+}
+
+// The whole block through the player's decoder
+static uint32_t play_tables(t_tape *t, pulse_t *words, uint32_t size)
+{
+    static pulse_t chunk[PULSE_CHUNK];
+    static t_decoder dec;
+    t_pulse_sink sink;
+    t_block_desc blk;
+    uint8_t hdr[TZX_HDR_MAX];
+
+    tape_read(t, 0, hdr, TZX_HDR_MAX);
+    uint8_t data = block_parse(hdr[0], hdr, &blk);
+    block_begin(&dec, &blk, t, data);
+    pulse_sink_init(&sink, chunk, PULSE_CHUNK);
+
+    uint32_t len = 0;
+    bool done;
+    do
+    {
+        done = block_fill(&dec, &sink);
+        for (uint32_t i = 0; (i < sink.pos) && (len < size); i++)
+            words[len++] = chunk[i];
+        sink.pos = 0;
+    } while (!done);
+    block_end(&dec);
+    return len;
+}
+
+// The whole block a bit at a time, the sink big enough for all of it
+static uint32_t play_bits(t_tape *t, t_pulse_sink *s)
+{
+    uint8_t hdr[TZX_HDR_MAX];
+    t_block_desc blk;
+    tape_read(t, 0, hdr, TZX_HDR_MAX);
+    uint32_t addr = block_parse(hdr[0], hdr, &blk);
+    uint32_t end = addr + blk.len;
+    s->pos = 0;
+    s->level = 1;
+
+    if (blk.type != BLK_PDATA)
+    {
+        for (uint32_t n = 0; n < blk.p_total; n++)
+            send_pulse(s, blk.p_pulse);
+        send_pulse(s, blk.sync_a);
+        send_pulse(s, blk.sync_b);
+    }
+
+    while (addr < end)
+    {
+        int last_bit = ((addr == end - 1) && (blk.used_bits != 8)) ? 8 - blk.used_bits : 0;
+        uint8_t data = tape_byte(t, addr++);
+        for (int y = 8; --y >= last_bit;)
+        {
+            if ((data >> y) & 0x1)
+            {
+                send_pulse(s, blk.bit_1);
+                send_pulse(s, blk.bit_1);
+            }
+            else
+            {
+                send_pulse(s, blk.bit_0);
+                send_pulse(s, blk.bit_0);
+            }
+        }
+    }
+    return s->pos;
+}
+
+static int usage(void)
+{
+    printf("Usage: tappioca-stdbench [-k K of data] [-n times]\n");
+    return 2;
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t kbytes = 32, times = 20;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-k") && (i + 1 < argc))
+            kbytes = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-n") && (i + 1 < argc))
+            times = atoi(argv[++i]);
+        else
+            return usage();
+    }
+    // A standard block's length is 16 bits
+    if ((kbytes == 0) || (kbytes > 63) || (times == 0))
+        return usage();
+
+    // The most words a block can be: the longest pilot and the sync, then two pulses a data bit
+    uint32_t size = 8063 + 2 + 2 * 8 * 1024 * kbytes;
+    pulse_t *tables = malloc(size * sizeof(pulse_t));
+    pulse_t *bits = malloc(size * sizeof(pulse_t));
+    t_buf b = {0};
+    if ((tables == NULL) || (bits == NULL))
+        return 1;
+
+    int failed = 0;
+    printf("%-30s %12s %14s %14s %8s\n", "Block", "Words", "Bits w/s", "Tables w/s", "Speedup");
+    for (uint32_t x = 0; x < TESTS; x++)
+    {
+        t_tape tape;
+        t_pulse_sink sink;
+        make_block(&b, &tests[x], 1024 * kbytes);
+        tape_open_mem(&tape, b.data, b.len);
+        pulse_sink_init(&sink, bits, size);
+
+        uint32_t n_bits = play_bits(&tape, &sink);
+        uint32_t n_tables = play_tables(&tape, tables, size);
+        uint32_t diff = 0;
+        while ((diff < n_bits) && (diff < n_tables) && (bits[diff] == tables[diff]))
+            diff++;
+        if ((n_bits != n_tables) || (diff != n_bits))
+        {
+            printf("%s: %u words a bit at a time, %u from the tables, differing from word %u\n", tests[x].name,
+                   n_bits, n_tables, diff);
+            failed++;
+            continue;
+        }
+
+        clock_t start = clock();
+        for (uint32_t n = 0; n < times; n++)
+            play_bits(&tape, &sink);
+        double bit_secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+        start = clock();
+        for (uint32_t n = 0; n < times; n++)
+            play_tables(&tape, tables, size);
+        double table_secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+        double words = (double)n_tables * times;
+        if ((bit_secs > 0) && (table_secs > 0))
+            printf("%-30s %12u %14.0f %14.0f %7.2fx\n", tests[x].name, n_tables, words / bit_secs,
+                   words / table_secs, bit_secs / table_secs);
+        else
+            printf("%-30s %12u %14s %14s\n", tests[x].name, n_tables, "-", "-");
+    }
+
+    free(tables);
+    free(bits);
+    free(b.data);
+    return failed ? 1 : 0;
+}
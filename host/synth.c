@@ -0,0 +1,590 @@
+/*
+ * tappioca-synth - write a synthetic TZX using every block type
+ *
+ * The tape is made up rather than copied from a real game, so it can be
+ * shared freely. Each block ID in enum blocks appears at least once, along
+ * with jumps, loops, call / return sequences and level changes, so a run
+ * through tappioca-render exercises every decoder and all of the player.
+ *
+ * The output is always the same, so renders of it can be diffed between
+ * versions of the decoders - ctest checks the renders of a few against the
+ * goldens in tests/golden.
+ *
+ * With -n, short blocks are added on the end until there are that many, for
+ * timing how the player copes with a tape of thousands of blocks.
+ *
+ * With -d, a Direct Recording of that many seconds is added on the end, for
+ * timing the raw decoder - its runs are the lengths a sampled loader makes,
+ * with the odd single sample of noise.
+ *
+ * With -c, control flow the way multi-loads use it is added on the end:
+ * loops inside loops, calls made from inside a loop, a loop inside a called
+ * routine, and calls back to blocks before the call. Each tone in it is a
+ * different length, so a render shows the order they played in.
+ *
+ * With -a, a custom info block is added last to make the tape a multiple of
+ * that many bytes long, so a tape can end exactly on a TAPE_CHUNK boundary.
+ */
+#include <stdio.h>  // printf
+#include <stdlib.h> // realloc, atoi
+#include <string.h> // strlen, strcmp
+#include "blocks.h"
+
+typedef struct t_buf
+{
+    uint8_t *data;
+    uint32_t len;
+    uint32_t size;
+
+    // Blocks so far, for working out relative jumps
+    uint16_t blocks;
+} t_buf;
+
+static void put(t_buf *b, uint32_t value, int width)
+{
+    if (b->len + width > b->size)
+    {
+        b->size = 2 * b->size + width;
+        b->data = realloc(b->data, b->size);
+    }
+    for (int x = 0; x < width; x++)
+        b->data[b->len++] = (value >> (x * 8)) & 0xFF;
+}
+
+static void put_bytes(t_buf *b, const uint8_t *data, uint32_t len)
+{
+    for (uint32_t i = 0; i < len; i++)
+        put(b, data[i], 1);
+}
+
+// Patch a length field once the rest of the block is in
+static void patch(t_buf *b, uint32_t at, uint32_t value, int width)
+{
+    for (int x = 0; x < width; x++)
+        b->data[at + x] = (value >> (x * 8)) & 0xFF;
+}
+
+static uint16_t block(t_buf *b, uint8_t id)
+{
+    put(b, id, 1);
+    return b->blocks++;
+}
+
+// Some bytes to play - a ramp with a flag byte first
+static void pattern(uint8_t *data, uint32_t len, uint8_t flag)
+{
+    data[0] = flag;
+    for (uint32_t i = 1; i < len; i++)
+        data[i] = i * 37 + flag;
+}
+
+/*
+ * Data blocks
+ */
+static void std_block(t_buf *b, uint16_t pause, uint8_t flag, uint16_t len)
+{
+    uint8_t data[256];
+    pattern(data, len, flag);
+
+    block(b, BLK_STD);
+    put(b, pause, 2);
+    put(b, len, 2);
+    put_bytes(b, data, len);
+}
+
+static void turbo_block(t_buf *b)
+{
+    uint8_t data[8];
+    pattern(data, sizeof(data), 0xFF);
+
+    block(b, BLK_TURBO);
+    put(b, 2000, 2); // Pilot
+    put(b, 600, 2);  // Sync
+    put(b, 700, 2);
+    put(b, 800, 2);  // Bits
+    put(b, 1600, 2);
+    put(b, 1000, 2); // Pilot pulses
+    put(b, 6, 1);    // Used bits in the last byte
+    put(b, 100, 2);  // Pause
+    put(b, sizeof(data), 3);
+    put_bytes(b, data, sizeof(data));
+}
+
+static void tone_block(t_buf *b, uint16_t duration, uint16_t count)
+{
+    block(b, BLK_TONE);
+    put(b, duration, 2);
+    put(b, count, 2);
+}
+
+static void pulses_block(t_buf *b)
+{
+    static const uint16_t pulses[] = {500, 1000, 1500, 2000, 65535};
+
+    block(b, BLK_PULSES);
+    put(b, 5, 1);
+    for (int i = 0; i < 5; i++)
+        put(b, pulses[i], 2);
+}
+
+static void pdata_block(t_buf *b)
+{
+    uint8_t data[5];
+    pattern(data, sizeof(data), 0x55);
+
+    block(b, BLK_PDATA);
+    put(b, 855, 2);
+    put(b, 1710, 2);
+    put(b, 3, 1); // Used bits
+    put(b, 0, 2); // No pause
+    put(b, sizeof(data), 3);
+    put_bytes(b, data, sizeof(data));
+}
+
+static void direct_block(t_buf *b)
+{
+    static const uint8_t data[] = {0x00, 0xFF, 0x0F, 0xF0, 0xAA, 0xC0};
+
+    block(b, BLK_DIRECT);
+    put(b, 79, 2);  // t-states per sample (44.1KHz)
+    put(b, 100, 2); // Pause
+    put(b, 5, 1);   // Used bits
+    put(b, sizeof(data), 3);
+    put_bytes(b, data, sizeof(data));
+}
+
+// RLE of a run of pulses, with a long one (> 255 samples) in the middle
+static uint32_t csw_rle(uint8_t *rle)
+{
+    uint32_t len = 0;
+    for (int i = 0; i < 64; i++)
+        rle[len++] = (i & 1) ? 10 : 20;
+    rle[len++] = 0x00;
+    rle[len++] = 0x50; // 0x00015050 samples - about 2 secs
+    rle[len++] = 0x50;
+    rle[len++] = 0x01;
+    rle[len++] = 0x00;
+    for (int i = 0; i < 64; i++)
+        rle[len++] = 1 + i;
+    return len;
+}
+
+static void csw_block(t_buf *b, uint8_t compression)
+{
+    uint8_t rle[256];
+    uint32_t len = csw_rle(rle);
+
+    block(b, BLK_CSW);
+    uint32_t at = b->len;
+    put(b, 0, 4);      // Block length, patched below
+    put(b, 100, 2);    // Pause
+    put(b, 44100, 3);  // Sample rate
+    put(b, compression, 1);
+    put(b, 129, 4);    // Pulses
+
+    if (compression == 1)
+    {
+        put_bytes(b, rle, len);
+    }
+    else
+    {
+        // Z-RLE as a single stored deflate block, which needs no compressor
+        put(b, 0x78, 1);
+        put(b, 0x01, 1);
+        put(b, 0x01, 1); // Final, stored
+        put(b, len, 2);
+        put(b, ~len & 0xFFFF, 2);
+        put_bytes(b, rle, len);
+
+        // Adler-32, big-endian
+        uint32_t s1 = 1, s2 = 0;
+        for (uint32_t i = 0; i < len; i++)
+        {
+            s1 = (s1 + rle[i]) % 65521;
+            s2 = (s2 + s1) % 65521;
+        }
+        uint32_t adler = (s2 << 16) | s1;
+        for (int x = 3; x >= 0; x--)
+            put(b, (adler >> (x * 8)) & 0xFF, 1);
+    }
+    patch(b, at, b->len - at - 4, 4);
+}
+
+// Symbol definition: flags, then pulses (0 ends a short symbol)
+static void symdef(t_buf *b, uint8_t flags, int max, const uint16_t *pulses)
+{
+    put(b, flags, 1);
+    for (int i = 0; i < max; i++)
+        put(b, pulses[i], 2);
+}
+
+// A standard loader, as a Generalised block
+static void gen_block_std(t_buf *b)
+{
+    static const uint16_t pilot[2] = {2168, 0};
+    static const uint16_t sync[2] = {667, 735};
+    static const uint16_t bit_0[2] = {855, 855};
+    static const uint16_t bit_1[2] = {1710, 1710};
+    static const uint8_t data[] = {0xFF, 0x12, 0x34, 0x56};
+
+    block(b, BLK_GENERAL);
+    uint32_t at = b->len;
+    put(b, 0, 4);
+    put(b, 100, 2);  // Pause
+    put(b, 2, 4);    // Pilot RLE entries
+    put(b, 2, 1);    // Pulses per pilot symbol
+    put(b, 2, 1);    // Pilot symbols
+    put(b, 8 * sizeof(data), 4);
+    put(b, 2, 1);    // Pulses per data symbol
+    put(b, 2, 1);    // Data symbols
+
+    symdef(b, 0, 2, pilot);
+    symdef(b, 0, 2, sync);
+    put(b, 0, 1);    // Pilot x 500
+    put(b, 500, 2);
+    put(b, 1, 1);    // Sync x 1
+    put(b, 1, 2);
+
+    symdef(b, 0, 2, bit_0);
+    symdef(b, 0, 2, bit_1);
+    put_bytes(b, data, sizeof(data));
+    patch(b, at, b->len - at - 4, 4);
+}
+
+// Pilot only, with every kind of level change
+static void gen_block_levels(t_buf *b)
+{
+    static const uint16_t high[1] = {1000};
+    static const uint16_t low[1] = {1200};
+    static const uint16_t same[1] = {1400};
+    static const uint16_t edge[1] = {1600};
+
+    block(b, BLK_GENERAL);
+    uint32_t at = b->len;
+    put(b, 0, 4);
+    put(b, 0, 2);    // No pause
+    put(b, 6, 4);
+    put(b, 1, 1);
+    put(b, 4, 1);
+    put(b, 0, 4);    // No data
+    put(b, 0, 1);
+    put(b, 0, 1);
+
+    symdef(b, 3, 1, high);
+    symdef(b, 2, 1, low);
+    symdef(b, 1, 1, same);
+    symdef(b, 0, 1, edge);
+    static const uint8_t rle[6][2] = {{0, 2}, {1, 2}, {2, 3}, {3, 3}, {1, 1}, {0, 1}};
+    for (int i = 0; i < 6; i++)
+    {
+        put(b, rle[i][0], 1);
+        put(b, rle[i][1], 2);
+    }
+    patch(b, at, b->len - at - 4, 4);
+}
+
+// Data only, 2 bits per symbol, short symbols and a partial last byte
+static void gen_block_data(t_buf *b)
+{
+    static const uint16_t sym[4][3] = {{600, 600, 0}, {900, 0, 0}, {1200, 1200, 1200}, {300, 0, 0}};
+    static const uint8_t data[] = {0x1B, 0xE4, 0x4E, 0xC0};
+
+    block(b, BLK_GENERAL);
+    uint32_t at = b->len;
+    put(b, 0, 4);
+    put(b, 50, 2);   // Pause
+    put(b, 0, 4);    // No pilot
+    put(b, 0, 1);
+    put(b, 0, 1);
+    put(b, 13, 4);   // 13 symbols, the last byte part used
+    put(b, 3, 1);
+    put(b, 4, 1);
+
+    for (int i = 0; i < 4; i++)
+        symdef(b, i == 3 ? 1 : 0, 3, sym[i]);
+    put_bytes(b, data, sizeof(data));
+    patch(b, at, b->len - at - 4, 4);
+}
+
+/*
+ * Behaviour and info blocks
+ */
+static void pause_block(t_buf *b, uint16_t ms)
+{
+    block(b, BLK_PAUSE);
+    put(b, ms, 2);
+}
+
+static void text_block(t_buf *b, uint8_t id, const char *text)
+{
+    block(b, id);
+    put(b, strlen(text), 1);
+    put_bytes(b, (const uint8_t *)text, strlen(text));
+}
+
+static void level_block(t_buf *b, uint8_t level)
+{
+    block(b, BLK_SIG_LEVEL);
+    put(b, 1, 4);
+    put(b, level, 1);
+}
+
+// Samples of runs from 1 to 24 long, mostly loader edges
+static void noise_block(t_buf *b, uint32_t secs)
+{
+    uint32_t samples = secs * 44100;
+    uint32_t bytes = (samples + 7) / 8;
+    uint32_t seed = 1;
+    uint8_t level = 0;
+
+    block(b, BLK_DIRECT);
+    put(b, 79, 2);
+    put(b, 0, 2);
+    put(b, samples % 8 ? samples % 8 : 8, 1);
+    put(b, bytes, 3);
+
+    uint32_t at = b->len;
+    for (uint32_t x = 0; x < bytes; x++)
+        put(b, 0, 1);
+
+    for (uint32_t x = 0; x < samples;)
+    {
+        seed = seed * 1103515245 + 12345;
+        uint32_t run = ((seed >> 16) % 8) ? 8 + (seed >> 20) % 17 : 1 + (seed >> 20) % 2;
+        for (; run && (x < samples); run--, x++)
+            b->data[at + x / 8] |= level << (7 - x % 8);
+        level ^= 1;
+    }
+}
+
+static void jump_block(t_buf *b, int16_t offset)
+{
+    block(b, BLK_JUMP);
+    put(b, (uint16_t)offset, 2);
+}
+
+static void loop_block(t_buf *b, uint16_t count)
+{
+    block(b, BLK_LOOP_START);
+    put(b, count, 2);
+}
+
+// Entries are offsets from the call, like jumps
+static void seq_block(t_buf *b, uint16_t count, const uint16_t *calls)
+{
+    uint16_t at = block(b, BLK_SEQ_CALL);
+    put(b, count, 2);
+    for (uint16_t x = 0; x < count; x++)
+        put(b, (uint16_t)(calls[x] - at), 2);
+}
+
+static void flow_blocks(t_buf *b)
+{
+    // Routines for the calls, jumped over
+    uint16_t skip = b->blocks;
+    uint32_t at = b->len + 1;
+    jump_block(b, 0);
+
+    uint16_t one = b->blocks;
+    tone_block(b, 1800, 4);
+    block(b, BLK_SEQ_RET);
+
+    uint16_t two = b->blocks;
+    tone_block(b, 1900, 4);
+    block(b, BLK_SEQ_RET);
+
+    // With a loop inside
+    uint16_t three = b->blocks;
+    loop_block(b, 4);
+    tone_block(b, 2000, 2);
+    block(b, BLK_LOOP_END);
+    block(b, BLK_SEQ_RET);
+
+    patch(b, at, b->blocks - skip, 2);
+
+    // A loop inside a loop: twice round 1500, three 1600s, 1700
+    loop_block(b, 2);
+    tone_block(b, 1500, 2);
+    loop_block(b, 3);
+    tone_block(b, 1600, 2);
+    block(b, BLK_LOOP_END);
+    tone_block(b, 1700, 2);
+    block(b, BLK_LOOP_END);
+
+    // Calls from inside a loop: twice round 1800, 1900
+    const uint16_t calls[] = {one, two};
+    loop_block(b, 2);
+    seq_block(b, 2, calls);
+    block(b, BLK_LOOP_END);
+
+    // Four 2000s then 1800
+    const uint16_t more[] = {three, one};
+    seq_block(b, 2, more);
+    tone_block(b, 1000, 4);
+}
+
+int main(int argc, char *argv[])
+{
+    t_buf b = {NULL, 0, 0, 0};
+    uint32_t count = 0;
+    uint32_t noise = 0;
+    uint32_t align = 0;
+    bool flow = false;
+    char *out_name = argv[argc - 1];
+
+    int arg = 1;
+    for (; arg < argc - 1; arg++)
+    {
+        if (!strcmp(argv[arg], "-c"))
+            flow = true;
+        else if (arg == argc - 2)
+            break;
+        else if (!strcmp(argv[arg], "-n"))
+            count = atoi(argv[++arg]);
+        else if (!strcmp(argv[arg], "-d"))
+            noise = atoi(argv[++arg]);
+        else if (!strcmp(argv[arg], "-a"))
+            align = atoi(argv[++arg]);
+        else
+            break;
+    }
+    if ((argc < 2) || (arg != argc - 1))
+    {
+        printf("Usage: tappioca-synth [-n blocks] [-d secs] [-c] [-a bytes] <output.tzx>\n");
+        return 1;
+    }
+
+    // TZX v1.20 header
+    put_bytes(&b, (const uint8_t *)"ZXTape!\x1A", 8);
+    put(&b, 1, 1);
+    put(&b, 20, 1);
+
+    text_block(&b, BLK_TEXT, "tappioca synthetic test tape");
+
+    block(&b, BLK_INFO);
+    put(&b, 1 + 2 + 9, 2);
+    put(&b, 1, 1);   // One string
+    put(&b, 0x00, 1); // Title
+    put(&b, 9, 1);
+    put_bytes(&b, (const uint8_t *)"Synthetic", 9);
+
+    block(&b, BLK_HARDWARE);
+    put(&b, 1, 1);
+    put(&b, 0x00, 1); // Computer
+    put(&b, 0x00, 1); // 16K
+    put(&b, 0x00, 1); // Runs on it
+
+    // Every data block
+    std_block(&b, 500, 0x00, 19);
+    std_block(&b, 500, 0xFF, 32);
+    turbo_block(&b);
+    tone_block(&b, 1000, 500);
+    pulses_block(&b);
+    pdata_block(&b);
+    level_block(&b, 0);
+    direct_block(&b);
+    csw_block(&b, 1);
+    csw_block(&b, 2);
+    gen_block_std(&b);
+    gen_block_levels(&b);
+    gen_block_data(&b);
+    level_block(&b, 1);
+    pause_block(&b, 250);
+
+    // Group
+    text_block(&b, BLK_GROUP_START, "Group");
+    tone_block(&b, 700, 100);
+    block(&b, BLK_GROUP_END);
+
+    // Jump over a block that should never play
+    jump_block(&b, 2);
+    tone_block(&b, 3000, 50);
+
+    // Loop of three
+    block(&b, BLK_LOOP_START);
+    put(&b, 3, 2);
+    tone_block(&b, 1100, 20);
+    block(&b, BLK_LOOP_END);
+
+    // Call two sequences, which are jumped over otherwise
+    block(&b, BLK_SEQ_CALL);
+    put(&b, 2, 2);
+    put(&b, 2, 2);
+    put(&b, 4, 2);
+    jump_block(&b, 5);
+    tone_block(&b, 1300, 30);
+    block(&b, BLK_SEQ_RET);
+    pulses_block(&b);
+    block(&b, BLK_SEQ_RET);
+
+    // Menu - there is nothing to choose with, so it plays on
+    block(&b, BLK_SEL);
+    uint32_t at = b.len;
+    put(&b, 0, 2);
+    put(&b, 2, 1);
+    put(&b, 1, 2);
+    put(&b, 3, 1);
+    put_bytes(&b, (const uint8_t *)"One", 3);
+    put(&b, 2, 2);
+    put(&b, 3, 1);
+    put_bytes(&b, (const uint8_t *)"Two", 3);
+    patch(&b, at, b.len - at - 2, 2);
+
+    block(&b, BLK_STOP_48K);
+    put(&b, 0, 4);
+
+    block(&b, BLK_MSG);
+    put(&b, 1, 1); // Seconds
+    put(&b, 2, 1);
+    put_bytes(&b, (const uint8_t *)"Hi", 2);
+
+    block(&b, BLK_CUSTOM);
+    put_bytes(&b, (const uint8_t *)"tappioca        ", 16);
+    put(&b, 4, 4);
+    put(&b, 0xDEADBEEF, 4);
+
+    block(&b, BLK_GLUE);
+    put_bytes(&b, (const uint8_t *)"XTape!\x1A", 7);
+    put(&b, 1, 1);
+    put(&b, 20, 1);
+
+    std_block(&b, 1000, 0xFF, 8);
+
+    // Padding, if asked for
+    while (b.blocks < count)
+    {
+        if (b.blocks % 3)
+            std_block(&b, 1, 0xFF, 4);
+        else
+            pause_block(&b, 1);
+    }
+
+    if (noise > 0)
+        noise_block(&b, noise);
+    if (flow)
+        flow_blocks(&b);
+
+    // ID, name and length, then as much as brings it to the next multiple
+    if (align > 0)
+    {
+        uint32_t fill = (align - (b.len + 1 + 16 + 4) % align) % align;
+        block(&b, BLK_CUSTOM);
+        put_bytes(&b, (const uint8_t *)"tappioca padding", 16);
+        put(&b, fill, 4);
+        for (uint32_t i = 0; i < fill; i++)
+            put(&b, 0, 1);
+    }
+
+    FILE *out = fopen(out_name, "wb");
+    if (out == NULL)
+    {
+        printf("Cannot create %s\n", out_name);
+        return 1;
+    }
+    fwrite(b.data, 1, b.len, out);
+    fclose(out);
+    free(b.data);
+
+    printf("%u blocks, %u bytes\n", b.blocks, b.len);
+    return 0;
+}
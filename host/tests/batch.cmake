@@ -0,0 +1,39 @@
+# Render a directory of synthetic tapes with tappioca-wav on one thread and on four, and check
+# each WAV is the same both times and the same as tappioca-render -f wav makes - run by ctest as
+#   cmake -DSYNTH=... -DPZX=... -DRENDER=... -DWAV=... -DWORK=... -P batch.cmake
+# The directory has a TZX and a PZX of the same name, and another of that name under it
+file(REMOVE_RECURSE ${WORK})
+file(MAKE_DIRECTORY ${WORK}/tapes/more)
+
+function(run)
+    execute_process(COMMAND ${ARGN} RESULT_VARIABLE result OUTPUT_VARIABLE output)
+    if(result)
+        message(FATAL_ERROR "${ARGN} failed: ${result}\n${output}")
+    endif()
+endfunction()
+
+run(${SYNTH} ${WORK}/tapes/synth.tzx)
+run(${SYNTH} -c ${WORK}/flow.tzx)
+run(${PZX} ${WORK}/flow.tzx ${WORK}/tapes/synth.pzx)
+run(${SYNTH} -d 1 ${WORK}/tapes/more/synth.tzx)
+
+run(${WAV} -j 1 ${WORK}/one ${WORK}/tapes)
+run(${WAV} -j 4 ${WORK}/four ${WORK}/tapes)
+
+foreach(tape synth.tzx synth.pzx more/synth.tzx)
+    run(${RENDER} -f wav ${WORK}/tapes/${tape} ${WORK}/render.wav)
+    foreach(out one four)
+        execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${WORK}/${out}/${tape}.wav ${WORK}/render.wav
+                        RESULT_VARIABLE result)
+        if(result)
+            message(FATAL_ERROR "${WORK}/${out}/${tape}.wav differs from tappioca-render -f wav")
+        endif()
+    endforeach()
+endforeach()
+
+# Two tapes of the same name given from different directories would be one WAV, so are refused
+execute_process(COMMAND ${WAV} ${WORK}/clash ${WORK}/tapes/synth.tzx ${WORK}/tapes/more/synth.tzx
+                RESULT_VARIABLE result OUTPUT_QUIET)
+if(NOT result)
+    message(FATAL_ERROR "tappioca-wav rendered two tapes to ${WORK}/clash/synth.tzx.wav")
+endif()
@@ -0,0 +1,232 @@
+/*
+ * test-flashcache - a tape played from its flash cache is the tape played
+ *
+ * Three tapes are cached through the host flash model (see flashsim.h) in
+ * a region just big enough for the first two. Each cache has to replay
+ * word for word what the player makes from the tape, when just built and
+ * when found again after the region is closed and opened, as after a
+ * reboot. The third cache wraps to the start of the region, over part of
+ * the first, which then has to be built again rather than played - and
+ * the second is still played from its cache if the third stopped short of
+ * it.
+ *
+ * The tapes are given in that order, the first taking more sectors than
+ * the third, so only part of it is written over.
+ */
+#define _GNU_SOURCE   // mkdtemp
+#include <stdio.h>    // printf
+#include <stdlib.h>   // mkdtemp, malloc, realloc
+#include <unistd.h>   // rmdir
+#include "flashcache.h"
+#include "flashsim.h"
+
+#define TAPES 3
+
+static pulse_t chunk[PULSE_CHUNK];
+static int failed;
+
+typedef struct t_words
+{
+    pulse_t *words;
+    uint32_t len;
+    uint32_t size;
+} t_words;
+
+typedef struct t_test_tape
+{
+    const char *name;
+    uint8_t *data;
+    uint32_t size;
+    t_tape tape;
+    t_player player;
+    t_words plain;
+    uint32_t sectors;
+} t_test_tape;
+
+static void check(bool ok, const char *what, const char *name)
+{
+    if (!ok)
+    {
+        printf("Failed: %s, %s\n", name, what);
+        failed++;
+    }
+}
+
+static void add_words(t_words *w, const t_pulse_sink *s)
+{
+    if (w->len + s->pos > w->size)
+    {
+        w->size = 2 * w->size + s->pos;
+        w->words = realloc(w->words, w->size * sizeof(pulse_t));
+    }
+    for (uint32_t i = 0; i < s->pos; i++)
+        w->words[w->len++] = s->buf[i];
+}
+
+static bool same_words(const t_words *a, const t_words *b)
+{
+    if (a->len != b->len)
+        return false;
+    for (uint32_t i = 0; i < a->len; i++)
+    {
+        if (a->words[i] != b->words[i])
+            return false;
+    }
+    return true;
+}
+
+// The whole stream from a cache just opened or built
+static void replay(t_flashcache *c, t_words *w)
+{
+    t_pulse_sink sink;
+    pulse_sink_init(&sink, chunk, PULSE_CHUNK);
+    w->len = 0;
+    bool done;
+    do
+    {
+        done = flashcache_fill(c, &sink);
+        add_words(w, &sink);
+        sink.pos = 0;
+    } while (!done);
+}
+
+/*
+ * Look for the tape's cache, and build one if there is none, checking it
+ * was found or not as expected. Either way its replay has to be the plain
+ * play. The cache is left in c
+ */
+static void cache_tape(t_test_tape *t, t_flash *flash, t_flashcache *c, bool expect, const char *what)
+{
+    static t_words cached;
+    t_pulse_sink sink;
+    pulse_sink_init(&sink, chunk, PULSE_CHUNK);
+
+    bool found = flashcache_open(c, flash, &t->tape, CACHE_AS_RECORDED);
+    check(found == expect, what, t->name);
+    if (!found && !flashcache_build(c, &t->player, &sink))
+    {
+        check(false, "cannot build its cache", t->name);
+        return;
+    }
+    replay(c, &cached);
+    check(same_words(&cached, &t->plain), "the cache does not replay the tape", t->name);
+}
+
+// A fresh region of the size given, or the one already in the file
+static bool open_region(t_flash *flash, t_flash_sim *sim, const char *path, uint32_t size)
+{
+    if (!flash_sim_open(flash, sim, path, size))
+    {
+        printf("Cannot open %s\n", path);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != TAPES + 1)
+    {
+        printf("Usage: test-flashcache <tape> <tape> <tape>\n");
+        return 2;
+    }
+
+    char dir[] = "/tmp/test-flashcache-XXXXXX";
+    if (mkdtemp(dir) == NULL)
+    {
+        printf("Cannot make a directory to work in\n");
+        return 1;
+    }
+    char path[64];
+    snprintf(path, sizeof(path), "%s/flash.bin", dir);
+
+    // Each tape played in full, then cached on its own to see how many sectors it takes
+    static t_test_tape tapes[TAPES];
+    static t_flashcache cache;
+    t_flash flash;
+    t_flash_sim sim;
+    for (int x = 0; x < TAPES; x++)
+    {
+        t_test_tape *t = &tapes[x];
+        t->name = argv[x + 1];
+        FILE *f = fopen(t->name, "rb");
+        if (f == NULL)
+        {
+            printf("Cannot open %s\n", t->name);
+            return 1;
+        }
+        t->data = malloc(1024 * 1024);
+        t->size = fread(t->data, 1, 1024 * 1024, f);
+        fclose(f);
+        tape_open_mem(&t->tape, t->data, t->size);
+        if (!player_open(&t->player, &t->tape))
+        {
+            printf("%s: not a tape that can be played\n", t->name);
+            return 1;
+        }
+
+        t_pulse_sink sink;
+        pulse_sink_init(&sink, chunk, PULSE_CHUNK);
+        bool done;
+        do
+        {
+            done = player_fill(&t->player, &sink);
+            add_words(&t->plain, &sink);
+            sink.pos = 0;
+        } while (!done);
+        player_rewind(&t->player);
+
+        remove(path);
+        if (!open_region(&flash, &sim, path, 1024 * 1024))
+            return 1;
+        cache_tape(t, &flash, &cache, false, "found in a fresh region");
+        t->sectors = (FLASH_PAGE + cache.bytes + FLASH_SECTOR - 1) / FLASH_SECTOR;
+        flash_sim_close(&sim);
+    }
+    if (tapes[0].sectors <= tapes[2].sectors)
+        printf("%s takes no more sectors than %s, so is all written over\n", tapes[0].name, tapes[2].name);
+
+    // The first two fill the region between them
+    uint32_t size = (tapes[0].sectors + tapes[1].sectors) * FLASH_SECTOR;
+    remove(path);
+    if (!open_region(&flash, &sim, path, size))
+        return 1;
+    cache_tape(&tapes[0], &flash, &cache, false, "found in a fresh region");
+    check(cache.start == 0, "not built at the start", tapes[0].name);
+    cache_tape(&tapes[1], &flash, &cache, false, "found before it was built");
+    check(cache.start == tapes[0].sectors * FLASH_SECTOR, "not built after the first", tapes[1].name);
+    flash_sim_close(&sim);
+
+    // Both are found again after a reboot
+    if (!open_region(&flash, &sim, path, size))
+        return 1;
+    cache_tape(&tapes[0], &flash, &cache, true, "not found again");
+    cache_tape(&tapes[1], &flash, &cache, true, "not found again");
+
+    // The third goes back to the start, over the first
+    cache_tape(&tapes[2], &flash, &cache, false, "found before it was built");
+    check(cache.start == 0, "not built at the start, over the first", tapes[2].name);
+    bool second_kept = (tapes[2].sectors <= tapes[0].sectors);
+    flash_sim_close(&sim);
+
+    if (!open_region(&flash, &sim, path, size))
+        return 1;
+    cache_tape(&tapes[1], &flash, &cache, second_kept,
+               second_kept ? "not found after the third stopped short of it" : "found after the third overwrote it");
+    cache_tape(&tapes[0], &flash, &cache, false, "found after the third overwrote part of it");
+    flash_sim_close(&sim);
+
+    // Tidy up
+    for (int x = 0; x < TAPES; x++)
+    {
+        player_close(&tapes[x].player);
+        free(tapes[x].data);
+        free(tapes[x].plain.words);
+    }
+    remove(path);
+    if (rmdir(dir) != 0)
+        printf("Cannot remove %s\n", dir);
+
+    printf("%d failed\n", failed);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,28 @@
+# Write a synthetic tape, render it and compare the render with its golden - run by ctest as
+#   cmake -DSYNTH=... -DRENDER=... -DARGS=... -DGOLDEN=... -DWORK=... [-DPZX=...] -P golden.cmake
+# With PZX, the tape is written out as a PZX first, which has to render the same
+separate_arguments(ARGS)
+
+execute_process(COMMAND ${SYNTH} ${ARGS} ${WORK}.tzx RESULT_VARIABLE result OUTPUT_QUIET)
+if(result)
+    message(FATAL_ERROR "tappioca-synth ${ARGS} failed: ${result}")
+endif()
+
+set(tape ${WORK}.tzx)
+if(PZX)
+    execute_process(COMMAND ${PZX} ${WORK}.tzx ${WORK}.pzx RESULT_VARIABLE result OUTPUT_QUIET)
+    if(result)
+        message(FATAL_ERROR "tappioca-pzx failed: ${result}")
+    endif()
+    set(tape ${WORK}.pzx)
+endif()
+
+execute_process(COMMAND ${RENDER} ${tape} ${WORK}.txt RESULT_VARIABLE result OUTPUT_QUIET)
+if(result)
+    message(FATAL_ERROR "tappioca-render ${tape} failed: ${result}")
+endif()
+
+execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${WORK}.txt ${GOLDEN} RESULT_VARIABLE result)
+if(result)
+    message(FATAL_ERROR "${WORK}.txt differs from ${GOLDEN}")
+endif()
@@ -0,0 +1,157 @@
+/*
+ * test-heap - a tape's size doesn't change the memory it takes to play
+ *
+ * A small and a large tape, each a single Pure Data block, are played
+ * through the two-half window from a source that only hands out what is
+ * asked for, as the SD card does. The player and decoders' calls to malloc
+ * and friends are wrapped (see CMakeLists.txt) to keep count of the bytes
+ * they have live, and the most they ever have is the same for both tapes -
+ * the data only ever passes through the window, however much of it there
+ * is. Every byte of the tape is read from the source just the once.
+ */
+#include <stdio.h>  // printf
+#include <string.h> // memcpy, memset
+#include "player.h"
+
+// Data bytes in each tape, the large one far more than the window
+#define SMALL_DATA 1000
+#define LARGE_DATA (256 * 1024)
+
+/*
+ * The wrapped allocator: each block has its size in front, so the live
+ * total can be kept
+ */
+#define HEAP_HDR 16
+
+void *__real_malloc(size_t size);
+void __real_free(void *ptr);
+
+static size_t heap_live, heap_peak;
+
+void *__wrap_malloc(size_t size)
+{
+    uint8_t *p = __real_malloc(HEAP_HDR + size);
+    if (p == NULL)
+        return NULL;
+    *(size_t *)p = size;
+    heap_live += size;
+    if (heap_live > heap_peak)
+        heap_peak = heap_live;
+    return p + HEAP_HDR;
+}
+
+void __wrap_free(void *ptr)
+{
+    if (ptr == NULL)
+        return;
+    uint8_t *p = (uint8_t *)ptr - HEAP_HDR;
+    heap_live -= *(size_t *)p;
+    __real_free(p);
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+    void *p = __wrap_malloc(n * size);
+    if (p != NULL)
+        memset(p, 0, n * size);
+    return p;
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    void *p = __wrap_malloc(size);
+    if ((p != NULL) && (ptr != NULL))
+    {
+        size_t old = *(size_t *)((uint8_t *)ptr - HEAP_HDR);
+        memcpy(p, ptr, (old < size) ? old : size);
+        __wrap_free(ptr);
+    }
+    return p;
+}
+
+// The source, counting what is read from it
+typedef struct t_source
+{
+    const uint8_t *data;
+    uint32_t size;
+    uint64_t read;
+} t_source;
+
+static uint32_t source_read(void *ctx, uint32_t addr, uint8_t *dst, uint32_t len)
+{
+    t_source *s = ctx;
+    if (addr >= s->size)
+        return 0;
+    if (len > s->size - addr)
+        len = s->size - addr;
+    memcpy(dst, s->data + addr, len);
+    s->read += len;
+    return len;
+}
+
+// A TZX of one Pure Data block of that many bytes
+static uint8_t *make_tape(uint32_t data, uint32_t *size)
+{
+    static const uint8_t hdr[] = {'Z', 'X', 'T', 'a', 'p', 'e', '!', 0x1A, 1, 20,
+                                  BLK_PDATA, 0x57, 0x03, 0xAE, 0x06, 8, 0xE8, 0x03};
+    *size = sizeof(hdr) + 3 + data;
+    uint8_t *tape = __real_malloc(*size);
+    memcpy(tape, hdr, sizeof(hdr));
+    for (int x = 0; x < 3; x++)
+        tape[sizeof(hdr) + x] = (data >> (x * 8)) & 0xFF;
+    for (uint32_t i = 0; i < data; i++)
+        tape[sizeof(hdr) + 3 + i] = i * 7;
+    return tape;
+}
+
+// Most heap the tape took to open and play, or 0 if it didn't play as it should
+static size_t play(uint32_t data)
+{
+    static uint8_t window[2][TAPE_CHUNK];
+    static pulse_t chunk[PULSE_CHUNK];
+    t_source src;
+    t_tape tape;
+    t_player player;
+    t_pulse_sink sink;
+
+    src.data = make_tape(data, &src.size);
+    src.read = 0;
+    heap_live = heap_peak = 0;
+
+    tape_open(&tape, source_read, &src, src.size, window);
+    if (!player_open(&player, &tape))
+    {
+        printf("%u bytes: not a tape that can be played\n", data);
+        return 0;
+    }
+    pulse_sink_init(&sink, chunk, PULSE_CHUNK);
+    uint64_t words = 0;
+    bool done;
+    do
+    {
+        done = player_fill(&player, &sink);
+        words += sink.pos;
+        sink.pos = 0;
+        player_prefetch(&player);
+    } while (!done);
+    player_close(&player);
+    __real_free((void *)src.data);
+
+    // Two words a bit, and the pause
+    bool ok = (words >= (uint64_t)data * 16) && (src.read == src.size) && (heap_live == 0);
+    printf("%u bytes: %llu words, %llu bytes read of %u, %zu bytes of heap at most, %zu left\n", data,
+           (unsigned long long)words, (unsigned long long)src.read, src.size, heap_peak, heap_live);
+    return ok ? heap_peak : 0;
+}
+
+int main(void)
+{
+    size_t small = play(SMALL_DATA);
+    size_t large = play(LARGE_DATA);
+    if ((small == 0) || (large == 0) || (large != small))
+    {
+        printf("Failed\n");
+        return 1;
+    }
+    return 0;
+}
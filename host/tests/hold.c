@@ -0,0 +1,73 @@
+/*
+ * test-hold - holds either side of the longest word
+ *
+ * A hold longer than one word is sent as the longest word and a zero word
+ * to flip straight back, then the rest - and just past PULSE_MAX, the
+ * rest is less than the zero word and the shortest word it leaves room
+ * for. Every hold from just under the longest word to past that is sent
+ * as a PZX pause, and has to come out as words adding up to the hold,
+ * each one a word the PIO can play, in a bounded number of words.
+ */
+#include <stdio.h> // printf
+#include "blocks.h"
+
+// More than any of these holds takes
+#define WORDS_MAX 16
+
+// As pulse_cycles(), but the longest word of a PULSE_HIRES build is more than 32 bits of cycles
+static uint64_t word_cycles(pulse_t word)
+{
+    return word ? (uint64_t)word + ASM_OFFSET : ASM_FLIP;
+}
+
+int main(void)
+{
+    static pulse_t chunk[PULSE_CHUNK];
+    int failed = 0;
+
+    // In t-states, so a PULSE_HIRES build tries the ones around the same cycles
+    uint64_t first = (PULSE_MAX - 2) / PULSE_SCALE;
+    uint64_t last = (PULSE_MAX + ASM_OFFSET + ASM_FLIP + 2 + PULSE_SCALE - 1) / PULSE_SCALE;
+    for (uint64_t tstates = first; tstates <= last; tstates++)
+    {
+        // PAUS at the level it starts at, so no flip first
+        uint8_t pzx[12] = {'P', 'A', 'U', 'S', 4, 0, 0, 0};
+        for (int x = 0; x < 4; x++)
+            pzx[8 + x] = (tstates >> (x * 8)) & 0xFF;
+        pzx[11] |= 0x80;
+
+        t_tape tape;
+        t_block_desc blk;
+        t_decoder dec;
+        t_pulse_sink sink;
+        tape_open_mem(&tape, pzx, sizeof(pzx));
+        pulse_sink_init(&sink, chunk, PULSE_CHUNK);
+        uint8_t data = block_parse(BLK_PZX_PAUSE, pzx, &blk);
+        block_begin(&dec, &blk, &tape, data);
+
+        // One chunk is far more room than it needs, so a hold that never ends fills it
+        bool done = block_fill(&dec, &sink);
+        uint64_t cycles = 0;
+        bool bad = !done || (sink.pos > WORDS_MAX);
+        for (uint32_t i = 0; i < sink.pos; i++)
+        {
+            cycles += word_cycles(chunk[i]);
+            // A zero word is only ever the flip back after a longest word
+            if ((chunk[i] == 0) && ((i == 0) || (chunk[i - 1] == 0)))
+                bad = true;
+        }
+        if (sink.pos && (chunk[sink.pos - 1] == 0))
+            bad = true;
+
+        uint64_t hold = tstates * PULSE_SCALE;
+        if (bad || (cycles != hold))
+        {
+            printf("Hold of %llu cycles: %s, %u words, %llu cycles\n", (unsigned long long)hold,
+                   done ? "done" : "not done", sink.pos, (unsigned long long)cycles);
+            failed++;
+        }
+    }
+
+    printf("%llu holds, %d failed\n", (unsigned long long)(last - first + 1), failed);
+    return failed ? 1 : 0;
+}
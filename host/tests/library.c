@@ -0,0 +1,242 @@
+/*
+ * test-library - the catalogue only indexes the directories that changed
+ *
+ * A tree of tapes is written to a fresh directory standing in for the SD
+ * card and catalogued through library_open(), as the firmware does on
+ * boot. The first time every tape has to be indexed, and each has to be
+ * found by number and by path. After that, only the tapes of a directory
+ * whose listing has changed - a tape with a new date or size, one added or
+ * one taken away - are indexed again, and the rest of the catalogue, and
+ * the hashes of the other directories, stay as they were.
+ *
+ * A tape whose path is too long to keep is left out, and so is a tape in a
+ * directory whose path is.
+ */
+#define _GNU_SOURCE   // mkdtemp
+#include <stdio.h>    // printf
+#include <stdlib.h>   // mkdtemp
+#include <string.h>   // memcpy, memcmp, strcmp, strstr
+#include <unistd.h>   // chdir, rmdir
+#include <sys/stat.h> // mkdir
+#include <sys/time.h> // utimes
+#include "ff.h"
+#include "blocks.h"
+#include "library.h"
+
+// The date every tape is given, so only a change to it is a change
+#define TAPE_TIME 1000000000
+
+// A directory name that leaves no room for a tape in it
+#define LONG_DIR "A_DIRECTORY_WITH_A_NAME_SO_LONG_THAT_NO_TAPE_PATH_IN_IT_FITS"
+
+static int failed;
+
+static void check(bool ok, const char *what)
+{
+    if (!ok)
+    {
+        printf("Failed: %s\n", what);
+        failed++;
+    }
+}
+
+static void put(uint8_t *buf, uint32_t *len, uint32_t value, int width)
+{
+    for (int x = 0; x < width; x++)
+        buf[(*len)++] = (value >> (x * 8)) & 0xFF;
+}
+
+// A standard data block of the size given, as a TZX or a TAP, with the file's date set
+static void write_tape(const char *name, uint16_t size, time_t date)
+{
+    static uint8_t buf[8 * 1024];
+    bool tzx = strstr(name, ".TZX") != NULL;
+    uint32_t len = 0;
+    if (tzx)
+    {
+        memcpy(buf, "ZXTape!\x1A\x01\x14", 10);
+        len = 10;
+        put(buf, &len, BLK_STD, 1);
+        put(buf, &len, 1000, 2);
+    }
+    put(buf, &len, size, 2);
+    for (uint16_t i = 0; i < size; i++)
+        put(buf, &len, (uint8_t)i, 1);
+
+    FILE *f = fopen(name, "wb");
+    fwrite(buf, 1, len, f);
+    fclose(f);
+    struct timeval tv[2] = {{date, 0}, {date, 0}};
+    utimes(name, tv);
+}
+
+static const char *const tapes[] = {
+    "ROOT.TAP", "GAMES/ALPHA.TZX", "GAMES/BETA.TAP", "GAMES/MORE/GAMMA.TZX", "UTILS/DELTA.TZX",
+};
+#define TAPES (sizeof(tapes) / sizeof(tapes[0]))
+
+typedef struct t_opened
+{
+    bool ok;
+    uint32_t count;
+    uint32_t scanned;
+    uint32_t dir_count;
+    t_lib_dir dirs[8];
+} t_opened;
+
+static t_opened open_library(void)
+{
+    static uint8_t window[2][TAPE_CHUNK];
+    static pulse_t chunk[PULSE_CHUNK];
+    t_pulse_sink sink;
+    t_library lib;
+    t_opened o = {0};
+
+    pulse_sink_init(&sink, chunk, PULSE_CHUNK);
+    o.ok = library_open(&lib, window, &sink);
+    if (!o.ok)
+        return o;
+    o.count = lib.count;
+    o.scanned = lib.scanned;
+    o.dir_count = lib.dir_count;
+    for (uint32_t i = 0; (i < lib.dir_count) && (i < 8); i++)
+        o.dirs[i] = lib.dirs[i];
+    library_close(&lib);
+    return o;
+}
+
+// Hash of a directory's listing, as the catalogue has it
+static uint32_t dir_hash(const t_opened *o, const char *path)
+{
+    for (uint32_t i = 0; (i < o->dir_count) && (i < 8); i++)
+    {
+        if (!strcmp(o->dirs[i].path, path))
+            return o->dirs[i].hash;
+    }
+    return 0;
+}
+
+// Open again, checking how many tapes there are and how many were indexed
+static t_opened reopen(uint32_t count, uint32_t scanned, const char *what)
+{
+    t_opened o = open_library();
+    char line[128];
+    snprintf(line, sizeof(line), "%s: %u tapes, %u indexed, not %u and %u", what, o.count, o.scanned, count,
+             scanned);
+    check(o.ok && (o.count == count) && (o.scanned == scanned), line);
+    return o;
+}
+
+// Every tape in the catalogue in order, found by number and by path, each with its blocks
+static void check_tapes(const char *const *paths, uint32_t count, const char *what)
+{
+    static uint8_t window[2][TAPE_CHUNK];
+    static pulse_t chunk[PULSE_CHUNK];
+    t_pulse_sink sink;
+    t_library lib;
+    char line[160];
+
+    pulse_sink_init(&sink, chunk, PULSE_CHUNK);
+    if (!library_open(&lib, window, &sink))
+    {
+        snprintf(line, sizeof(line), "%s: cannot open the catalogue", what);
+        check(false, line);
+        return;
+    }
+    for (uint32_t n = 0; n < count; n++)
+    {
+        t_lib_entry e;
+        char path[LIB_PATH];
+        snprintf(line, sizeof(line), "%s: tape %u is %s, with one block", what, n, paths[n]);
+        check(library_get(&lib, n, &e, path) && !strcmp(path, paths[n]) && (e.blocks == 1), line);
+        snprintf(line, sizeof(line), "%s: %s is found as tape %u", what, paths[n], n);
+        check(library_find(&lib, paths[n]) == (int32_t)n, line);
+    }
+    snprintf(line, sizeof(line), "%s: tapes with paths too long to keep are left out", what);
+    check((library_find(&lib, LONG_DIR "/GAME.TZX") < 0) && (library_find(&lib, LONG_DIR "/DEEPER/GAME.TZX") < 0),
+          line);
+    library_close(&lib);
+}
+
+int main(void)
+{
+    char dir[] = "/tmp/test-library-XXXXXX";
+    if ((mkdtemp(dir) == NULL) || (chdir(dir) != 0))
+    {
+        printf("Cannot make a directory to work in\n");
+        return 1;
+    }
+
+    mkdir("GAMES", 0777);
+    mkdir("GAMES/MORE", 0777);
+    mkdir("UTILS", 0777);
+    mkdir(LONG_DIR, 0777);
+    mkdir(LONG_DIR "/DEEPER", 0777);
+    mkdir("EMPTY", 0777);
+    for (uint32_t x = 0; x < TAPES; x++)
+        write_tape(tapes[x], 100 + x, TAPE_TIME);
+    write_tape(LONG_DIR "/GAME.TZX", 100, TAPE_TIME);
+    write_tape(LONG_DIR "/DEEPER/GAME.TZX", 100, TAPE_TIME);
+
+    // First time, every tape that fits is indexed, in order of directory then name
+    t_opened first = reopen(TAPES, TAPES, "first catalogue");
+    check_tapes(tapes, TAPES, "first catalogue");
+    check(first.dir_count == 6, "every directory that fits is listed, with or without tapes");
+
+    // Nothing changed, nothing indexed
+    t_opened same = reopen(TAPES, 0, "unchanged card");
+    check(!memcmp(same.dirs, first.dirs, sizeof(first.dirs)), "unchanged card: the directory table is the same");
+
+    // A new date in one directory - just its tapes, and just its hash
+    struct timeval tv[2] = {{TAPE_TIME + 60, 0}, {TAPE_TIME + 60, 0}};
+    utimes("GAMES/BETA.TAP", tv);
+    t_opened dated = reopen(TAPES, 2, "tape with a new date");
+    check(dir_hash(&dated, "GAMES") != dir_hash(&first, "GAMES"), "a new date changes the directory's hash");
+    check((dir_hash(&dated, "") == dir_hash(&first, "")) &&
+              (dir_hash(&dated, "GAMES/MORE") == dir_hash(&first, "GAMES/MORE")) &&
+              (dir_hash(&dated, "UTILS") == dir_hash(&first, "UTILS")),
+          "a new date leaves the other directories' hashes alone");
+
+    // Another size, the same date
+    write_tape("UTILS/DELTA.TZX", 200, TAPE_TIME);
+    t_opened grown = reopen(TAPES, 1, "tape of another size");
+    check(dir_hash(&grown, "UTILS") != dir_hash(&dated, "UTILS"), "another size changes the directory's hash");
+
+    // One added below, then one taken away from the root
+    write_tape("GAMES/MORE/EPSILON.TAP", 100, TAPE_TIME);
+    reopen(TAPES + 1, 2, "tape added");
+    static const char *const added[] = {
+        "ROOT.TAP", "GAMES/ALPHA.TZX", "GAMES/BETA.TAP", "GAMES/MORE/EPSILON.TAP", "GAMES/MORE/GAMMA.TZX",
+        "UTILS/DELTA.TZX",
+    };
+    check_tapes(added, TAPES + 1, "tape added");
+
+    remove("ROOT.TAP");
+    reopen(TAPES, 0, "tape taken away");
+    check_tapes(added + 1, TAPES, "tape taken away");
+
+    // Tidy up
+    static const char *const left[] = {
+        "GAMES/ALPHA.TZX", "GAMES/BETA.TAP", "GAMES/MORE/EPSILON.TAP", "GAMES/MORE/GAMMA.TZX", "UTILS/DELTA.TZX",
+        LONG_DIR "/GAME.TZX", LONG_DIR "/DEEPER/GAME.TZX", LIB_FILE,
+    };
+    for (uint32_t x = 0; x < sizeof(left) / sizeof(left[0]); x++)
+    {
+        char idx[128];
+        snprintf(idx, sizeof(idx), "%s.idx", left[x]);
+        remove(left[x]);
+        remove(idx);
+    }
+    remove("ROOT.TAP.idx");
+    rmdir("GAMES/MORE");
+    rmdir("GAMES");
+    rmdir("UTILS");
+    rmdir(LONG_DIR "/DEEPER");
+    rmdir(LONG_DIR);
+    rmdir("EMPTY");
+    if ((chdir("/") != 0) || (rmdir(dir) != 0))
+        printf("Cannot remove %s\n", dir);
+
+    printf("%d failed\n", failed);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,135 @@
+/*
+ * test-pack - a tape played out of a pack is the tape played from its file
+ *
+ * The archive given is opened as the firmware opens the one built in, and
+ * each tape given is found in it by name and played through
+ * tape_read_pack(), which inflates a chunk into the window as it is read.
+ * That has to be word for word what the player makes reading the tape's
+ * own file through the window, as it would from the SD card - including
+ * for a tape that ends exactly on a TAPE_CHUNK boundary, so its last chunk
+ * is a whole one.
+ */
+#include <stdio.h>  // printf
+#include <stdlib.h> // malloc, realloc
+#include <string.h> // strrchr
+#include "ff.h"
+#include "player.h"
+#include "tapepack.h"
+
+static pulse_t chunk[PULSE_CHUNK];
+static uint8_t window[2][TAPE_CHUNK];
+
+typedef struct t_play
+{
+    pulse_t *words;
+    uint32_t len;
+    uint32_t size;
+} t_play;
+
+// The tape played to the end, false if it cannot be
+static bool play(t_tape *t, t_play *r)
+{
+    t_player player;
+    t_pulse_sink sink;
+    r->len = 0;
+    if (!player_open(&player, t))
+        return false;
+
+    pulse_sink_init(&sink, chunk, PULSE_CHUNK);
+    bool done;
+    do
+    {
+        done = player_fill(&player, &sink);
+        if (r->len + sink.pos > r->size)
+        {
+            r->size = 2 * r->size + sink.pos;
+            r->words = realloc(r->words, r->size * sizeof(pulse_t));
+        }
+        for (uint32_t i = 0; i < sink.pos; i++)
+            r->words[r->len++] = chunk[i];
+        sink.pos = 0;
+    } while (!done);
+    player_close(&player);
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3)
+    {
+        printf("Usage: test-pack <archive> <tape>...\n");
+        return 2;
+    }
+
+    FILE *f = fopen(argv[1], "rb");
+    if (f == NULL)
+    {
+        printf("Cannot open %s\n", argv[1]);
+        return 1;
+    }
+    fseek(f, 0, SEEK_END);
+    uint32_t size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *data = malloc(size);
+    if ((data == NULL) || (fread(data, 1, size, f) != size))
+    {
+        printf("Cannot read %s\n", argv[1]);
+        return 1;
+    }
+    fclose(f);
+
+    t_pack pack;
+    if (!pack_open(&pack, data, size))
+    {
+        printf("%s: not a pack\n", argv[1]);
+        return 1;
+    }
+
+    int failed = 0;
+    t_play packed = {0}, file = {0};
+    for (int x = 2; x < argc; x++)
+    {
+        const char *slash = strrchr(argv[x], '/');
+        const char *name = slash ? slash + 1 : argv[x];
+        int32_t n = pack_find(&pack, name);
+        t_pack_reader reader;
+        t_tape tape;
+        if ((n < 0) || !pack_tape_open(&pack, n, &reader, &tape, window))
+        {
+            printf("%s: not in the pack\n", name);
+            failed++;
+            continue;
+        }
+        bool ok = play(&tape, &packed);
+
+        FIL fh;
+        if (f_open(&fh, argv[x], FA_READ) != FR_OK)
+        {
+            printf("Cannot open %s\n", argv[x]);
+            failed++;
+            continue;
+        }
+        uint32_t bytes = f_size(&fh);
+        tape_open(&tape, tape_read_fatfs, &fh, bytes, window);
+        ok = play(&tape, &file) && ok;
+        f_close(&fh);
+
+        uint32_t diff = 0;
+        while ((diff < packed.len) && (diff < file.len) && (packed.words[diff] == file.words[diff]))
+            diff++;
+        if (!ok || (packed.len != file.len) || (diff != file.len))
+        {
+            printf("%s: %u words from the pack, %u from the file, differing from word %u\n", name, packed.len,
+                   file.len, diff);
+            failed++;
+        }
+        else
+            printf("%s: %u bytes, %u words, the same both ways\n", name, bytes, file.len);
+    }
+
+    free(packed.words);
+    free(file.words);
+    free(data);
+    printf("%d failed\n", failed);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,27 @@
+# Pack the synthetic tapes, and check each plays the same out of the pack as from its file - run by ctest as
+#   cmake -DSYNTH=... -DPACK=... -DTEST=... -DWORK=... -P pack.cmake
+# One tape is padded to a multiple of TAPE_CHUNK (4096), so the last chunk of it is a whole one
+file(REMOVE_RECURSE ${WORK})
+file(MAKE_DIRECTORY ${WORK})
+
+function(run)
+    execute_process(COMMAND ${ARGN} RESULT_VARIABLE result OUTPUT_VARIABLE output)
+    if(result)
+        message(FATAL_ERROR "${ARGN} failed: ${result}\n${output}")
+    endif()
+endfunction()
+
+run(${SYNTH} ${WORK}/synth.tzx)
+run(${SYNTH} -c ${WORK}/flow.tzx)
+run(${SYNTH} -d 1 ${WORK}/raw.tzx)
+run(${SYNTH} -d 1 -a 4096 ${WORK}/chunks.tzx)
+
+file(SIZE ${WORK}/chunks.tzx size)
+math(EXPR rest "${size} % 4096")
+if(NOT rest EQUAL 0)
+    message(FATAL_ERROR "${WORK}/chunks.tzx is ${size} bytes, not whole chunks")
+endif()
+
+set(tapes ${WORK}/synth.tzx ${WORK}/flow.tzx ${WORK}/raw.tzx ${WORK}/chunks.tzx)
+run(${PACK} ${WORK}/tapes.pak ${tapes})
+run(${TEST} ${WORK}/tapes.pak ${tapes})
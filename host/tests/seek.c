@@ -0,0 +1,183 @@
+/*
+ * test-seek - play from a block or a time is the tail of a full play
+ *
+ * The tape given is played in full, then from every block play reaches
+ * and from times all through it, and each of those has to be the words of
+ * the full play from there on, starting at the same level. From a time,
+ * the word the time falls in is cut short to what is left of it - or
+ * dropped, if that is less than the shortest word. A time in standard,
+ * turbo or pure data starts again at the byte it lands in instead, and a
+ * time in their pilot or sync starts the pilot again, so only the seek
+ * itself is checked there.
+ */
+#include <stdio.h>  // printf
+#include <stdlib.h> // malloc, realloc
+#include "player.h"
+
+// Times tried, spread evenly through the tape, each also tried a t-state either side
+#define TIMES 250
+
+static pulse_t chunk[PULSE_CHUNK];
+
+typedef struct t_play
+{
+    pulse_t *words;
+    uint8_t *levels;
+    uint64_t *at; // Cycles into the tape each word starts at, and one more for the end
+    uint32_t len;
+    uint32_t size;
+} t_play;
+
+static void add_words(t_play *r, const t_pulse_sink *s, uint8_t level, uint64_t *cycles)
+{
+    if (r->len + s->pos + 1 > r->size)
+    {
+        r->size = 2 * r->size + s->pos + 1;
+        r->words = realloc(r->words, r->size * sizeof(pulse_t));
+        r->levels = realloc(r->levels, r->size);
+        r->at = realloc(r->at, r->size * sizeof(uint64_t));
+    }
+    for (uint32_t i = 0; i < s->pos; i++, level ^= 1)
+    {
+        r->words[r->len] = s->buf[i];
+        r->levels[r->len] = level;
+        r->at[r->len++] = *cycles;
+        *cycles += pulse_cycles(s->buf[i]);
+    }
+    r->at[r->len] = *cycles;
+}
+
+// Play on to the end, the sink holding what a seek has left in it
+static void play(t_player *p, t_pulse_sink *s, t_play *r)
+{
+    uint64_t cycles = 0;
+    bool done;
+    r->len = 0;
+    do
+    {
+        uint8_t level = s->level ^ (s->pos & 1);
+        done = player_fill(p, s);
+        add_words(r, s, level, &cycles);
+        s->pos = 0;
+    } while (!done);
+}
+
+// The words from a seek against the full play from word k on, the first of them being first instead
+static bool same_tail(const t_play *full, uint32_t k, pulse_t first, const t_play *from)
+{
+    if ((from->len != full->len - k) || ((from->len > 0) && (from->levels[0] != full->levels[k])))
+        return false;
+    for (uint32_t i = 0; i < from->len; i++)
+    {
+        pulse_t word = i ? full->words[k + i] : first;
+        if ((from->words[i] != word) || (from->levels[i] != full->levels[k + i]))
+            return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2)
+    {
+        printf("Usage: test-seek <tape>\n");
+        return 2;
+    }
+    FILE *f = fopen(argv[1], "rb");
+    if (f == NULL)
+    {
+        printf("Cannot open %s\n", argv[1]);
+        return 1;
+    }
+    static uint8_t data[1024 * 1024];
+    uint32_t size = fread(data, 1, sizeof(data), f);
+    fclose(f);
+
+    t_tape tape;
+    t_player player;
+    t_pulse_sink sink;
+    t_play full = {0}, from = {0};
+    tape_open_mem(&tape, data, size);
+    if (!player_open(&player, &tape))
+    {
+        printf("%s: not a tape that can be played\n", argv[1]);
+        return 1;
+    }
+    pulse_sink_init(&sink, chunk, PULSE_CHUNK);
+    play(&player, &sink, &full);
+    uint64_t end = full.at[full.len];
+
+    int failed = 0, blocks = 0, times = 0, restarts = 0;
+    for (uint16_t b = 0; b < player.blocks; b++)
+    {
+        pulse_sink_init(&sink, chunk, PULSE_CHUNK);
+        if (!player_seek_block(&player, &sink, b))
+            continue;
+        blocks++;
+
+        // The first word at or after where the block starts
+        uint64_t at = player.seek[b].at;
+        uint32_t k = 0;
+        while ((k < full.len) && (full.at[k] < at))
+            k++;
+        play(&player, &sink, &from);
+        if ((full.at[k] != at) || !same_tail(&full, k, (k < full.len) ? full.words[k] : 0, &from))
+        {
+            if (failed++ < 10)
+                printf("From block %u, at %llu cycles: %u words, not the %u of the full play\n", b,
+                       (unsigned long long)at, from.len, full.len - k);
+        }
+    }
+
+    for (uint32_t x = 0; x < 3 * TIMES; x++)
+    {
+        int64_t tstates = (int64_t)(end / PULSE_SCALE * (x / 3) / TIMES) + (int)(x % 3) - 1;
+        uint64_t to = tstates * PULSE_SCALE;
+        if ((tstates < 0) || (to >= end))
+            continue;
+
+        pulse_sink_init(&sink, chunk, PULSE_CHUNK);
+        if (!player_seek_time(&player, &sink, tstates))
+        {
+            if (failed++ < 10)
+                printf("At %llu t-states: not found, in a tape of %llu\n", (unsigned long long)tstates,
+                       (unsigned long long)(end / PULSE_SCALE));
+            continue;
+        }
+        times++;
+
+        // Restarted data or pilot plays a pilot of its own - only that play found the time is checked
+        uint8_t type = player.dec.blk.type;
+        if ((sink.pos == 0) && player.playing && ((type == BLK_STD) || (type == BLK_TURBO) || (type == BLK_PDATA)))
+        {
+            restarts++;
+            continue;
+        }
+
+        // The word the time falls in, cut short or dropped
+        uint32_t k = 0;
+        while (full.at[k + 1] <= to)
+            k++;
+        uint64_t rest = full.at[k + 1] - to;
+        pulse_t first = full.words[k];
+        if (rest < pulse_cycles(first))
+        {
+            if (rest > ASM_OFFSET)
+                first = rest - ASM_OFFSET;
+            else if (++k < full.len)
+                first = full.words[k];
+        }
+        play(&player, &sink, &from);
+        if (!same_tail(&full, k, first, &from))
+        {
+            if (failed++ < 10)
+                printf("From %llu t-states: %u words, not the %u of the full play\n", (unsigned long long)tstates,
+                       from.len, full.len - k);
+        }
+    }
+
+    printf("%u words, %d blocks and %d times (%d in restarted data), %d failed\n", full.len, blocks, times,
+           restarts, failed);
+    player_close(&player);
+    return failed ? 1 : 0;
+}
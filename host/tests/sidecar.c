@@ -0,0 +1,230 @@
+/*
+ * test-sidecar - sidecar indexes are used when good, and rebuilt when not
+ *
+ * Tapes are written to a fresh directory standing in for the SD card and
+ * opened through sidecar_open(), as the firmware does. The first open has
+ * to scan the tape and write its sidecar, and the next has to read it back
+ * with the same index. Before each open the running time saved in the
+ * sidecar is changed to one no tape has, which the checks leave alone, so
+ * an open that used the sidecar comes back with it and one that scanned
+ * comes back with the real time, and saves that again.
+ *
+ * A change to the tape's date, size or first TAPE_CHUNK bytes, or a
+ * sidecar that is cut short or of another version, has to mean a scan. A
+ * TAP and a TZX of the same name each keep a sidecar of their own.
+ */
+#define _GNU_SOURCE   // mkdtemp
+#include <stdio.h>    // printf
+#include <stdlib.h>   // mkdtemp
+#include <string.h>   // memcpy
+#include <unistd.h>   // chdir, truncate
+#include <sys/time.h> // utimes
+#include "ff.h"
+#include "sidecar.h"
+
+// A running time no tape here has, in the sidecar of a tape that has not been scanned again
+#define MARKER 0x123456789ULL
+
+// The date every tape is given, so only a change to it is a change
+#define TAPE_TIME 1000000000
+
+static int failed;
+
+static void check(bool ok, const char *what)
+{
+    if (!ok)
+    {
+        printf("Failed: %s\n", what);
+        failed++;
+    }
+}
+
+static void put(uint8_t *buf, uint32_t *len, uint32_t value, int width)
+{
+    for (int x = 0; x < width; x++)
+        buf[(*len)++] = (value >> (x * 8)) & 0xFF;
+}
+
+// Standard data blocks of the sizes given, as a TZX or a TAP, with the file's date set
+static void write_tape(const char *name, bool tzx, const uint16_t *sizes, int blocks, uint8_t fill)
+{
+    static uint8_t buf[64 * 1024];
+    uint32_t len = 0;
+    if (tzx)
+    {
+        memcpy(buf, "ZXTape!\x1A\x01\x14", 10);
+        len = 10;
+    }
+    for (int b = 0; b < blocks; b++)
+    {
+        if (tzx)
+        {
+            put(buf, &len, BLK_STD, 1);
+            put(buf, &len, 1000, 2);
+        }
+        put(buf, &len, sizes[b], 2);
+        for (uint16_t i = 0; i < sizes[b]; i++)
+            put(buf, &len, (uint8_t)(fill + i), 1);
+    }
+
+    FILE *f = fopen(name, "wb");
+    fwrite(buf, 1, len, f);
+    fclose(f);
+    struct timeval tv[2] = {{TAPE_TIME, 0}, {TAPE_TIME, 0}};
+    utimes(name, tv);
+}
+
+// Running time saved in a sidecar, or -1 if it cannot be read
+static int64_t saved_duration(const char *idx)
+{
+    uint8_t hdr[IDX_HDR_SIZE];
+    FILE *f = fopen(idx, "rb");
+    if (f == NULL)
+        return -1;
+    bool ok = fread(hdr, 1, IDX_HDR_SIZE, f) == IDX_HDR_SIZE;
+    fclose(f);
+    return ok ? (int64_t)(parse_uint(hdr+20, 4) | (uint64_t)parse_uint(hdr+24, 4) << 32) : -1;
+}
+
+// Change the sidecar as given, and give it the marker for a running time
+static void mark(const char *idx, uint32_t at, uint8_t value)
+{
+    FILE *f = fopen(idx, "r+b");
+    if (f == NULL)
+        return;
+    uint8_t marker[8];
+    for (int x = 0; x < 8; x++)
+        marker[x] = (MARKER >> (x * 8)) & 0xFF;
+    fseek(f, 20, SEEK_SET);
+    fwrite(marker, 1, 8, f);
+    if (at > 0)
+    {
+        fseek(f, at, SEEK_SET);
+        fputc(value, f);
+    }
+    fclose(f);
+}
+
+typedef struct t_opened
+{
+    bool ok;
+    bool from_sidecar;
+    uint16_t blocks;
+    uint64_t duration;
+    t_block_entry index[16];
+} t_opened;
+
+static t_opened open_tape(const char *name)
+{
+    static uint8_t window[2][TAPE_CHUNK];
+    static pulse_t chunk[PULSE_CHUNK];
+    t_opened o = {0};
+    FIL fh;
+    t_tape tape;
+    t_player player;
+    t_pulse_sink sink;
+
+    if (f_open(&fh, name, FA_READ) != FR_OK)
+        return o;
+    tape_open(&tape, tape_read_fatfs, &fh, f_size(&fh), window);
+    pulse_sink_init(&sink, chunk, PULSE_CHUNK);
+    o.ok = sidecar_open(&player, &tape, &sink, name);
+    if (o.ok)
+    {
+        o.blocks = player.blocks;
+        o.duration = player.duration;
+        o.from_sidecar = (player.duration == MARKER);
+        for (uint16_t i = 0; (i < player.blocks) && (i < 16); i++)
+            o.index[i] = player.index[i];
+        player_close(&player);
+    }
+    f_close(&fh);
+    return o;
+}
+
+// Open once the sidecar is marked, and check it was read or scanned - and if scanned, saved again
+static t_opened open_marked(const char *name, const char *idx, bool from_sidecar, const char *what)
+{
+    t_opened o = open_tape(name);
+    char line[128];
+    snprintf(line, sizeof(line), "%s: %s", what, from_sidecar ? "read from the sidecar" : "scanned");
+    check(o.ok && (o.from_sidecar == from_sidecar), line);
+    if (o.ok && !from_sidecar)
+    {
+        snprintf(line, sizeof(line), "%s: sidecar saved again", what);
+        check(saved_duration(idx) == (int64_t)o.duration, line);
+    }
+    return o;
+}
+
+int main(void)
+{
+    char dir[] = "/tmp/test-sidecar-XXXXXX";
+    if ((mkdtemp(dir) == NULL) || (chdir(dir) != 0))
+    {
+        printf("Cannot make a directory to work in\n");
+        return 1;
+    }
+
+    static const uint16_t sizes[] = {19, 3000, 6000, 19};
+    write_tape("GAME.TZX", true, sizes, 3, 0);
+
+    // First time, a scan and a new sidecar
+    t_opened first = open_tape("GAME.TZX");
+    check(first.ok && (first.blocks == 3) && (first.duration > 0), "first open indexes the tape");
+    check(saved_duration("GAME.TZX.idx") == (int64_t)first.duration, "first open writes GAME.TZX.idx");
+
+    // Then from the sidecar, just the same
+    mark("GAME.TZX.idx", 0, 0);
+    t_opened again = open_marked("GAME.TZX", "GAME.TZX.idx", true, "unchanged tape");
+    bool same = (again.blocks == first.blocks);
+    for (uint16_t i = 0; same && (i < first.blocks); i++)
+        same = (again.index[i].addr == first.index[i].addr) && (again.index[i].id == first.index[i].id);
+    check(same, "the sidecar has the same index as the scan");
+
+    // A TAP of the same name has its own, and leaves the TZX's alone
+    write_tape("GAME.TAP", false, sizes, 2, 0);
+    t_opened tap = open_tape("GAME.TAP");
+    check(tap.ok && (tap.blocks == 2) && (saved_duration("GAME.TAP.idx") == (int64_t)tap.duration),
+          "a TAP of the same name gets GAME.TAP.idx");
+    open_marked("GAME.TZX", "GAME.TZX.idx", true, "TZX after the TAP");
+    mark("GAME.TAP.idx", 0, 0);
+    open_marked("GAME.TAP", "GAME.TAP.idx", true, "TAP after the TZX");
+
+    // Another date
+    mark("GAME.TZX.idx", 0, 0);
+    struct timeval tv[2] = {{TAPE_TIME + 60, 0}, {TAPE_TIME + 60, 0}};
+    utimes("GAME.TZX", tv);
+    open_marked("GAME.TZX", "GAME.TZX.idx", false, "tape with a new date");
+
+    // The same size and date, but different data in the first TAPE_CHUNK bytes
+    write_tape("GAME.TZX", true, sizes, 3, 0);
+    open_tape("GAME.TZX");
+    mark("GAME.TZX.idx", 0, 0);
+    write_tape("GAME.TZX", true, sizes, 3, 1);
+    open_marked("GAME.TZX", "GAME.TZX.idx", false, "tape with new data at the start");
+
+    // Another size, with another block
+    mark("GAME.TZX.idx", 0, 0);
+    write_tape("GAME.TZX", true, sizes, 4, 1);
+    t_opened grown = open_marked("GAME.TZX", "GAME.TZX.idx", false, "tape with another block");
+    check(grown.blocks == 4, "the rescan finds the new block");
+
+    // A sidecar of another version, and one cut short
+    mark("GAME.TZX.idx", 4, IDX_VERSION + 1);
+    open_marked("GAME.TZX", "GAME.TZX.idx", false, "sidecar of another version");
+    mark("GAME.TZX.idx", 0, 0);
+    check(truncate("GAME.TZX.idx", IDX_HDR_SIZE + 2) == 0, "sidecar cut short");
+    open_marked("GAME.TZX", "GAME.TZX.idx", false, "sidecar cut short");
+
+    // Tidy up
+    remove("GAME.TZX");
+    remove("GAME.TZX.idx");
+    remove("GAME.TAP");
+    remove("GAME.TAP.idx");
+    if ((chdir("/") != 0) || (rmdir(dir) != 0))
+        printf("Cannot remove %s\n", dir);
+
+    printf("%d failed\n", failed);
+    return failed ? 1 : 0;
+}
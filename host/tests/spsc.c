@@ -0,0 +1,116 @@
+/*
+ * test-spsc - the SPSC queue between two threads
+ *
+ * A producer thread writes sequence numbers into a small ring, a batch of
+ * whatever size it picks at a time, and a consumer thread reads them back
+ * in batches of its own, as the decoder and the DMA do with the pulse
+ * ring. Every number has to come out once, in order, and neither side may
+ * ever see more queued or free than the ring holds. The indexes start just
+ * short of wrapping, so they wrap part way through.
+ */
+#include <stdio.h>   // printf
+#include <stdlib.h>  // exit
+#include <pthread.h> // pthread_create
+#include <sched.h>   // sched_yield
+#include "spsc.h"
+
+// Small, so the ring is full or empty much of the time
+#define RING_SIZE 64
+#define RING_MASK (RING_SIZE - 1)
+
+// Entries sent in all
+#define ENTRIES 20000000
+
+// Where the indexes start, so they wrap after this many
+#define START (UINT32_MAX - 1000)
+
+static t_spsc q;
+static uint32_t ring[RING_SIZE];
+
+// Batch sizes of 1 to RING_SIZE, different on each side
+static uint32_t next_batch(uint32_t *seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return ((*seed >> 16) & RING_MASK) + 1;
+}
+
+// The other side would wait for ever, so a broken index ends the test there and then
+static void broken(const char *what, uint32_t count)
+{
+    printf("%s %u, in a ring of %u\n", what, count, RING_SIZE);
+    exit(1);
+}
+
+static void *producer(void *arg)
+{
+    (void)arg;
+    uint32_t seed = 1, seq = 0;
+    while (seq < ENTRIES)
+    {
+        uint32_t space = spsc_space(&q, RING_SIZE);
+        if (space > RING_SIZE)
+            broken("The producer saw space for", space);
+        // Let the other side run, on a machine with one core
+        if (space == 0)
+            sched_yield();
+        uint32_t n = next_batch(&seed);
+        if (n > space)
+            n = space;
+        if (n > ENTRIES - seq)
+            n = ENTRIES - seq;
+
+        uint32_t at = spsc_head(&q);
+        for (uint32_t i = 0; i < n; i++)
+            ring[(at + i) & RING_MASK] = seq++;
+        spsc_publish(&q, n);
+    }
+    return NULL;
+}
+
+static void *consumer(void *arg)
+{
+    uint32_t seed = 2, seq = 0, *bad = arg;
+    while (seq < ENTRIES)
+    {
+        uint32_t avail = spsc_avail(&q);
+        if (avail > RING_SIZE)
+            broken("The consumer saw queued", avail);
+        if (avail == 0)
+            sched_yield();
+        uint32_t n = next_batch(&seed);
+        if (n > avail)
+            n = avail;
+
+        uint32_t at = spsc_tail(&q);
+        for (uint32_t i = 0; i < n; i++, seq++)
+        {
+            if (ring[(at + i) & RING_MASK] != seq)
+            {
+                if ((*bad)++ < 10)
+                    printf("Entry %u came out as %u\n", seq, ring[(at + i) & RING_MASK]);
+            }
+        }
+        spsc_release(&q, n);
+    }
+    return NULL;
+}
+
+int main(void)
+{
+    uint32_t bad = 0;
+    pthread_t p, c;
+
+    spsc_init(&q);
+    atomic_store_explicit(&q.head, START, memory_order_relaxed);
+    atomic_store_explicit(&q.tail, START, memory_order_relaxed);
+
+    pthread_create(&c, NULL, consumer, &bad);
+    pthread_create(&p, NULL, producer, NULL);
+    pthread_join(p, NULL);
+    pthread_join(c, NULL);
+
+    if (spsc_count(&q) != 0)
+        printf("%u entries left queued\n", spsc_count(&q));
+    printf("%u entries, %u out of order\n", ENTRIES, bad);
+    return (bad || spsc_count(&q)) ? 1 : 0;
+}
@@ -0,0 +1,297 @@
+/*
+ * tappioca-pzx - write a TZX or TAP out as a PZX
+ *
+ * The tape is played through the decoders, and each block is written as
+ * the PZX blocks that play the same words: standard, turbo and pure data
+ * as a PULS of the pilot and sync and a DATA of the bytes, and pauses as
+ * PAUS. Tones, pulse sequences, Direct Recording, CSW and Generalised
+ * blocks are written as the pulses they decode to. Jumps, loops and calls
+ * are played out, so a block in a loop is written each time it plays, and
+ * a tape that goes round forever is written up to where it goes round.
+ *
+ * A render of the PZX is then the same as a render of the tape it came
+ * from, word for word, which is how the PZX decoders are checked. Pulses
+ * are written in t-states, so that only holds without PULSE_HIRES.
+ */
+#include <stdio.h>  // printf
+#include <stdlib.h> // realloc, free
+#include "ff.h"
+#include "player.h"
+
+typedef struct t_buf
+{
+    uint8_t *data;
+    uint32_t len;
+    uint32_t size;
+} t_buf;
+
+static void put(t_buf *b, uint32_t value, int width)
+{
+    if (b->len + width > b->size)
+    {
+        b->size = 2 * b->size + width;
+        b->data = realloc(b->data, b->size);
+    }
+    for (int x = 0; x < width; x++)
+        b->data[b->len++] = (value >> (x * 8)) & 0xFF;
+}
+
+// A tag, the length, then the body - which is emptied for the next block
+static void put_block(t_buf *out, const char *tag, t_buf *body)
+{
+    for (int x = 0; x < 4; x++)
+        put(out, tag[x], 1);
+    put(out, body->len, 4);
+    for (uint32_t i = 0; i < body->len; i++)
+        put(out, body->data[i], 1);
+    body->len = 0;
+}
+
+/*
+ * PULS: runs of pulses of the same length, written as they are added.
+ * A run of more than one, or a pulse too long for 15 bits, has a count
+ * first - and a long one takes 31 bits.
+ */
+typedef struct t_pulses
+{
+    t_buf body;
+    uint32_t duration;
+    uint32_t count;
+} t_pulses;
+
+static void flush_pulses(t_pulses *p)
+{
+    while (p->count > 0)
+    {
+        uint32_t n = (p->count > 0x7FFF) ? 0x7FFF : p->count;
+        if ((n > 1) || (p->duration >= 0x8000))
+            put(&p->body, 0x8000 | n, 2);
+        if (p->duration >= 0x8000)
+        {
+            put(&p->body, 0x8000 | (p->duration >> 16), 2);
+            put(&p->body, p->duration & 0xFFFF, 2);
+        }
+        else
+            put(&p->body, p->duration, 2);
+        p->count -= n;
+    }
+}
+
+static void add_pulses(t_pulses *p, uint32_t duration, uint32_t count)
+{
+    if ((p->count > 0) && (duration != p->duration))
+        flush_pulses(p);
+    p->duration = duration;
+    p->count += count;
+}
+
+static void end_pulses(t_pulses *p, t_buf *out)
+{
+    flush_pulses(p);
+    if (p->body.len > 0)
+        put_block(out, "PULS", &p->body);
+}
+
+// DATA of no bits just takes the output to a level - the PZX way to send a zero word
+static void put_data(t_buf *out, t_buf *body, const t_block_desc *blk, uint32_t bits, uint8_t level,
+                     t_tape *t, uint32_t addr)
+{
+    put(body, bits | ((uint32_t)level << 31), 4);
+    put(body, 0, 2); // No tail
+    put(body, 2, 1); // Two pulses in a 0 and a 1
+    put(body, 2, 1);
+    put(body, blk->bit_0, 2);
+    put(body, blk->bit_0, 2);
+    put(body, blk->bit_1, 2);
+    put(body, blk->bit_1, 2);
+    for (uint32_t i = 0; i < (bits + 7) / 8; i++)
+        put(body, tape_byte(t, addr + i), 1);
+    put_block(out, "DATA", body);
+}
+
+static void put_level(t_buf *out, t_buf *body, uint8_t level)
+{
+    t_block_desc none = {0};
+    put_data(out, body, &none, 0, level, NULL, 0);
+}
+
+static void put_pause(t_buf *out, t_buf *body, uint8_t level, uint32_t duration)
+{
+    put(body, duration | ((uint32_t)level << 31), 4);
+    put_block(out, "PAUS", body);
+}
+
+/*
+ * Decode a block the way the player would, into words, leaving the level
+ * the output ends on in the sink
+ */
+static pulse_t *words;
+static uint32_t words_len, words_size;
+
+static void decode(t_block_desc *blk, t_tape *t, uint32_t addr, t_pulse_sink *s)
+{
+    static t_decoder dec;
+
+    words_len = 0;
+    block_begin(&dec, blk, t, addr);
+    bool done;
+    do
+    {
+        done = block_fill(&dec, s);
+        if (words_len + s->pos > words_size)
+        {
+            words_size = 2 * words_size + s->pos;
+            words = realloc(words, words_size * sizeof(pulse_t));
+        }
+        for (uint32_t i = 0; i < s->pos; i++)
+            words[words_len++] = s->buf[i];
+        s->pos = 0;
+    } while (!done);
+}
+
+// Pulse length in t-states of a word - a zero word is a pulse of no length, which just flips the level
+static uint32_t word_tstates(pulse_t word)
+{
+    return word ? ((uint32_t)word + ASM_OFFSET) / PULSE_SCALE : 0;
+}
+
+// Write a block as its PZX blocks, the sink being the level the TZX has the output at
+static void convert(t_buf *out, t_tape *t, const t_block_entry *e, t_pulse_sink *s)
+{
+    static t_pulses p;
+    static t_buf body;
+    uint8_t hdr[TZX_HDR_MAX];
+    t_block_desc blk;
+
+    tape_read(t, e->addr, hdr, TZX_HDR_MAX);
+    uint8_t data = block_parse(e->id, hdr, &blk);
+    if (!data)
+    {
+        // The only other block that plays anything - a flip, if the level is not the one asked for
+        if ((e->id == BLK_SIG_LEVEL) && (s->level == hdr[5]))
+        {
+            s->level ^= 1;
+            put_level(out, &body, s->level);
+        }
+        return;
+    }
+
+    uint32_t pause = blk.pause;
+    uint8_t level = s->level;
+    blk.pause = 0;
+    decode(&blk, t, e->addr + data, s);
+
+    switch (blk.type)
+    {
+    case BLK_STD:
+    case BLK_TURBO:
+        // Pulses start low, so one of no length first to start high
+        if (level == 1)
+            add_pulses(&p, 0, 1);
+        add_pulses(&p, blk.p_pulse, blk.p_total);
+        add_pulses(&p, blk.sync_a, 1);
+        add_pulses(&p, blk.sync_b, 1);
+        end_pulses(&p, out);
+        level ^= blk.p_total & 1;
+        // fall through
+    case BLK_PDATA:
+        if (blk.len > 0)
+            put_data(out, &body, &blk, blk.len * 8 - (8 - blk.used_bits), level, t, e->addr + data);
+        break;
+
+    default:
+    {
+        // Everything else as the pulses it decodes to
+        uint32_t zeros = 0;
+        if (level == 1)
+            add_pulses(&p, 0, 1);
+        for (uint32_t i = 0; i < words_len; i++)
+        {
+            add_pulses(&p, word_tstates(words[i]), 1);
+            zeros = words[i] ? 0 : zeros + 1;
+        }
+        end_pulses(&p, out);
+
+        // A zero word at the end would only go out before the next pulse - send it now
+        if (zeros & 1)
+            put_level(out, &body, s->level);
+        break;
+    }
+    }
+
+    if (pause > 0)
+    {
+        // 1ms at the level the last edge went to, then the rest low
+        blk = (t_block_desc){.type = BLK_PAUSE, .pause = pause};
+        put_pause(out, &body, s->level, FREQ / 1000);
+        if (pause > 1)
+            put_pause(out, &body, 0, (pause - 1) * (FREQ / 1000));
+        decode(&blk, t, 0, s);
+    }
+}
+
+static int usage(void)
+{
+    printf("Usage: tappioca-pzx <tape> <out.pzx>\n");
+    return 2;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 3)
+        return usage();
+
+    static uint8_t window[2][TAPE_CHUNK];
+    static pulse_t chunk[PULSE_CHUNK];
+    t_pulse_sink sink;
+    FIL fh;
+    t_tape tape;
+    t_player player;
+
+    if (f_open(&fh, argv[1], FA_READ) != FR_OK)
+    {
+        printf("Cannot open %s\n", argv[1]);
+        return 1;
+    }
+    tape_open(&tape, tape_read_fatfs, &fh, f_size(&fh), window);
+    if (!player_open(&player, &tape))
+    {
+        printf("%s: not a tape that can be played\n", argv[1]);
+        return 1;
+    }
+    pulse_sink_init(&sink, chunk, PULSE_CHUNK);
+
+    // Version 1.0, with no title
+    t_buf out = {0}, hdr = {0};
+    put(&hdr, 1, 1);
+    put(&hdr, 0, 1);
+    put_block(&out, "PZXT", &hdr);
+
+    if (player_play_once(&player))
+        printf("%s: goes round forever - written up to where it goes round\n", argv[1]);
+    uint32_t written = 0;
+    for (uint16_t b; (b = player_walk(&player)) < player.blocks; written++)
+        convert(&out, &tape, &player.index[b], &sink);
+
+    FILE *fo = fopen(argv[2], "wb");
+    if (fo == NULL)
+    {
+        printf("Cannot create %s\n", argv[2]);
+        return 1;
+    }
+    fwrite(out.data, 1, out.len, fo);
+    if (fclose(fo) != 0)
+    {
+        printf("Cannot write %s\n", argv[2]);
+        remove(argv[2]);
+        return 1;
+    }
+    printf("%s: %u blocks played out, %u bytes\n", argv[2], written, out.len);
+
+    player_close(&player);
+    f_close(&fh);
+    free(out.data);
+    free(hdr.data);
+    free(words);
+    return 0;
+}
@@ -0,0 +1,44 @@
+#include <string.h> // memcpy
+#include "wavout.h"
+
+void wav_init(t_wav *w, uint32_t rate)
+{
+    w->rate = rate;
+    w->cycles = 0;
+    w->samples = 0;
+}
+
+uint64_t wav_word(t_wav *w, pulse_t word)
+{
+    w->cycles += pulse_cycles(word);
+
+    // The first sample that starts at or after the end of the word
+    uint64_t end = (w->cycles * w->rate + (uint64_t)FREQ * PULSE_SCALE - 1) / ((uint64_t)FREQ * PULSE_SCALE);
+    uint64_t n = end - w->samples;
+    w->samples = end;
+    return n;
+}
+
+static void put_uint(uint8_t *p, uint32_t value, int width)
+{
+    for (int x = 0; x < width; x++)
+        p[x] = (value >> (x * 8)) & 0xFF;
+}
+
+void wav_header(const t_wav *w, uint8_t hdr[WAV_HEADER])
+{
+    uint32_t data = w->samples;
+
+    memcpy(hdr, "RIFF", 4);
+    put_uint(hdr + 4, 36 + data, 4);
+    memcpy(hdr + 8, "WAVEfmt ", 8);
+    put_uint(hdr + 16, 16, 4);      // fmt size
+    put_uint(hdr + 20, 1, 2);       // PCM
+    put_uint(hdr + 22, 1, 2);       // Mono
+    put_uint(hdr + 24, w->rate, 4);
+    put_uint(hdr + 28, w->rate, 4); // Bytes per second
+    put_uint(hdr + 32, 1, 2);       // Block align
+    put_uint(hdr + 34, 8, 2);       // Bits per sample
+    memcpy(hdr + 36, "data", 4);
+    put_uint(hdr + 40, data, 4);
+}
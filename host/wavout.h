@@ -0,0 +1,35 @@
+#ifndef WAVOUT_H
+#define WAVOUT_H
+
+#include <stdint.h>
+#include "pulse.h"
+
+/*
+ * Pulse words as a WAV, for the host tools
+ *
+ * 8-bit mono PCM at any sample rate. Each sample is the level at the moment
+ * it starts, so every sample starting before a word ends belongs to that
+ * word - a word is a run of samples of one value, which can be filled in
+ * one go rather than a sample at a time.
+ */
+#define WAV_HEADER 44
+#define WAV_HIGH 0xC0
+#define WAV_LOW 0x40
+
+typedef struct t_wav
+{
+    uint32_t rate;
+    // Played so far
+    uint64_t cycles;
+    uint64_t samples;
+} t_wav;
+
+void wav_init(t_wav *w, uint32_t rate);
+
+// Samples the word takes, after those so far
+uint64_t wav_word(t_wav *w, pulse_t word);
+
+// The header for the samples so far
+void wav_header(const t_wav *w, uint8_t hdr[WAV_HEADER]);
+
+#endif
@@ -0,0 +1,565 @@
+#include <stdio.h>  // printf
+#include <stdlib.h> // malloc, qsort, bsearch
+#include <string.h> // strcmp, memcpy, memmove
+#include <ctype.h>  // tolower
+#include "library.h"
+
+#ifdef USE_FATFS
+#include "player.h"
+#include "sidecar.h"
+
+typedef char t_lib_path[LIB_PATH];
+
+// A tape as it is listed in its directory
+typedef struct t_lib_file
+{
+    char name[LIB_PATH];
+    FSIZE_t size;
+    WORD fdate;
+    WORD ftime;
+} t_lib_file;
+
+static void put_uint(uint8_t *ptr, uint64_t value, int width)
+{
+    for (int x = 0; x < width; x++)
+        ptr[x] = (value >> (x * 8)) & 0xFF;
+}
+
+// FNV-1a, to notice when a directory's tapes change
+static uint32_t hash_bytes(uint32_t hash, const void *data, uint32_t len)
+{
+    const uint8_t *ptr = data;
+    for (uint32_t i = 0; i < len; i++)
+        hash = (hash ^ ptr[i]) * 16777619;
+
+    return hash;
+}
+
+// dir/name, false if it is too long to keep - path may be another of the same array as dir
+static bool join_path(char path[LIB_PATH], const char *dir, const char *name)
+{
+    size_t dir_len = strlen(dir), name_len = strlen(name);
+    size_t len = dir_len + (dir_len > 0) + name_len;
+    if (len >= LIB_PATH)
+        return false;
+
+    memmove(path, dir, dir_len);
+    if (dir_len > 0)
+        path[dir_len++] = '/';
+    memcpy(path + dir_len, name, name_len + 1);
+    return true;
+}
+
+// Only .tzx, .pzx and .tap, in any case
+static bool is_tape(const char *name)
+{
+    const char *ext = strrchr(name, '.');
+    char low[5] = "";
+
+    if ((ext == NULL) || (strlen(ext) != 4))
+        return false;
+    for (int x = 0; x < 4; x++)
+        low[x] = tolower((unsigned char)ext[x]);
+
+    return !strcmp(low, ".tzx") || !strcmp(low, ".pzx") || !strcmp(low, ".tap");
+}
+
+static int cmp_name(const void *a, const void *b)
+{
+    return strcmp(a, b);
+}
+
+/*
+ * Catalogue records
+ */
+static void pack_entry(const t_lib_entry *e, uint8_t rec[LIB_REC_SIZE])
+{
+    memcpy(rec, e->name, LIB_PATH);
+    put_uint(rec + LIB_PATH, e->size, 4);
+    put_uint(rec + LIB_PATH + 4, e->blocks, 2);
+    put_uint(rec + LIB_PATH + 6, e->duration, 8);
+    memcpy(rec + LIB_PATH + 14, e->title, LIB_TITLE);
+}
+
+static void unpack_entry(uint8_t rec[LIB_REC_SIZE], t_lib_entry *e)
+{
+    memcpy(e->name, rec, LIB_PATH);
+    e->size = parse_uint(rec + LIB_PATH, 4);
+    e->blocks = parse_uint(rec + LIB_PATH + 4, 2);
+    e->duration = parse_uint(rec + LIB_PATH + 6, 4) | (uint64_t)parse_uint(rec + LIB_PATH + 10, 4) << 32;
+    memcpy(e->title, rec + LIB_PATH + 14, LIB_TITLE);
+    e->name[LIB_PATH - 1] = '\0';
+    e->title[LIB_TITLE - 1] = '\0';
+}
+
+static bool read_at(FIL *fh, uint32_t addr, void *dst, UINT len)
+{
+    UINT got;
+    return (f_lseek(fh, addr) == FR_OK) && (f_read(fh, dst, len, &got) == FR_OK) && (got == len);
+}
+
+// Give up on a catalogue part way through loading it
+static bool load_failed(t_library *lib)
+{
+    f_close(&lib->fh);
+    free(lib->dirs);
+    lib->dirs = NULL;
+    return false;
+}
+
+// Open a catalogue and read in its directory table
+static bool load_catalogue(t_library *lib, const char *name)
+{
+    uint8_t hdr[LIB_HDR_SIZE];
+    uint8_t rec[LIB_DIR_SIZE];
+
+    lib->dirs = NULL;
+    lib->dir_count = 0;
+    lib->count = 0;
+    if (f_open(&lib->fh, name, FA_READ) != FR_OK)
+        return false;
+
+    if (!read_at(&lib->fh, 0, hdr, LIB_HDR_SIZE) || memcmp(hdr, LIB_MAGIC, 4) || (hdr[4] != LIB_VERSION))
+        return load_failed(lib);
+    lib->dir_count = parse_uint(hdr + 8, 4);
+    lib->count = parse_uint(hdr + 12, 4);
+    uint32_t at = parse_uint(hdr + 16, 4);
+
+    lib->dirs = malloc(lib->dir_count * sizeof(t_lib_dir) + 1);
+    if ((lib->dirs == NULL) || (f_lseek(&lib->fh, at) != FR_OK))
+        return load_failed(lib);
+
+    for (uint32_t i = 0; i < lib->dir_count; i++)
+    {
+        UINT got;
+        t_lib_dir *d = &lib->dirs[i];
+        if ((f_read(&lib->fh, rec, LIB_DIR_SIZE, &got) != FR_OK) || (got != LIB_DIR_SIZE))
+            return load_failed(lib);
+        memcpy(d->path, rec, LIB_PATH);
+        d->path[LIB_PATH - 1] = '\0';
+        d->hash = parse_uint(rec + LIB_PATH, 4);
+        d->first = parse_uint(rec + LIB_PATH + 4, 4);
+        d->count = parse_uint(rec + LIB_PATH + 8, 4);
+    }
+    return true;
+}
+
+/*
+ * Scanning the card
+ */
+
+// Every directory on the card, sorted
+static t_lib_path *list_dirs(uint32_t *count)
+{
+    uint32_t size = 16;
+    t_lib_path *dirs = malloc(size * sizeof(t_lib_path));
+    DIR dp;
+    FILINFO fno;
+
+    if (dirs == NULL)
+        return NULL;
+    dirs[0][0] = '\0';
+    *count = 1;
+
+    // Each new directory is added to the end, and listed in turn
+    for (uint32_t i = 0; i < *count; i++)
+    {
+        if (f_opendir(&dp, dirs[i][0] ? dirs[i] : "/") != FR_OK)
+            continue;
+
+        while ((f_readdir(&dp, &fno) == FR_OK) && fno.fname[0])
+        {
+            if (!(fno.fattrib & AM_DIR) || (fno.fname[0] == '.'))
+                continue;
+
+            if (*count == size)
+            {
+                t_lib_path *grown = realloc(dirs, size * 2 * sizeof(t_lib_path));
+                if (grown == NULL)
+                    break;
+                dirs = grown;
+                size *= 2;
+            }
+            if (join_path(dirs[*count], dirs[i], fno.fname))
+                (*count)++;
+        }
+        f_closedir(&dp);
+    }
+
+    qsort(dirs, *count, sizeof(t_lib_path), cmp_name);
+    return dirs;
+}
+
+// The tapes in a directory, sorted by name, and a hash of the listing
+static t_lib_file *list_tapes(const char *dir, uint32_t *count, uint32_t *hash)
+{
+    uint32_t size = 16;
+    t_lib_file *files = malloc(size * sizeof(t_lib_file));
+    char path[LIB_PATH];
+    DIR dp;
+    FILINFO fno;
+
+    *count = 0;
+    *hash = 2166136261;
+    if (files == NULL)
+        return NULL;
+
+    if (f_opendir(&dp, dir[0] ? dir : "/") == FR_OK)
+    {
+        while ((f_readdir(&dp, &fno) == FR_OK) && fno.fname[0])
+        {
+            if ((fno.fattrib & AM_DIR) || (fno.fname[0] == '.') || !is_tape(fno.fname))
+                continue;
+            if (!join_path(path, dir, fno.fname))
+                continue;
+
+            if (*count == size)
+            {
+                t_lib_file *grown = realloc(files, size * 2 * sizeof(t_lib_file));
+                if (grown == NULL)
+                    break;
+                files = grown;
+                size *= 2;
+            }
+            t_lib_file *f = &files[(*count)++];
+            memset(f->name, 0, LIB_PATH);
+            strcpy(f->name, fno.fname);
+            f->size = fno.fsize;
+            f->fdate = fno.fdate;
+            f->ftime = fno.ftime;
+        }
+        f_closedir(&dp);
+    }
+
+    // Name first in each, so they sort by name
+    qsort(files, *count, sizeof(t_lib_file), cmp_name);
+    for (uint32_t i = 0; i < *count; i++)
+    {
+        *hash = hash_bytes(*hash, files[i].name, strlen(files[i].name) + 1);
+        *hash = hash_bytes(*hash, &files[i].size, sizeof(files[i].size));
+        *hash = hash_bytes(*hash, &files[i].fdate, sizeof(files[i].fdate));
+        *hash = hash_bytes(*hash, &files[i].ftime, sizeof(files[i].ftime));
+    }
+    return files;
+}
+
+// Title from the archive info, or failing that the first text description
+static void tape_title(t_player *p, char title[LIB_TITLE])
+{
+    uint32_t at = 0;
+    uint8_t len = 0;
+    bool found = false;
+
+    for (uint16_t i = 0; (i < p->blocks) && !found; i++)
+    {
+        uint32_t addr = p->index[i].addr;
+
+        if ((p->index[i].id == BLK_TEXT) && (at == 0))
+        {
+            len = tape_byte(p->tape, addr + 1);
+            at = addr + 2;
+        }
+        else if (p->index[i].id == BLK_INFO)
+        {
+            // Strings of type, length, text - type 0 is the title
+            uint32_t str = addr + 4;
+            for (uint8_t n = tape_byte(p->tape, addr + 3); (n > 0) && !found; n--)
+            {
+                found = (tape_byte(p->tape, str) == 0x00);
+                if (found)
+                {
+                    len = tape_byte(p->tape, str + 1);
+                    at = str + 2;
+                }
+                str += 2 + tape_byte(p->tape, str + 1);
+            }
+        }
+        else if (p->index[i].id == BLK_PZX_HEADER)
+        {
+            // The version, then NUL-terminated strings - the first is the title
+            uint32_t end = addr + PZX_HDR_SIZE + tape_uint(p->tape, addr + 4, 4);
+            at = addr + PZX_HDR_SIZE + 2;
+            len = 0;
+            while ((at + len < end) && (len < LIB_TITLE - 1) && (tape_byte(p->tape, at + len) != 0))
+                len++;
+            found = true;
+        }
+    }
+
+    if (len > LIB_TITLE - 1)
+        len = LIB_TITLE - 1;
+    memset(title, 0, LIB_TITLE);
+    tape_read(p->tape, at, (uint8_t *)title, len);
+
+    // Line breaks and the like become spaces
+    for (uint8_t x = 0; x < len; x++)
+    {
+        if ((uint8_t)title[x] < 0x20)
+            title[x] = ' ';
+    }
+}
+
+// Index a tape, through its sidecar, for its catalogue entry
+static void scan_tape(t_library *lib, const char *dir, const t_lib_file *f,
+                      uint8_t (*window)[TAPE_CHUNK], t_pulse_sink *s, t_lib_entry *e)
+{
+    char path[LIB_PATH];
+    FIL fh;
+    t_tape tape;
+    t_player player;
+
+    memset(e, 0, sizeof(*e));
+    memcpy(e->name, f->name, LIB_PATH);
+    e->size = f->size;
+
+    join_path(path, dir, f->name);
+    if (f_open(&fh, path, FA_READ) != FR_OK)
+        return;
+
+    tape_open(&tape, tape_read_fatfs, &fh, f_size(&fh), window);
+    if (sidecar_open(&player, &tape, s, path))
+    {
+        e->blocks = player.blocks;
+        e->duration = player.duration;
+        tape_title(&player, e->title);
+        player_close(&player);
+    }
+    f_close(&fh);
+    lib->scanned++;
+}
+
+// Copy a run of tape records from one catalogue to another
+static bool copy_entries(FIL *from, uint32_t first, uint32_t count, FIL *to)
+{
+    uint8_t rec[LIB_REC_SIZE];
+    UINT got;
+
+    if (f_lseek(from, LIB_HDR_SIZE + first * LIB_REC_SIZE) != FR_OK)
+        return false;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if ((f_read(from, rec, LIB_REC_SIZE, &got) != FR_OK) || (got != LIB_REC_SIZE))
+            return false;
+        if ((f_write(to, rec, LIB_REC_SIZE, &got) != FR_OK) || (got != LIB_REC_SIZE))
+            return false;
+    }
+    return true;
+}
+
+static int cmp_dir(const void *key, const void *dir)
+{
+    return strcmp(key, ((const t_lib_dir *)dir)->path);
+}
+
+static t_lib_dir *find_dir(t_library *lib, const char *path)
+{
+    if (lib->dirs == NULL)
+        return NULL;
+
+    return bsearch(path, lib->dirs, lib->dir_count, sizeof(t_lib_dir), cmp_dir);
+}
+
+// Write a new catalogue, reusing the old one's records where it can
+static bool write_catalogue(t_library *old, t_lib_dir *dirs, uint32_t dir_count,
+                            uint8_t (*window)[TAPE_CHUNK], t_pulse_sink *s)
+{
+    FIL fh;
+    UINT put;
+    uint8_t hdr[LIB_HDR_SIZE] = LIB_MAGIC;
+    uint8_t rec[LIB_REC_SIZE];
+    uint32_t count = 0;
+    bool ok = true;
+
+    if (f_open(&fh, LIB_TEMP, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK)
+    {
+        printf("Cannot write %s\n", LIB_TEMP);
+        return false;
+    }
+    f_write(&fh, hdr, LIB_HDR_SIZE, &put);
+
+    for (uint32_t i = 0; ok && (i < dir_count); i++)
+    {
+        t_lib_dir *d = &dirs[i];
+        t_lib_dir *was = find_dir(old, d->path);
+        d->first = count;
+
+        if ((was != NULL) && (was->hash == d->hash))
+        {
+            ok = copy_entries(&old->fh, was->first, was->count, &fh);
+            d->count = was->count;
+        }
+        else
+        {
+            // Changed - index each of its tapes again
+            uint32_t hash;
+            t_lib_file *files = list_tapes(d->path, &d->count, &hash);
+            for (uint32_t x = 0; x < d->count; x++)
+            {
+                t_lib_entry e;
+                scan_tape(old, d->path, &files[x], window, s, &e);
+                pack_entry(&e, rec);
+                ok &= (f_write(&fh, rec, LIB_REC_SIZE, &put) == FR_OK) && (put == LIB_REC_SIZE);
+            }
+            d->hash = hash;
+            free(files);
+        }
+        count += d->count;
+    }
+
+    // Directory table on the end, then the header can be filled in
+    uint32_t at = f_tell(&fh);
+    for (uint32_t i = 0; ok && (i < dir_count); i++)
+    {
+        uint8_t drec[LIB_DIR_SIZE] = {0};
+        memcpy(drec, dirs[i].path, LIB_PATH);
+        put_uint(drec + LIB_PATH, dirs[i].hash, 4);
+        put_uint(drec + LIB_PATH + 4, dirs[i].first, 4);
+        put_uint(drec + LIB_PATH + 8, dirs[i].count, 4);
+        ok = (f_write(&fh, drec, LIB_DIR_SIZE, &put) == FR_OK) && (put == LIB_DIR_SIZE);
+    }
+
+    hdr[4] = LIB_VERSION;
+    put_uint(hdr + 8, dir_count, 4);
+    put_uint(hdr + 12, count, 4);
+    put_uint(hdr + 16, at, 4);
+    ok = ok && (f_lseek(&fh, 0) == FR_OK) && (f_write(&fh, hdr, LIB_HDR_SIZE, &put) == FR_OK);
+    f_close(&fh);
+
+    if (!ok)
+        f_unlink(LIB_TEMP);
+    return ok;
+}
+
+bool library_open(t_library *lib, uint8_t (*window)[TAPE_CHUNK], t_pulse_sink *s)
+{
+    uint32_t dir_count;
+    bool same;
+
+    // What the catalogue says was there last time, if there is one
+    load_catalogue(lib, LIB_FILE);
+    lib->scanned = 0;
+
+    // What is there now - directory listings only, no tapes opened
+    t_lib_path *paths = list_dirs(&dir_count);
+    if (paths == NULL)
+        return false;
+
+    t_lib_dir *dirs = calloc(dir_count, sizeof(t_lib_dir));
+    if (dirs == NULL)
+    {
+        free(paths);
+        return false;
+    }
+
+    same = (lib->dirs != NULL) && (dir_count == lib->dir_count);
+    for (uint32_t i = 0; i < dir_count; i++)
+    {
+        memcpy(dirs[i].path, paths[i], LIB_PATH);
+        free(list_tapes(dirs[i].path, &dirs[i].count, &dirs[i].hash));
+
+        t_lib_dir *was = find_dir(lib, dirs[i].path);
+        same &= (was != NULL) && (was->hash == dirs[i].hash);
+    }
+    free(paths);
+
+    if (same)
+    {
+        free(dirs);
+        return true;
+    }
+
+    // Something has changed, so write a new one and swap it in
+    printf("Updating %s...\n", LIB_FILE);
+    bool ok = write_catalogue(lib, dirs, dir_count, window, s);
+    free(dirs);
+    uint32_t scanned = lib->scanned;
+    library_close(lib);
+    if (!ok)
+        return false;
+
+    f_unlink(LIB_FILE);
+    if ((f_rename(LIB_TEMP, LIB_FILE) != FR_OK) || !load_catalogue(lib, LIB_FILE))
+        return false;
+
+    lib->scanned = scanned;
+    return true;
+}
+
+bool library_get(t_library *lib, uint32_t n, t_lib_entry *e, char path[LIB_PATH])
+{
+    uint8_t rec[LIB_REC_SIZE];
+
+    if (n >= lib->count)
+        return false;
+    if (!read_at(&lib->fh, LIB_HDR_SIZE + n * LIB_REC_SIZE, rec, LIB_REC_SIZE))
+        return false;
+    unpack_entry(rec, e);
+
+    // Directory holding it - their runs of tapes are in order
+    uint32_t lo = 0, hi = lib->dir_count;
+    while (lo < hi)
+    {
+        uint32_t mid = (lo + hi) / 2;
+        t_lib_dir *d = &lib->dirs[mid];
+        if (n < d->first)
+            hi = mid;
+        else if (n >= d->first + d->count)
+            lo = mid + 1;
+        else
+            return join_path(path, d->path, e->name);
+    }
+    return false;
+}
+
+int32_t library_find(t_library *lib, const char *path)
+{
+    char dir[LIB_PATH];
+    char name[LIB_PATH];
+
+    // Split off the directory, leading slash or not
+    if (path[0] == '/')
+        path++;
+    const char *slash = strrchr(path, '/');
+    uint32_t dir_len = slash ? slash - path : 0;
+    const char *file = slash ? slash + 1 : path;
+
+    if ((dir_len >= LIB_PATH) || (strlen(file) >= LIB_PATH))
+        return -1;
+    memcpy(dir, path, dir_len);
+    dir[dir_len] = '\0';
+    strcpy(name, file);
+
+    t_lib_dir *d = find_dir(lib, dir);
+    if (d == NULL)
+        return -1;
+
+    // Tapes are in name order within the directory
+    uint32_t lo = d->first, hi = d->first + d->count;
+    while (lo < hi)
+    {
+        uint32_t mid = (lo + hi) / 2;
+        char probe[LIB_PATH];
+        if (!read_at(&lib->fh, LIB_HDR_SIZE + mid * LIB_REC_SIZE, probe, LIB_PATH))
+            return -1;
+        probe[LIB_PATH - 1] = '\0';
+
+        int cmp = strcmp(name, probe);
+        if (cmp == 0)
+            return mid;
+        if (cmp < 0)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return -1;
+}
+
+void library_close(t_library *lib)
+{
+    if (lib->dirs != NULL)
+        f_close(&lib->fh);
+    free(lib->dirs);
+    lib->dirs = NULL;
+}
+#endif
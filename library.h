@@ -0,0 +1,97 @@
+#ifndef LIBRARY_H
+#define LIBRARY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "pulse.h"
+#include "tapeio.h"
+
+/*
+ * Tape library
+ *
+ * A catalogue of every TZX / PZX / TAP on the SD card, kept on the card in
+ * LIB_FILE, so a tape can be picked by number or name without reflashing.
+ * Tapes are sorted by directory, then by name, and each entry holds what a
+ * menu needs: size, blocks, running time and the title from the tape.
+ *
+ * The catalogue is brought up to date on each boot. FAT does not change a
+ * directory's date when its files change, so every directory is listed
+ * (which only reads the directory itself) and a hash of its tapes' names,
+ * sizes and dates is compared with the one in the catalogue. Only tapes in
+ * directories that differ are opened and indexed again - those go through
+ * their sidecar (see sidecar.h), so they are quick too unless they changed.
+ *
+ * Layout, all little-endian:
+ *  0  "TPCT"
+ *  4  version
+ *  8  directories
+ *  12 tapes
+ *  16 where the directory table starts
+ *  20 tapes, LIB_REC_SIZE each: name, size (4), blocks (2),
+ *     running time in t-states (8), title
+ *  .. directories, LIB_DIR_SIZE each: path, hash (4), first tape (4),
+ *     tapes (4)
+ */
+#define LIB_FILE "TAPPIOCA.CAT"
+#define LIB_TEMP "TAPPIOCA.TMP"
+#define LIB_MAGIC "TPCT"
+#define LIB_VERSION 1
+
+// Longest path and title kept, with the terminator - longer paths are left out
+#define LIB_PATH 64
+#define LIB_TITLE 48
+
+#define LIB_HDR_SIZE 20
+#define LIB_REC_SIZE (LIB_PATH + 4 + 2 + 8 + LIB_TITLE)
+#define LIB_DIR_SIZE (LIB_PATH + 4 + 4 + 4)
+
+typedef struct t_lib_entry
+{
+    char name[LIB_PATH]; // Within its directory
+    uint32_t size;
+    uint16_t blocks;
+    uint64_t duration; // t-states, 0 if not known
+    char title[LIB_TITLE];
+} t_lib_entry;
+
+typedef struct t_lib_dir
+{
+    char path[LIB_PATH]; // "" for the root
+    uint32_t hash;
+    uint32_t first;
+    uint32_t count;
+} t_lib_dir;
+
+#ifdef USE_FATFS
+#include "ff.h"
+
+typedef struct t_library
+{
+    FIL fh;
+
+    // Directory table, kept in memory - the tapes are read as they are needed
+    t_lib_dir *dirs;
+    uint32_t dir_count;
+    uint32_t count;
+
+    // Tapes opened while updating
+    uint32_t scanned;
+} t_library;
+
+/*
+ * Bring the catalogue up to date with the card and open it. Tapes that
+ * need indexing are read through the window, and the (empty) sink is used
+ * to work out their running times.
+ */
+bool library_open(t_library *lib, uint8_t (*window)[TAPE_CHUNK], t_pulse_sink *s);
+
+// Tape n, and its full path - false if there is no such tape
+bool library_get(t_library *lib, uint32_t n, t_lib_entry *e, char path[LIB_PATH]);
+
+// Number of the tape at path, -1 if it is not in the catalogue
+int32_t library_find(t_library *lib, const char *path);
+
+void library_close(t_library *lib);
+#endif
+
+#endif
@@ -0,0 +1,86 @@
+#include <string.h> // memset
+#include "outputs.h"
+
+void output_init(t_output *o, const t_out_queue *q)
+{
+    memset(o, 0, sizeof(*o));
+    o->queue = *q;
+    pulse_sink_init(&o->sink, o->chunk, PULSE_CHUNK);
+    o->lo_water = UINT32_MAX;
+}
+
+void output_rewind(t_output *o)
+{
+    player_rewind(&o->player);
+    if (o->cache)
+        flashcache_rewind(o->cache);
+
+    o->sink.pos = 0;
+    o->done = false;
+    o->lo_water = UINT32_MAX;
+    o->hi_water = 0;
+    o->chunks = 0;
+}
+
+int outputs_service(t_output *outs, uint8_t n)
+{
+    int pick = -1;
+    uint32_t least = UINT32_MAX;
+
+    for (uint8_t i = 0; i < n; i++)
+    {
+        t_out_queue *q = &outs[i].queue;
+        if (outs[i].done || (q->space(q->ctx) < PULSE_CHUNK))
+            continue;
+
+        uint32_t level = q->level(q->ctx);
+        if (level < least)
+        {
+            least = level;
+            pick = i;
+        }
+    }
+    if (pick < 0)
+        return -1;
+
+    t_output *o = &outs[pick];
+
+    // How close it came to running dry, once it has started
+    if (o->chunks > 0)
+    {
+        if (least < o->lo_water)
+            o->lo_water = least;
+        if (o->player.telem)
+            telem_queued(o->player.telem, least);
+    }
+
+    // A seek can leave the first words in the sink, so there is never more than a chunk
+    o->done = o->cache ? flashcache_fill(o->cache, &o->sink) : player_fill(&o->player, &o->sink);
+    o->queue.write(o->queue.ctx, o->sink.buf, o->sink.pos);
+    o->sink.pos = 0;
+    o->chunks++;
+
+    uint32_t level = o->queue.level(o->queue.ctx);
+    if (level > o->hi_water)
+        o->hi_water = level;
+    return pick;
+}
+
+void outputs_prefetch(t_output *outs, uint8_t n)
+{
+    for (uint8_t i = 0; i < n; i++)
+    {
+        if (!outs[i].done && !outs[i].cache)
+            player_prefetch(&outs[i].player);
+    }
+}
+
+bool outputs_done(const t_output *outs, uint8_t n)
+{
+    for (uint8_t i = 0; i < n; i++)
+    {
+        if (!outs[i].done)
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,73 @@
+#ifndef OUTPUTS_H
+#define OUTPUTS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "tapeio.h"
+#include "player.h"
+#include "flashcache.h"
+
+/*
+ * Several outputs played from one core
+ *
+ * Each output drives a Spectrum of its own: it has its own tape, a player
+ * with its own place on the tape and output level (kept in its sink), and
+ * a queue of pulse words for its own state machine. Nothing is shared, so
+ * the outputs can play different tapes, or the same one out of step.
+ *
+ * outputs_service() decodes one chunk at a time, for whichever output has
+ * the fewest words queued of those with room for a whole chunk - the one
+ * nearest to running dry is always fed first, and decoding never waits on
+ * a full queue while another output could use the time. When none has
+ * room, the tape windows can be topped up instead (outputs_prefetch()).
+ *
+ * The queue is reached through callbacks, so the same scheduler feeds the
+ * DMA rings on the Pico and modelled ones on the host.
+ */
+typedef struct t_out_queue
+{
+    // Words queued and not yet played, and words that can be queued without waiting
+    uint32_t (*level)(void *ctx);
+    uint32_t (*space)(void *ctx);
+    // Queue words - there is always space() for them
+    void (*write)(void *ctx, const pulse_t *words, uint32_t count);
+    void *ctx;
+} t_out_queue;
+
+typedef struct t_output
+{
+    // Opened by the caller, after output_init()
+    t_tape tape;
+    t_player player;
+    // Played from instead of the player, if set
+    t_flashcache *cache;
+
+    t_pulse_sink sink;
+    pulse_t chunk[PULSE_CHUNK];
+    t_out_queue queue;
+
+    // Whole tape queued
+    bool done;
+
+    // Fewest / most words queued when a chunk was handed over, and chunks handed over, since the rewind
+    uint32_t lo_water;
+    uint32_t hi_water;
+    uint32_t chunks;
+} t_output;
+
+// Get an output ready to play into the queue given - its tape and player are opened next
+void output_init(t_output *o, const t_out_queue *q);
+
+// Back to the start of the tape, for another play - the player can then seek
+void output_rewind(t_output *o);
+
+// Decode and queue a chunk for the output that most needs one: its number, -1 if none has room
+int outputs_service(t_output *outs, uint8_t n);
+
+// Read ahead on every tape still playing, while no output has room
+void outputs_prefetch(t_output *outs, uint8_t n);
+
+// True once every output has queued the whole of its tape
+bool outputs_done(const t_output *outs, uint8_t n);
+
+#endif
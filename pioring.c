@@ -0,0 +1,148 @@
+#include <string.h> // memcpy
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+#include "pioring.h"
+
+// Rings serviced by the DMA IRQ handler
+static t_pioring *rings[NUM_PIOS * NUM_PIO_STATE_MACHINES];
+static uint n_rings = 0;
+
+// Hand the next batch to the DMA, if it is idle - consumer core, IRQs off
+static void pioring_kick(t_pioring *r)
+{
+    if ((r->launched > 0) || dma_channel_is_busy(r->dma))
+        return;
+
+    uint32_t n = spsc_avail(&r->q);
+    if (n == 0)
+        return;
+    if (n > PIORING_BATCH)
+        n = PIORING_BATCH;
+
+    // Read address wraps within the ring, so one transfer is enough
+    r->launched = n;
+    dma_channel_set_read_addr(r->dma, &r->buf[spsc_tail(&r->q) & PIORING_MASK], false);
+    dma_channel_set_trans_count(r->dma, n, true);
+}
+
+// Count an underrun if the SM has stalled since the last look - consumer core
+static void pioring_check_stall(t_pioring *r)
+{
+    uint32_t mask = 1u << (PIO_FDEBUG_TXSTALL_LSB + r->sm);
+    if (r->pio->fdebug & mask)
+    {
+        // Write 1 to clear
+        r->pio->fdebug = mask;
+        if (r->counting)
+            r->stalls++;
+    }
+}
+
+static void pioring_irq(void)
+{
+    for (uint i = 0; i < n_rings; i++)
+    {
+        t_pioring *r = rings[i];
+        if (dma_channel_get_irq0_status(r->dma))
+        {
+            dma_channel_acknowledge_irq0(r->dma);
+
+            // Batch has been read - give the slots back to the producer
+            spsc_release(&r->q, r->launched);
+            r->launched = 0;
+
+            // The first batch has gone in, so the tape is playing
+            pioring_check_stall(r);
+            r->counting = true;
+
+            // Low point - only the PIO FIFO is left if this is zero
+            uint32_t level = spsc_avail(&r->q);
+            if (level < r->lo_water)
+                r->lo_water = level;
+
+            pioring_kick(r);
+        }
+    }
+}
+
+void pioring_init(t_pioring *r, PIO pio, uint sm)
+{
+    r->pio = pio;
+    r->sm = sm;
+    r->launched = 0;
+    spsc_init(&r->q);
+    pioring_reset_marks(r);
+
+    // Pulse words out of the ring, into the TX FIFO, at the pace of the SM
+    r->dma = dma_claim_unused_channel(true);
+    dma_channel_config c = dma_channel_get_default_config(r->dma);
+    channel_config_set_transfer_data_size(&c, sizeof(pulse_t) == 4 ? DMA_SIZE_32 : DMA_SIZE_16);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_ring(&c, false, __builtin_ctz(sizeof(r->buf)));
+    channel_config_set_dreq(&c, pio_get_dreq(pio, sm, true));
+    dma_channel_configure(r->dma, &c, &pio->txf[sm], r->buf, 0, false);
+
+    // Completion of each batch starts the next
+    if (n_rings == 0)
+    {
+        irq_add_shared_handler(DMA_IRQ_0, pioring_irq, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+        irq_set_enabled(DMA_IRQ_0, true);
+    }
+    rings[n_rings++] = r;
+    dma_channel_set_irq0_enabled(r->dma, true);
+}
+
+void pioring_write(t_pioring *r, const pulse_t *words, uint32_t count)
+{
+    // Copy in, wrapping around the end of the ring
+    uint32_t at = spsc_head(&r->q) & PIORING_MASK;
+    uint32_t n = PIORING_WORDS - at;
+    if (n > count)
+        n = count;
+    memcpy(&r->buf[at], words, n * sizeof(pulse_t));
+    memcpy(&r->buf[0], words + n, (count - n) * sizeof(pulse_t));
+
+    // Publishing is a release, so the words are in memory before the DMA sees them
+    spsc_publish(&r->q, count);
+
+    uint32_t level = pioring_level(r);
+    if (level > r->hi_water)
+        r->hi_water = level;
+
+    // Wake the consumer core
+    __sev();
+}
+
+bool pioring_drained(t_pioring *r)
+{
+    if ((pioring_level(r) > 0) || !pio_sm_is_tx_fifo_empty(r->pio, r->sm))
+        return false;
+
+    // The SM stalls once the last word is out, which is not an underrun
+    r->counting = false;
+    return true;
+}
+
+void pioring_drain(t_pioring *r)
+{
+    while (!pioring_drained(r))
+        tight_loop_contents();
+}
+
+void pioring_service(t_pioring *r)
+{
+    uint32_t save = save_and_disable_interrupts();
+    pioring_check_stall(r);
+    pioring_kick(r);
+    restore_interrupts(save);
+}
+
+void pioring_reset_marks(t_pioring *r)
+{
+    r->hi_water = 0;
+    r->lo_water = PIORING_WORDS;
+    r->stalls = 0;
+    r->counting = false;
+}
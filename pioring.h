@@ -0,0 +1,94 @@
+#ifndef PIORING_H
+#define PIORING_H
+
+#include "hardware/pio.h"
+#include "pulse.h"
+#include "spsc.h"
+
+/*
+ * DMA-fed pulse FIFO
+ *
+ * Pulse words go into a ring buffer which a DMA channel, paced by the
+ * pulsegen state machine's TX DREQ, copies into the PIO FIFO.
+ *
+ * The ring is a single-producer / single-consumer queue, so the two sides
+ * can run on different cores: the decoders top it up on one, and the DMA
+ * IRQ and pioring_service() hand it to the DMA on the other, in batches of
+ * up to PIORING_BATCH words. Slots are released back to the producer as
+ * each batch completes.
+ *
+ * The consumer also watches the state machine's TXSTALL flag: if it is set,
+ * the SM ran out of words and held the level for longer than it should. It
+ * is a sticky flag, so each time it is found set counts as one underrun,
+ * however many words were late. The SM sits stalled before a tape starts
+ * and after it ends, so underruns are only counted in between - from the
+ * first batch done to pioring_drain(), or pioring_drained() finding it so.
+ */
+
+// 4096 words - a few seconds of typical tape data
+#define PIORING_BITS 12
+#define PIORING_WORDS (1u << PIORING_BITS)
+#define PIORING_MASK (PIORING_WORDS - 1)
+#define PIORING_BATCH (PIORING_WORDS / 4)
+
+typedef struct t_pioring
+{
+    // DMA read address wraps, so the ring is aligned to its own size
+    pulse_t buf[PIORING_WORDS] __attribute__((aligned(PIORING_WORDS * sizeof(pulse_t))));
+
+    PIO pio;
+    uint sm;
+    int dma;
+
+    // Producer: decoders, consumer: DMA
+    t_spsc q;
+    // Words in the transfer in flight (consumer only)
+    volatile uint32_t launched;
+
+    // Most / fewest words queued since the last pioring_reset_marks()
+    uint32_t hi_water;
+    volatile uint32_t lo_water;
+
+    // Times the SM was found stalled on an empty FIFO, while counting
+    volatile uint32_t stalls;
+    volatile bool counting;
+} t_pioring;
+
+// Claim a DMA channel and chain it to the state machine's TX FIFO
+// The DMA IRQ is serviced by the calling core, which is the consumer
+void pioring_init(t_pioring *r, PIO pio, uint sm);
+
+/*
+ * Producer side
+ */
+// Words queued, including any the DMA is part way through
+static inline uint32_t pioring_level(t_pioring *r)
+{
+    return spsc_count(&r->q);
+}
+
+// Words that can be written without waiting
+static inline uint32_t pioring_space(t_pioring *r)
+{
+    return spsc_space(&r->q, PIORING_WORDS);
+}
+
+// Queue words - there must be pioring_space() for them
+void pioring_write(t_pioring *r, const pulse_t *words, uint32_t count);
+
+// Wait until everything queued has gone into the PIO, and stop counting underruns
+void pioring_drain(t_pioring *r);
+
+// The same without waiting: true, and no more underruns counted, if it has all gone
+bool pioring_drained(t_pioring *r);
+
+/*
+ * Consumer side
+ */
+// Start a transfer if the DMA is idle and words are waiting
+void pioring_service(t_pioring *r);
+
+// Clear the water marks and underruns, for another play
+void pioring_reset_marks(t_pioring *r);
+
+#endif
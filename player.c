@@ -0,0 +1,1016 @@
+#include <stdio.h>  // printf
+#include <stdlib.h> // malloc
+#include <string.h> // memmove, memcmp
+#include "player.h"
+
+// TZX files start with "ZXT", PZX files with "PZXT", anything else is treated as a TAP
+static uint8_t tape_format(t_tape *t)
+{
+    uint8_t magic[4];
+    tape_read(t, 0, magic, 4);
+
+    if (!memcmp(magic, "ZXT", 3))
+        return TAPE_TZX;
+    if (!memcmp(magic, "PZXT", 4))
+        return TAPE_PZX;
+    return TAPE_TAP;
+}
+
+static const char *format_names[] = {"TAP", "TZX", "PZX"};
+
+/*
+ * Index the tape: check the block lengths add up to the file, and note
+ * where each block starts, so jumps, loops and sequences can find them.
+ *
+ * This is a single pass over the block headers, so the tape streams past in
+ * chunks. Only the address and ID are kept, the rest of the header is read
+ * again when the block plays - it is in the tape window by then anyway.
+ */
+static bool index_tape(t_player *p)
+{
+    t_tape *t = p->tape;
+    uint8_t hdr[TZX_HDR_MAX];
+    uint32_t size = INDEX_MIN;
+    uint32_t length, addr = 0;
+    uint8_t id = BLK_TAP;
+
+    p->blocks = 0;
+    p->index = malloc(size * sizeof(t_block_entry));
+    if (p->index == NULL)
+        return false;
+
+    p->format = tape_format(t);
+    if (p->format == TAPE_TZX)
+        addr = 10; // Skip TZX header
+
+    while (addr < t->size)
+    {
+        // Fixed part of the block header
+        tape_read(t, addr, hdr, TZX_HDR_MAX);
+        // PZX blocks are sized by their own rule, so a TZX ID that happens to be one of theirs is still unknown
+        if (p->format == TAPE_PZX)
+        {
+            id = pzx_block_id(hdr);
+            length = pzx_block_size(hdr);
+        }
+        else
+        {
+            if (p->format == TAPE_TZX)
+                id = hdr[0];
+            length = block_size(id, hdr);
+        }
+        if (length == 0)
+        {
+            printf("%02x unknown!\n", id);
+            break;
+        }
+
+        // Blocks are numbered in 16 bits, like jumps and sequences
+        if (p->blocks == UINT16_MAX)
+            break;
+
+        // Out of room - double it, so big tapes are not copied every block
+        if (p->blocks == size)
+        {
+            size *= 2;
+            t_block_entry *grown = realloc(p->index, size * sizeof(t_block_entry));
+            if (grown == NULL)
+                break;
+            p->index = grown;
+        }
+
+        // Block checks out, add it
+        p->index[p->blocks].addr = addr;
+        p->index[p->blocks].id = id;
+        p->blocks++;
+        addr += length;
+    }
+
+    if (addr != t->size)
+    {
+        printf("Not a valid file (TZX, PZX or TAP): ends at %u of %u\n", addr, t->size);
+        free(p->index);
+        p->index = NULL;
+        return false;
+    }
+
+    // Give back what was not used
+    if (p->blocks > 0)
+        p->index = realloc(p->index, p->blocks * sizeof(t_block_entry));
+
+    printf("%s: %u blocks, %u bytes\n", format_names[p->format], p->blocks, t->size);
+    return true;
+}
+
+/*
+ * Control flow, as the playlist is compiled - the same as play would follow
+ * it, block by block
+ */
+typedef struct t_flow
+{
+    uint16_t block;
+
+    // Loops being played, innermost last: the LOOP_START block, and how many more times round
+    uint16_t loop_start[LOOP_DEPTH];
+    uint16_t loop_left[LOOP_DEPTH];
+
+    // Sequence being played: the call block, and the next of its entries
+    uint16_t seq_call;
+    uint16_t seq_step;
+
+    uint8_t loops;
+    uint8_t seq_live;
+} t_flow;
+
+// Control flow with nothing played in between this many times is a tape that plays nothing more
+#define FLOW_IDLE_MAX (1 << 17)
+
+typedef struct t_compile
+{
+    t_player *p;
+    uint32_t size;
+
+    // Where play was at the start of each step, to find a tape that goes round forever,
+    // and the runs hashed by it (step + 1, 0 for none) - twice the size, a power of 2
+    t_flow *seen;
+    uint16_t *hash;
+
+    // The run of blocks being added to
+    uint16_t first, count;
+    t_flow at;
+
+    // Each loop being played through: where play was, and the step it was up to, at the start of this time round
+    t_flow loop_flow[LOOP_DEPTH];
+    uint16_t loop_step[LOOP_DEPTH];
+} t_compile;
+
+// FNV-1a of where play is
+static uint32_t flow_hash(const t_flow *f)
+{
+    const uint8_t *b = (const uint8_t *)f;
+    uint32_t h = 2166136261u;
+    for (uint32_t i = 0; i < sizeof(*f); i++)
+        h = (h ^ b[i]) * 16777619u;
+    return h;
+}
+
+// Note a run by where play was at its start
+static void hash_add(t_compile *c, uint16_t step)
+{
+    uint32_t mask = 2 * c->size - 1;
+    uint32_t x = flow_hash(&c->seen[step]) & mask;
+    while (c->hash[x])
+        x = (x + 1) & mask;
+    c->hash[x] = step + 1;
+}
+
+// The run that started where play is now, -1 if none did
+static int32_t hash_find(t_compile *c, const t_flow *f)
+{
+    uint32_t mask = 2 * c->size - 1;
+    for (uint32_t x = flow_hash(f) & mask; c->hash[x]; x = (x + 1) & mask)
+    {
+        uint16_t step = c->hash[x] - 1;
+        if (memcmp(&c->seen[step], f, sizeof(*f)) == 0)
+            return step;
+    }
+    return -1;
+}
+
+// Add a step to the playlist, false if there is no room
+static bool add_step(t_compile *c, uint16_t first, uint16_t count, uint16_t repeat, const t_flow *at)
+{
+    t_player *p = c->p;
+
+    if (p->steps == PLAYLIST_MAX)
+        return false;
+
+    // Out of room - double it, as for the index
+    if (p->steps == c->size)
+    {
+        uint32_t size = c->size * 2;
+        t_play_step *list = realloc(p->list, size * sizeof(t_play_step));
+        t_flow *seen = realloc(c->seen, size * sizeof(t_flow));
+        uint16_t *hash = calloc(2 * size, sizeof(uint16_t));
+        if (list != NULL)
+            p->list = list;
+        if (seen != NULL)
+            c->seen = seen;
+        if ((list == NULL) || (seen == NULL) || (hash == NULL))
+        {
+            free(hash);
+            return false;
+        }
+        free(c->hash);
+        c->hash = hash;
+        c->size = size;
+        for (uint16_t x = 0; x < p->steps; x++)
+        {
+            if (p->list[x].count > 0)
+                hash_add(c, x);
+        }
+    }
+
+    p->list[p->steps] = (t_play_step){first, count, repeat};
+    c->seen[p->steps] = *at;
+    if (count > 0)
+        hash_add(c, p->steps);
+    p->steps++;
+    return true;
+}
+
+// The run so far is a step of its own
+static bool end_run(t_compile *c)
+{
+    if (c->count == 0)
+        return true;
+
+    uint16_t count = c->count;
+    c->count = 0;
+    return add_step(c, c->first, count, 1, &c->at);
+}
+
+// A sequence call's entries are offsets from the call, like jumps
+static uint16_t seq_entry(t_player *p, uint16_t call, uint16_t entry)
+{
+    return call + (int16_t)tape_uint(p->tape, p->index[call].addr+3+(2*entry), 2);
+}
+
+// Where a loop with nothing but plain blocks in it ends, or 0 if it does not
+static uint16_t plain_loop_end(t_player *p, uint16_t start)
+{
+    for (uint16_t b = start + 1; b < p->blocks; b++)
+    {
+        switch (p->index[b].id)
+        {
+        case BLK_LOOP_END:
+            return b;
+        case BLK_JUMP:
+        case BLK_LOOP_START:
+        case BLK_SEQ_CALL:
+        case BLK_SEQ_RET:
+            return 0;
+        default:
+            break;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Follow the control flow through the tape, as play would, and note the
+ * blocks that play as the steps of the playlist. The flow only depends on
+ * the control blocks, never on what the data blocks hold, so it can all
+ * be worked out up front
+ */
+static bool compile_playlist(t_player *p)
+{
+    t_compile c;
+    t_flow f;
+    memset(&c, 0, sizeof(c));
+    memset(&f, 0, sizeof(f));
+
+    c.p = p;
+    c.size = PLAYLIST_MIN;
+    p->steps = 0;
+    p->list = malloc(c.size * sizeof(t_play_step));
+    c.seen = malloc(c.size * sizeof(t_flow));
+    c.hash = calloc(2 * c.size, sizeof(uint16_t));
+    bool ok = (p->list != NULL) && (c.seen != NULL) && (c.hash != NULL);
+
+    // After control flow, play may have been here before - if so, it goes round forever
+    bool moved = false;
+    uint32_t idle = 0;
+
+    while (ok && (f.block < p->blocks))
+    {
+        if (moved)
+        {
+            moved = false;
+            if (!(ok = end_run(&c)))
+                break;
+
+            int32_t back = hash_find(&c, &f);
+            if (back >= 0)
+            {
+                ok = add_step(&c, back, 0, 0, &f);
+                break;
+            }
+        }
+        if (idle++ > FLOW_IDLE_MAX)
+            break;
+
+        uint16_t b = f.block;
+        t_block_entry *e = &p->index[b];
+        switch (e->id)
+        {
+        // Jump - Signed short word, relative to this block
+        case BLK_JUMP:
+            f.block = b + (int16_t)tape_uint(p->tape, e->addr+1, 2);
+            moved = true;
+            continue;
+
+        case BLK_LOOP_START:
+        {
+            uint16_t count = tape_uint(p->tape, e->addr+1, 2);
+            if (count == 0)
+                count = 1;
+
+            // Just plain blocks - one step, repeated
+            uint16_t end = plain_loop_end(p, b);
+            if (end > 0)
+            {
+                ok = end_run(&c);
+                if (ok && (end > b + 1))
+                {
+                    ok = add_step(&c, b + 1, end - b - 1, count, &f);
+                    idle = 0;
+                }
+                f.block = end + 1;
+                continue;
+            }
+
+            // Anything else is played through once, starting a step of its own
+            f.block++;
+            if (f.loops < LOOP_DEPTH)
+            {
+                if (!(ok = end_run(&c)))
+                    break;
+                f.loop_start[f.loops] = b;
+                f.loop_left[f.loops] = count - 1;
+                c.loop_step[f.loops] = p->steps;
+                c.loop_flow[f.loops++] = f;
+            }
+            moved = true;
+            continue;
+        }
+
+        case BLK_LOOP_END:
+            if (f.loops == 0)
+                break;
+
+            // Keep going back until counter is run down
+            if (f.loop_left[f.loops - 1] > 0)
+            {
+                if (!(ok = end_run(&c)))
+                    break;
+
+                // Round again from the same place as last time round, but for the count,
+                // plays the same again - so the rest of the times round are a step back
+                uint8_t top = f.loops - 1;
+                t_flow was = c.loop_flow[top];
+                was.loop_left[top] = f.loop_left[top];
+                was.block = b;
+                if (memcmp(&was, &f, sizeof(f)) == 0)
+                {
+                    if (p->steps > c.loop_step[top])
+                        ok = add_step(&c, c.loop_step[top], 0, f.loop_left[top], &f);
+                    f.loops--;
+                    f.loop_start[f.loops] = 0;
+                    f.loop_left[f.loops] = 0;
+                    f.block++;
+                    idle = 0;
+                    moved = true;
+                    continue;
+                }
+
+                // Otherwise round once more, to see if it settles down
+                f.loop_left[top]--;
+                f.block = f.loop_start[top] + 1;
+                c.loop_step[top] = p->steps;
+                c.loop_flow[top] = f;
+            }
+            else
+            {
+                f.loops--;
+                f.loop_start[f.loops] = 0;
+                f.block++;
+            }
+            moved = true;
+            continue;
+
+        // Sequence array - each call plays until a return
+        case BLK_SEQ_CALL:
+            if (tape_uint(p->tape, e->addr+1, 2) == 0)
+                break;
+
+            f.seq_live = 1;
+            f.seq_call = b;
+            f.seq_step = 1;
+            f.block = seq_entry(p, b, 0);
+            moved = true;
+            continue;
+
+        case BLK_SEQ_RET:
+            if (!f.seq_live)
+                break;
+
+            // On to the next call, or back to where we left off
+            if (f.seq_step < tape_uint(p->tape, p->index[f.seq_call].addr+1, 2))
+            {
+                f.block = seq_entry(p, f.seq_call, f.seq_step++);
+            }
+            else
+            {
+                f.block = f.seq_call + 1;
+                f.seq_live = 0;
+                f.seq_step = 0;
+            }
+            moved = true;
+            continue;
+
+        default:
+            break;
+        }
+
+        // A block that plays - or control flow that does nothing here - on the end of the run
+        if ((c.count > 0) && (b != c.first + c.count))
+            ok = end_run(&c);
+        if (c.count == 0)
+        {
+            c.first = b;
+            c.at = f;
+        }
+        c.count++;
+        f.block++;
+        idle = 0;
+    }
+    if (ok)
+        ok = end_run(&c);
+
+    free(c.seen);
+    free(c.hash);
+    if (!ok)
+    {
+        printf("Not enough memory for the playlist\n");
+        free(p->list);
+        p->list = NULL;
+        return false;
+    }
+
+    // Give back what was not used
+    if (p->steps > 0)
+        p->list = realloc(p->list, p->steps * sizeof(t_play_step));
+    return true;
+}
+
+// A step back: the step to play from - an earlier one, or the next if a loop is done
+static uint16_t step_back(t_player *p, uint16_t step)
+{
+    const t_play_step *st = &p->list[step];
+
+    // For ever - nothing is left of any loop
+    if (st->repeat == 0)
+    {
+        p->backs = 0;
+        return st->first;
+    }
+
+    // Round a loop - the first time here, it has been round once already
+    if ((p->backs == 0) || (p->back_step[p->backs - 1] != step))
+    {
+        if (p->backs == LOOP_DEPTH)
+            return step + 1;
+        p->back_step[p->backs] = step;
+        p->back_left[p->backs++] = st->repeat;
+    }
+    if (p->back_left[p->backs - 1] > 0)
+    {
+        p->back_left[p->backs - 1]--;
+        return st->first;
+    }
+    p->backs--;
+    return step + 1;
+}
+
+// Start on a step of the playlist, or end the tape after the last
+static void step_enter(t_player *p, uint16_t step)
+{
+    while ((step < p->steps) && (p->list[step].count == 0))
+        step = step_back(p, step);
+
+    p->step = step;
+    p->step_pos = 0;
+    if (step >= p->steps)
+    {
+        p->block = p->blocks;
+        return;
+    }
+    p->step_left = p->list[step].repeat - 1;
+    p->block = p->list[step].first;
+}
+
+// On to the next block in the playlist
+static void player_step(t_player *p)
+{
+    const t_play_step *st = &p->list[p->step];
+
+    if (++p->step_pos < st->count)
+    {
+        p->block = st->first + p->step_pos;
+        return;
+    }
+
+    // Round the run again, or on to the next step
+    if (p->step_left > 0)
+    {
+        p->step_left--;
+        p->step_pos = 0;
+        p->block = st->first;
+        return;
+    }
+    step_enter(p, p->step + 1);
+}
+
+// Start decoding a data block, it is played out by player_fill()
+static void player_begin(t_player *p, t_pulse_sink *s, t_block_desc *blk, uint32_t addr)
+{
+    block_begin(&p->dec, blk, p->tape, addr);
+    p->playing = true;
+    p->current = p->block;
+
+    if (p->telem != NULL)
+        telem_block_begin(p->telem, s, p->block, p->index[p->block].id);
+}
+
+// Act on the header of the current block - data blocks start a decoder
+static void player_next(t_player *p, t_pulse_sink *s)
+{
+    // Go to the block and pull in its fixed header
+    t_block_entry *e = &p->index[p->block];
+    uint8_t hdr[TZX_HDR_MAX];
+    tape_read(p->tape, e->addr, hdr, TZX_HDR_MAX);
+    // printf("%u: ID=%02x, L=%u\n", p->block, e->id, s->level);
+
+    // Data blocks (and pauses) are all handled by the decoder
+    t_block_desc blk;
+    uint8_t data = block_parse(e->id, hdr, &blk);
+    if (data)
+    {
+        if (p->speed != NULL)
+            block_scale(e->id, &blk, p->speed);
+
+        player_begin(p, s, &blk, e->addr + data);
+        return;
+    }
+
+    // The rest are just info, or need hardware or a screen
+    uint32_t addr = e->addr;
+    switch (e->id)
+    {
+    /*
+     * Behaviour Blocks
+     */
+    // Groups are only for display, and jumps, loops and sequences are in the playlist
+    case BLK_GROUP_START:
+    case BLK_GROUP_END:
+    case BLK_JUMP:
+    case BLK_LOOP_START:
+    case BLK_LOOP_END:
+    case BLK_SEQ_CALL:
+    case BLK_SEQ_RET:
+        break;
+
+    case BLK_SEL:
+        // Needs screen and menu to select an option
+
+        // Build the menu
+        uint8_t menu_size = hdr[3];
+        // Storage for the offsets
+        int16_t *offset = NULL;
+        offset = malloc(sizeof(int16_t) * menu_size);
+        // Storage for the names of the offsets
+        char(*names)[31] = malloc(sizeof(char[menu_size][31]));
+        // skip first 4 bytes
+        int x = 4;
+        for (uint8_t y = 0; y < menu_size; y++)
+        {
+            // Offset could be behind/in-front, so signed 16-bit
+            offset[y] = tape_uint(p->tape, addr+x, 2);
+            // Copy out the name
+            uint8_t name_len = tape_byte(p->tape, addr+x+2);
+            if (name_len > 30)
+                name_len = 30;
+            tape_read(p->tape, addr+x+3, (uint8_t *)names[y], name_len);
+            // Terminate the string by size byte
+            names[y][name_len] = '\0';
+            // skip name length + offset + size byte
+            x += tape_byte(p->tape, addr+x+2) + 3;
+            // We keep this printf() in to simulate the menu
+            // printf("%u) %s @ %d\n", y, names[y], p->block + offset[y]);
+        }
+
+        free(offset);
+        free(names);
+
+        break;
+
+    case BLK_STOP_48K:
+        // No way for us to detect the hardware
+        break;
+
+    case BLK_SIG_LEVEL:
+        // If the value doesn't match last level
+        if (s->level == hdr[5])
+        {
+            send_pulse(s, 0);
+        }
+        break;
+
+    /*
+     * Info Blocks - Mostly nothing to do
+     */
+    case BLK_TEXT:
+        break;
+    case BLK_INFO:
+    case BLK_HARDWARE:
+    case BLK_CUSTOM:
+    case BLK_GLUE:
+        break;
+
+    default:
+        break;
+    }
+}
+
+bool player_open(t_player *p, t_tape *t)
+{
+    p->tape = t;
+    p->built_in = false;
+    p->list = NULL;
+    p->playing = false;
+    p->duration = 0;
+    p->seek = NULL;
+    p->speed = NULL;
+    p->telem = NULL;
+    if (!index_tape(p))
+        return false;
+    if (!compile_playlist(p))
+    {
+        free(p->index);
+        p->index = NULL;
+        return false;
+    }
+
+    // The index is kept until the player is closed, for every replay
+    player_rewind(p);
+    return true;
+}
+
+bool player_open_index(t_player *p, t_tape *t, t_block_entry *index, uint16_t blocks)
+{
+    p->tape = t;
+    p->built_in = false;
+    p->list = NULL;
+    p->playing = false;
+    p->duration = 0;
+    p->seek = NULL;
+    p->speed = NULL;
+    p->telem = NULL;
+    p->index = index;
+    p->blocks = blocks;
+
+    p->format = tape_format(t);
+    if (!compile_playlist(p))
+    {
+        free(p->index);
+        p->index = NULL;
+        return false;
+    }
+
+    player_rewind(p);
+    return true;
+}
+
+void player_open_built(t_player *p, t_tape *t, const t_built_tape *b)
+{
+    p->tape = t;
+    p->built_in = true;
+    p->playing = false;
+    p->seek = NULL;
+    p->speed = NULL;
+    p->telem = NULL;
+
+    // Never written to - the player only reads them once they are made
+    p->format = b->format;
+    p->index = (t_block_entry *)b->index;
+    p->blocks = b->blocks;
+    p->list = (t_play_step *)b->list;
+    p->steps = b->steps;
+    p->duration = b->duration;
+
+    player_rewind(p);
+}
+
+// Note where play is, the first time it reaches the block about to start
+static void seek_mark(t_player *p, t_pulse_sink *s, uint64_t at)
+{
+    t_seek_point *m = &p->seek[p->block];
+    if (m->at != SEEK_NEVER)
+        return;
+
+    m->at = at;
+    m->step = p->step;
+    m->step_left = p->step_left;
+    m->level = s->level;
+}
+
+// Pick up play where it first reached a block
+static void seek_restore(t_player *p, t_pulse_sink *s, uint16_t block)
+{
+    const t_seek_point *m = &p->seek[block];
+
+    player_rewind(p);
+    p->block = block;
+    p->step = m->step;
+    p->step_pos = block - p->list[m->step].first;
+    p->step_left = m->step_left;
+    s->level = m->level;
+}
+
+/*
+ * Decode without playing, from *at (PIO cycles into the tape) until to.
+ * The sink holds each step's words while they are counted, so it must be
+ * empty, and what is left in it is what plays from there: the rest of the
+ * word the time falls in, and the words after it. Standard data skips
+ * its pilot, sync and whole bytes instead (see block_seek). False if the
+ * tape ends first
+ */
+static bool player_skip(t_player *p, t_pulse_sink *s, uint64_t *at, uint64_t to)
+{
+    uint64_t left = to - *at;
+
+    while (true)
+    {
+        s->pos = 0;
+        bool ended = false;
+
+        // One step of the player, as in player_fill()
+        if (p->playing)
+        {
+            if (block_seek(&p->dec, s, &left))
+            {
+                *at = to;
+                return true;
+            }
+            if (block_fill(&p->dec, s))
+                p->playing = false;
+        }
+        else if (p->block >= p->blocks)
+        {
+            ended = true;
+        }
+        else
+        {
+            if (p->seek != NULL)
+                seek_mark(p, s, to - left);
+            player_next(p, s);
+            player_step(p);
+        }
+
+        // Count the words off, until one takes it past the time
+        for (uint32_t i = 0; i < s->pos; i++)
+        {
+            uint32_t cycles = pulse_cycles(s->buf[i]);
+            if (cycles <= left)
+            {
+                left -= cycles;
+                continue;
+            }
+
+            // The rest of the step plays, the level stays as the whole step leaves it
+            uint32_t rest = s->pos - i;
+            memmove(s->buf, &s->buf[i], rest * sizeof(pulse_t));
+            s->pos = rest;
+            if (left > 0)
+            {
+                // Too little left for the shortest word is dropped, so the next word starts on time at its own level
+                cycles -= left;
+                if (cycles > ASM_OFFSET)
+                    s->buf[0] = cycles - ASM_OFFSET;
+                else
+                    memmove(s->buf, &s->buf[1], --s->pos * sizeof(pulse_t));
+            }
+            *at = to;
+            return true;
+        }
+
+        if (ended)
+        {
+            s->pos = 0;
+            *at = to - left;
+            return false;
+        }
+    }
+}
+
+uint64_t player_duration(t_player *p, t_pulse_sink *s)
+{
+    uint64_t cycles = 0;
+    uint8_t level = s->level;
+    t_telemetry *telem = p->telem;
+
+    // Not a real play, so not timed
+    p->telem = NULL;
+    player_rewind(p);
+
+    // Blocks are noted as they are reached, if there is room
+    free(p->seek);
+    p->seek = malloc(p->blocks * sizeof(t_seek_point));
+    for (uint16_t i = 0; (p->seek != NULL) && (i < p->blocks); i++)
+        p->seek[i].at = SEEK_NEVER;
+
+    if (player_skip(p, s, &cycles, DURATION_MAX * PULSE_SCALE))
+        cycles = 0;
+    s->pos = 0;
+
+    // Leave it as it was found
+    player_rewind(p);
+    s->level = level;
+    p->telem = telem;
+
+    p->duration = cycles / PULSE_SCALE;
+    return p->duration;
+}
+
+// Where the blocks are reached, worked out the first time it is needed
+static bool seek_ready(t_player *p, t_pulse_sink *s)
+{
+    if (p->seek == NULL)
+        player_duration(p, s);
+    return p->seek != NULL;
+}
+
+bool player_seek_block(t_player *p, t_pulse_sink *s, uint16_t block)
+{
+    if (!seek_ready(p, s) || (block >= p->blocks) || (p->seek[block].at == SEEK_NEVER))
+        return false;
+
+    seek_restore(p, s, block);
+    return true;
+}
+
+bool player_seek_time(t_player *p, t_pulse_sink *s, uint64_t tstates)
+{
+    uint64_t to = tstates * PULSE_SCALE;
+    if (!seek_ready(p, s))
+        return false;
+
+    // The last block play reaches by then, and on from there
+    int32_t from = -1;
+    for (uint16_t i = 0; i < p->blocks; i++)
+    {
+        uint64_t at = p->seek[i].at;
+        if ((at <= to) && ((from < 0) || (at > p->seek[from].at)))
+            from = i;
+    }
+    if (from < 0)
+        return false;
+
+    t_telemetry *telem = p->telem;
+    uint64_t at = p->seek[from].at;
+    seek_restore(p, s, from);
+
+    // Not a real play, so not timed
+    p->telem = NULL;
+    bool found = player_skip(p, s, &at, to);
+    p->telem = telem;
+
+    // Part way through a block, it is timed from here
+    if ((telem != NULL) && p->playing)
+        telem_block_begin(telem, s, p->current, p->index[p->current].id);
+    return found;
+}
+
+bool player_set_speed(t_player *p, const t_speed *speed)
+{
+    // Blocks are reached at different times at another speed
+    if (speed != p->speed)
+    {
+        free(p->seek);
+        p->seek = NULL;
+    }
+
+    p->speed = NULL;
+    if (speed == NULL)
+        return true;
+
+    // Loaders that test the level or offer a menu are timed to the tape
+    for (uint16_t i = 0; i < p->blocks; i++)
+    {
+        if ((p->index[i].id == BLK_SIG_LEVEL) || (p->index[i].id == BLK_SEL))
+        {
+            printf("Level-sensitive tape, playing at normal speed\n");
+            return false;
+        }
+    }
+
+    p->speed = speed;
+    return true;
+}
+
+void player_set_telemetry(t_player *p, t_telemetry *t)
+{
+    p->telem = t;
+}
+
+void player_rewind(t_player *p)
+{
+    if (p->playing)
+        block_end(&p->dec);
+
+    p->playing = false;
+    p->backs = 0;
+    step_enter(p, 0);
+}
+
+bool player_play_once(t_player *p)
+{
+    bool forever = false;
+    for (uint16_t x = 0; x < p->steps; x++)
+    {
+        if ((p->list[x].count == 0) && (p->list[x].repeat == 0))
+        {
+            p->steps = x;
+            forever = true;
+        }
+    }
+    player_rewind(p);
+    return forever;
+}
+
+uint16_t player_walk(t_player *p)
+{
+    uint16_t block = p->block;
+    if (block < p->blocks)
+        player_step(p);
+    return block;
+}
+
+void player_prefetch(t_player *p)
+{
+    t_tape *t = p->tape;
+
+    // Play goes elsewhere next - read ahead from there, once the rest of this block is in
+    if (p->playing && (p->block < p->blocks) && (p->block != p->current + 1))
+    {
+        uint32_t end = (p->current + 1 < p->blocks) ? p->index[p->current + 1].addr : t->size;
+        if (end <= t->base + t->len)
+        {
+            tape_prefetch_at(t, p->index[p->block].addr);
+            return;
+        }
+    }
+    tape_prefetch(t);
+}
+
+bool player_fill(t_player *p, t_pulse_sink *s)
+{
+    if (p->telem != NULL)
+        telem_resume(p->telem, s);
+
+    while (true)
+    {
+        // Carry on with the current data block
+        if (p->playing)
+        {
+            if (!block_fill(&p->dec, s))
+            {
+                if (p->telem != NULL)
+                    telem_pause(p->telem, s);
+                return false;
+            }
+            p->playing = false;
+
+            if (p->telem != NULL)
+                telem_block_end(p->telem, s);
+        }
+
+        // While we have data...
+        if (p->block >= p->blocks)
+            return true;
+
+        // Room for a level change, if the block is one
+        if (pulse_space(s) == 0)
+            return false;
+
+        player_next(p, s);
+
+        // On to the next block in the playlist
+        player_step(p);
+    }
+}
+
+void player_close(t_player *p)
+{
+    player_rewind(p);
+    if (!p->built_in)
+    {
+        free(p->index);
+        free(p->list);
+    }
+    free(p->seek);
+    p->index = NULL;
+    p->list = NULL;
+    p->seek = NULL;
+}
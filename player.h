@@ -0,0 +1,208 @@
+#ifndef PLAYER_H
+#define PLAYER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "blocks.h"
+#include "pulse.h"
+#include "tapeio.h"
+#include "telemetry.h"
+
+/*
+ * Tape player
+ *
+ * Walks the blocks of a TZX / PZX / TAP, following jumps, loops and sequences,
+ * and decodes the data blocks into a pulse sink. Nothing here touches the
+ * hardware: on the Pico the sink goes to the DMA ring, on the host it goes
+ * to a file.
+ *
+ * Like the block decoders, player_fill() is resumable - it stops when the
+ * sink is short of space, and carries on from the same spot next time.
+ *
+ * Jumps, loops and sequences are worked out once, when the tape is opened,
+ * into a playlist: runs of blocks that play one after another, each some
+ * number of times over. A loop of plain blocks is one run, repeated as it
+ * plays rather than copied out. A loop with more control flow inside it
+ * (nested loops, calls, jumps) is followed round until it plays the same
+ * each time - usually the first time - and the rest of its times round
+ * are a step back to where it started. So the player only ever steps
+ * through the playlist, and always knows which block comes next. A tape
+ * that goes round forever ends its playlist with a step back for good.
+ */
+// Where a block starts, and its ID (BLK_TAP for all of a TAP's blocks)
+typedef struct t_block_entry
+{
+    uint32_t addr;
+    uint8_t id;
+} t_block_entry;
+
+// Starting size of the block index, it doubles from here as needed
+#define INDEX_MIN 64
+
+// Blocks first to first + count - 1, played repeat times - or with count 0,
+// a step back to step first, to play from there repeat more times, or with
+// repeat 0 for ever
+typedef struct t_play_step
+{
+    uint16_t first;
+    uint16_t count;
+    uint16_t repeat;
+} t_play_step;
+
+// Starting size of the playlist, and the most steps it can have
+#define PLAYLIST_MIN 16
+#define PLAYLIST_MAX UINT16_MAX
+
+// Loops inside loops, as deep as they are followed
+#define LOOP_DEPTH 8
+
+/*
+ * Seeking
+ *
+ * The first time play reaches each block, where it is on the tape and the
+ * state it is in - the level, and its place in the playlist - is noted, so
+ * play can start again from any block reached with nothing to decode
+ * first. A time that falls within a block is reached by decoding from the
+ * start of the block without playing. Standard data is skipped a byte at
+ * a time and starts again at the byte the time falls in, after a short
+ * pilot, so the loader can pick it up - and a time in its pilot or sync
+ * starts the pilot again, short, before the data. Anything else plays on
+ * from the time itself.
+ */
+#define SEEK_NEVER UINT64_MAX
+
+typedef struct t_seek_point
+{
+    uint64_t at; // PIO cycles from the start, SEEK_NEVER if play never gets there
+    uint16_t step;
+    uint16_t step_left;
+    uint8_t level;
+} t_seek_point;
+
+// What a tape is, from how it starts
+enum tape_formats
+{
+    TAPE_TAP, // Anything that is not one of the others
+    TAPE_TZX,
+    TAPE_PZX
+};
+
+typedef struct t_player
+{
+    t_tape *tape;
+    uint8_t format;
+
+    // Every block on the tape, found once when it is opened
+    t_block_entry *index;
+    uint16_t blocks;
+
+    // The order they play in
+    t_play_step *list;
+    uint16_t steps;
+
+    // The index and playlist are built in (const), not the player's to free
+    bool built_in;
+
+    // Running time in t-states, 0 if it has not been worked out
+    uint64_t duration;
+
+    // Where each block is first reached, NULL if it has not been worked out
+    t_seek_point *seek;
+
+    // Accelerated playback, NULL to play as recorded
+    const t_speed *speed;
+
+    // Block timings, NULL if not wanted
+    t_telemetry *telem;
+
+    // Next block, and where that is in the playlist: the step, how far
+    // into its run, and how many more times the run plays after this one
+    uint16_t block;
+    uint16_t step;
+    uint16_t step_pos;
+    uint16_t step_left;
+
+    // Steps back round a loop being played again, innermost last, and how many more times each has to go
+    uint16_t back_step[LOOP_DEPTH];
+    uint16_t back_left[LOOP_DEPTH];
+    uint8_t backs;
+
+    // Data block being decoded, if playing
+    uint16_t current;
+    bool playing;
+    t_decoder dec;
+} t_player;
+
+// Index the tape and get ready to play it, false if it is not valid
+bool player_open(t_player *p, t_tape *t);
+
+// Get ready to play with an index made earlier, which the player then owns
+bool player_open_index(t_player *p, t_tape *t, t_block_entry *index, uint16_t blocks);
+
+/*
+ * A tape built into the firmware by tappioca-embed, with everything
+ * player_open() works out at boot worked out when it was built instead:
+ * the block index, the playlist and the running time. The tape itself
+ * is in flash, and so are the tables.
+ */
+typedef struct t_built_tape
+{
+    const uint8_t *data;
+    uint32_t size;
+    uint8_t format;
+    const t_block_entry *index;
+    uint16_t blocks;
+    const t_play_step *list;
+    uint16_t steps;
+    uint64_t duration;
+} t_built_tape;
+
+// Get ready to play a built-in tape straight away, with nothing read or allocated
+void player_open_built(t_player *p, t_tape *t, const t_built_tape *b);
+
+// Longest running time worked out - anything longer is taken to loop forever
+#define DURATION_MAX ((uint64_t)FREQ * 3600 * 4)
+
+// Work out the running time, and where each block is reached, by decoding
+// the whole tape into the (empty) sink without playing it. 0 if it is over
+// DURATION_MAX
+uint64_t player_duration(t_player *p, t_pulse_sink *s);
+
+// Play faster (or as recorded, with NULL) from the next block on. Tapes with
+// level-sensitive blocks (0x28, 0x2B) are always played as recorded, false
+bool player_set_speed(t_player *p, const t_speed *speed);
+
+// Time each data block as it is decoded (or stop, with NULL)
+void player_set_telemetry(t_player *p, t_telemetry *t);
+
+// Go back to the start of the tape
+void player_rewind(t_player *p);
+
+// End the tape where it would go round forever, rather than going round
+// again - true if it does - and rewind
+bool player_play_once(t_player *p);
+
+// For tools that follow the blocks without playing them: the block play is
+// at, moving on to the next (p->blocks once the tape has ended)
+uint16_t player_walk(t_player *p);
+
+/*
+ * Play from a block, or from a time (in t-states) into the tape, instead of
+ * the start. Either needs where the blocks are reached, which is worked out
+ * by player_duration() the first time. The sink must be empty, and may
+ * have the first words to play in it afterwards. False if play never gets
+ * to the block, or the tape ends before the time
+ */
+bool player_seek_block(t_player *p, t_pulse_sink *s, uint16_t block);
+bool player_seek_time(t_player *p, t_pulse_sink *s, uint64_t tstates);
+
+// Refill the idle half of the tape window with what is read next - from
+// where play goes after this block, if it is not the one after it
+void player_prefetch(t_player *p);
+
+// Decode as much as fits in the sink, true once the tape has ended
+bool player_fill(t_player *p, t_pulse_sink *s);
+
+void player_close(t_player *p);
+
+#endif
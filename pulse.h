@@ -0,0 +1,122 @@
+#ifndef PULSE_H
+#define PULSE_H
+
+#include <stdint.h>
+#include <string.h> // memcpy
+
+// Timing
+#define FREQ 3500000 // ZX Spectrum 48k clock frequency
+// #define FREQ 3540000 // ZX Spectrum 128K clock frequency
+
+/*
+ * PIO timing, in state machine cycles
+ *
+ * A word of n > 0 takes n + 4 cycles: set, out, jmp !Y, then jmp Y-- runs
+ * n + 1 times. A zero word is just set, out, jmp !Y.
+ *
+ * pulsegen runs at the Spectrum clock, so a cycle is a t-state, and takes
+ * 16-bit counts. With PULSE_HIRES, pulsegen32 runs at PULSE_SCALE times the
+ * Spectrum clock and takes 32-bit counts, so pulses can be placed to a
+ * fraction of a t-state and holds of up to half a minute fit in one word.
+ */
+#define ASM_OFFSET 4 // We "lose" 4 cycles in prep
+#define ASM_FLIP 3   // A zero word still takes 3 cycles (set, out, jmp)
+
+#ifdef PULSE_HIRES
+#define PULSE_SCALE 36 // Cycles per t-state (126MHz for a 48K)
+#define PULSE_WORD_MAX UINT32_MAX
+typedef uint32_t pulse_t;
+#else
+#define PULSE_SCALE 1
+#define PULSE_WORD_MAX UINT16_MAX
+typedef uint16_t pulse_t;
+#endif
+
+/*
+ * Pulse sink
+ *
+ * Decoders write pulse words for the pulsegen PIO program into a chunk
+ * buffer, and whoever owns the sink passes full chunks on: to the DMA
+ * ring on the Pico, or to memory / a file in a host build.
+ *
+ * Each word is one pulse duration in cycles, less ASM_OFFSET. Every word
+ * played flips the output, a zero word simply flips it back straight away.
+ * Decoders mostly work in t-states (send_pulse), and in cycles where they
+ * can place an edge more finely than that (send_cycles).
+ */
+
+// Longest pulse that fits in one word, in cycles
+#define PULSE_MAX ((uint64_t)PULSE_WORD_MAX + ASM_OFFSET)
+
+// No single unit of decoder work (e.g. one Generalised symbol) needs more
+#define PULSE_UNIT 256
+// Size of the chunks handed over by the decoders
+#define PULSE_CHUNK 1024
+
+typedef struct t_pulse_sink
+{
+    pulse_t *buf;
+    uint32_t pos;
+    uint32_t size;
+
+    // Level the next pulse is played at
+    // "An emulator should put the current pulse_level to low when starting to play"
+    // First pulse will be HIGH, then go to LOW
+    uint8_t level;
+} t_pulse_sink;
+
+static inline void pulse_sink_init(t_pulse_sink *s, pulse_t *buf, uint32_t size)
+{
+    s->buf = buf;
+    s->pos = 0;
+    s->size = size;
+    s->level = 1;
+}
+
+static inline uint32_t pulse_space(const t_pulse_sink *s)
+{
+    return s->size - s->pos;
+}
+
+// Word for a pulse of duration t-states
+static inline pulse_t pulse_word(uint32_t duration)
+{
+    if (duration > 0)
+    {
+        // Send pulse with assembler offset
+        return duration * PULSE_SCALE - ASM_OFFSET;
+    }
+    // send nothing, means next pulse remains at this level
+    return 0;
+}
+
+// Send the pulse of duration t-states
+static inline void send_pulse(t_pulse_sink *s, uint32_t duration)
+{
+    s->buf[s->pos++] = pulse_word(duration);
+    // State tracker for signal levels - the PIO flips on every word
+    s->level ^= 1;
+}
+
+// Send a pulse of cycles (ASM_OFFSET + 1 to PULSE_MAX of them), or a zero word
+static inline void send_cycles(t_pulse_sink *s, uint64_t cycles)
+{
+    s->buf[s->pos++] = cycles ? cycles - ASM_OFFSET : 0;
+    s->level ^= 1;
+}
+
+// Cycles a word takes in the PIO
+static inline uint32_t pulse_cycles(pulse_t word)
+{
+    return word ? word + ASM_OFFSET : ASM_FLIP;
+}
+
+// Send a run of ready-made words
+static inline void send_words(t_pulse_sink *s, const pulse_t *words, uint32_t count)
+{
+    memcpy(&s->buf[s->pos], words, count * sizeof(pulse_t));
+    s->pos += count;
+    s->level ^= count & 1;
+}
+
+#endif
@@ -0,0 +1,21 @@
+/*
+ * Tapes packed by tappioca-pack:
+ * tap-basic.tap
+ * tzx-basic.tzx
+ */
+
+static const uint8_t pack_data[] = {
+	0x54, 0x50, 0x41, 0x4b, 0x01, 0x00, 0x02, 0x00, 0x02, 0x00, 0x00, 0x00, 0x74, 0x61, 0x70, 0x2d,
+	0x62, 0x61, 0x73, 0x69, 0x63, 0x2e, 0x74, 0x61, 0x70, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x26, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x74, 0x7a, 0x78, 0x2d, 0x62, 0x61, 0x73, 0x69, 0x63, 0x2e, 0x74, 0x7a,
+	0x78, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x36, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x68, 0x00, 0x00, 0x00,
+	0x90, 0x00, 0x00, 0x00, 0xc7, 0x00, 0x00, 0x00, 0x48, 0x0d, 0x13, 0x66, 0x60, 0x60, 0xf0, 0x70,
+	0xf5, 0xf1, 0xf1, 0x57, 0x00, 0x01, 0x5e, 0x06, 0x86, 0x06, 0x5e, 0x86, 0x47, 0xfc, 0x0c, 0xff,
+	0x19, 0xb8, 0x38, 0x19, 0xbe, 0x2a, 0x81, 0x65, 0x94, 0x78, 0xdd, 0x00, 0x83, 0xee, 0x07, 0xc5,
+	0x48, 0x0d, 0x8b, 0x8a, 0x08, 0x49, 0x2c, 0x48, 0x55, 0x94, 0x62, 0x14, 0x11, 0x78, 0xc1, 0x2c,
+	0xcc, 0xc0, 0xc0, 0xe0, 0xe1, 0xea, 0xe3, 0xe3, 0xaf, 0x00, 0x02, 0xbc, 0x0c, 0x0c, 0x0d, 0xbc,
+	0x0c, 0x8f, 0x80, 0xe2, 0xfc, 0x0c, 0xff, 0x19, 0xb8, 0x38, 0x19, 0xbe, 0x2a, 0x81, 0x25, 0x95,
+	0x78, 0xdd, 0x00, 0x4d, 0x4e, 0x0c, 0x47,
+};
@@ -0,0 +1,147 @@
+#include <stdio.h>  // printf
+#include <stdlib.h> // malloc
+#include <string.h> // memcmp
+#include "sidecar.h"
+
+#ifdef USE_FATFS
+#include "ff.h"
+
+// Entries read or written at a time
+#define IDX_BATCH 64
+
+static void put_uint(uint8_t *ptr, uint64_t value, int width)
+{
+    for (int x = 0; x < width; x++)
+        ptr[x] = (value >> (x * 8)) & 0xFF;
+}
+
+// "GAME.tzx" becomes "GAME.tzx.idx" - the extension stays, so GAME.tap next to it has its own
+static bool sidecar_name(const char *name, char *idx, uint32_t size)
+{
+    return snprintf(idx, size, "%s%s", name, IDX_EXT) < (int)size;
+}
+
+// What the start of the sidecar should be, up to the running time
+static bool sidecar_key(t_tape *t, const char *name, uint8_t key[IDX_HDR_SIZE])
+{
+    FILINFO fno;
+    if (f_stat(name, &fno) != FR_OK)
+        return false;
+
+    memset(key, 0, IDX_HDR_SIZE);
+    memcpy(key, IDX_MAGIC, 4);
+    key[4] = IDX_VERSION;
+    put_uint(key+8, t->size, 4);
+    put_uint(key+12, fno.fdate, 2);
+    put_uint(key+14, fno.ftime, 2);
+    put_uint(key+16, tape_crc32(t, TAPE_CHUNK), 4);
+    return true;
+}
+
+// Read the index back, if the sidecar matches the tape
+static bool sidecar_load(t_player *p, t_tape *t, const char *idx, const uint8_t key[IDX_HDR_SIZE])
+{
+    FIL fh;
+    UINT got;
+    uint8_t hdr[IDX_HDR_SIZE];
+    uint8_t buf[IDX_BATCH * IDX_ENTRY_SIZE];
+
+    if (f_open(&fh, idx, FA_READ) != FR_OK)
+        return false;
+
+    // Magic and version, then size, date, time and CRC
+    if ((f_read(&fh, hdr, IDX_HDR_SIZE, &got) != FR_OK) || (got != IDX_HDR_SIZE) ||
+        (memcmp(hdr, key, 5) != 0) || (memcmp(hdr+8, key+8, 12) != 0))
+    {
+        f_close(&fh);
+        return false;
+    }
+
+    uint16_t blocks = parse_uint(hdr+6, 2);
+    uint32_t size = IDX_HDR_SIZE + blocks * IDX_ENTRY_SIZE;
+    t_block_entry *index = malloc(blocks * sizeof(t_block_entry));
+    if ((index == NULL) || (f_size(&fh) != size))
+    {
+        free(index);
+        f_close(&fh);
+        return false;
+    }
+
+    for (uint16_t i = 0; i < blocks; i += IDX_BATCH)
+    {
+        uint16_t n = (blocks - i < IDX_BATCH) ? blocks - i : IDX_BATCH;
+        if ((f_read(&fh, buf, n * IDX_ENTRY_SIZE, &got) != FR_OK) || (got != n * IDX_ENTRY_SIZE))
+        {
+            free(index);
+            f_close(&fh);
+            return false;
+        }
+
+        for (uint16_t x = 0; x < n; x++)
+        {
+            index[i + x].addr = parse_uint(buf + x * IDX_ENTRY_SIZE, 4);
+            index[i + x].id = buf[x * IDX_ENTRY_SIZE + 4];
+        }
+    }
+    f_close(&fh);
+
+    if (!player_open_index(p, t, index, blocks))
+        return false;
+    p->duration = parse_uint(hdr+20, 4) | (uint64_t)parse_uint(hdr+24, 4) << 32;
+    return true;
+}
+
+// Save the index - a failure only means the next boot scans again
+static void sidecar_save(t_player *p, const char *idx, uint8_t key[IDX_HDR_SIZE])
+{
+    FIL fh;
+    UINT put;
+    uint8_t buf[IDX_BATCH * IDX_ENTRY_SIZE];
+
+    if (f_open(&fh, idx, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK)
+    {
+        printf("Cannot write %s\n", idx);
+        return;
+    }
+
+    key[5] = p->format;
+    put_uint(key+6, p->blocks, 2);
+    put_uint(key+20, p->duration, 8);
+    f_write(&fh, key, IDX_HDR_SIZE, &put);
+
+    for (uint16_t i = 0; i < p->blocks; i += IDX_BATCH)
+    {
+        uint16_t n = (p->blocks - i < IDX_BATCH) ? p->blocks - i : IDX_BATCH;
+        for (uint16_t x = 0; x < n; x++)
+        {
+            put_uint(buf + x * IDX_ENTRY_SIZE, p->index[i + x].addr, 4);
+            buf[x * IDX_ENTRY_SIZE + 4] = p->index[i + x].id;
+        }
+        f_write(&fh, buf, n * IDX_ENTRY_SIZE, &put);
+    }
+    f_close(&fh);
+}
+
+bool sidecar_open(t_player *p, t_tape *t, t_pulse_sink *s, const char *name)
+{
+    char idx[128];
+    uint8_t key[IDX_HDR_SIZE];
+
+    // Without a date to check against, or a name too long to add to, there is no trusting a sidecar
+    if (!sidecar_name(name, idx, sizeof(idx)) || !sidecar_key(t, name, key))
+        return player_open(p, t);
+
+    if (sidecar_load(p, t, idx, key))
+    {
+        printf("Index from %s: %u blocks\n", idx, p->blocks);
+        return true;
+    }
+
+    // Stale or missing - scan the tape, then save it for next time
+    if (!player_open(p, t))
+        return false;
+    player_duration(p, s);
+    sidecar_save(p, idx, key);
+    return true;
+}
+#endif
@@ -0,0 +1,45 @@
+#ifndef SIDECAR_H
+#define SIDECAR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "player.h"
+
+/*
+ * Sidecar index files
+ *
+ * Indexing a tape reads every block header, and its running time needs the
+ * whole tape decoding. Both are saved next to the tape the first time, with
+ * IDX_EXT added to its name (so "DIZZY7.tzx" gets "DIZZY7.tzx.idx", and a
+ * DIZZY7.tap beside it a sidecar of its own - this needs FatFs long file
+ * names), and read back on later boots - as long as the tape still has
+ * the same size, modified time and CRC-32 over its first TAPE_CHUNK bytes.
+ * If anything differs, the tape is scanned again and the sidecar rewritten.
+ *
+ * Layout, all little-endian:
+ *  0  "TPIX"
+ *  4  version
+ *  5  format (see tape_formats)
+ *  6  blocks
+ *  8  tape size
+ *  12 FAT date, time
+ *  16 CRC-32 of the head of the tape
+ *  20 running time in t-states (0 if not known)
+ *  28 per block: address (4), ID (1)
+ */
+#define IDX_MAGIC "TPIX"
+#define IDX_VERSION 1
+#define IDX_EXT ".idx"
+#define IDX_HDR_SIZE 28
+#define IDX_ENTRY_SIZE 5
+
+#ifdef USE_FATFS
+/*
+ * Open a player on the tape read from the file name, using its sidecar if
+ * it is still good, or indexing the tape and writing a new one. The sink is
+ * only used (empty) to work out the running time on a fresh scan.
+ */
+bool sidecar_open(t_player *p, t_tape *t, t_pulse_sink *s, const char *name);
+#endif
+
+#endif
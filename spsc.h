@@ -0,0 +1,80 @@
+#ifndef SPSC_H
+#define SPSC_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+/*
+ * Lock-free single-producer / single-consumer queue indexes
+ *
+ * Only the indexes live here - the caller owns a power-of-two sized buffer
+ * and uses (index & (size - 1)) to find a slot. head is only written by the
+ * producer and tail only by the consumer, so nothing needs a lock or a
+ * read-modify-write: plain loads and stores with acquire/release ordering
+ * are enough, which is all the Cortex-M0+ can do anyway.
+ *
+ * Both indexes are free-running, so head - tail is the number queued.
+ */
+typedef struct t_spsc
+{
+    _Atomic uint32_t head; // Written by the producer
+    _Atomic uint32_t tail; // Written by the consumer
+} t_spsc;
+
+static inline void spsc_init(t_spsc *q)
+{
+    atomic_store_explicit(&q->head, 0, memory_order_relaxed);
+    atomic_store_explicit(&q->tail, 0, memory_order_relaxed);
+}
+
+// Either side: entries queued (exact for the consumer, at most for the producer)
+static inline uint32_t spsc_count(t_spsc *q)
+{
+    uint32_t tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+    return atomic_load_explicit(&q->head, memory_order_acquire) - tail;
+}
+
+/*
+ * Producer side
+ */
+// Where the next entry goes
+static inline uint32_t spsc_head(t_spsc *q)
+{
+    return atomic_load_explicit(&q->head, memory_order_relaxed);
+}
+
+// Free slots - slots the consumer has released are safe to overwrite
+static inline uint32_t spsc_space(t_spsc *q, uint32_t size)
+{
+    uint32_t tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+    return size - (spsc_head(q) - tail);
+}
+
+// Make count entries written at spsc_head() visible to the consumer
+static inline void spsc_publish(t_spsc *q, uint32_t count)
+{
+    atomic_store_explicit(&q->head, spsc_head(q) + count, memory_order_release);
+}
+
+/*
+ * Consumer side
+ */
+// Where the next entry comes from
+static inline uint32_t spsc_tail(t_spsc *q)
+{
+    return atomic_load_explicit(&q->tail, memory_order_relaxed);
+}
+
+// Entries published and ready to read
+static inline uint32_t spsc_avail(t_spsc *q)
+{
+    return atomic_load_explicit(&q->head, memory_order_acquire) - spsc_tail(q);
+}
+
+// Hand count slots back to the producer once they have been read
+static inline void spsc_release(t_spsc *q, uint32_t count)
+{
+    atomic_store_explicit(&q->tail, spsc_tail(q) + count, memory_order_release);
+}
+
+#endif
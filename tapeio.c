@@ -0,0 +1,167 @@
+#include <string.h> // memset, memcpy
+#include "tapeio.h"
+
+#ifdef USE_FATFS
+#include "ff.h"
+#endif
+
+void tape_open_mem(t_tape *t, const uint8_t *data, uint32_t size)
+{
+    memset(t, 0, sizeof(*t));
+    t->size = size;
+
+    // The whole tape is the window, so tape_load() is only hit past the end
+    t->data = data;
+    t->len = size;
+}
+
+void tape_open(t_tape *t, tape_read_fn read, void *ctx, uint32_t size,
+               uint8_t (*window)[TAPE_CHUNK])
+{
+    memset(t, 0, sizeof(*t));
+    t->read = read;
+    t->ctx = ctx;
+    t->size = size;
+    t->half = window;
+
+    // Nothing loaded yet
+    t->half_base[0] = t->half_base[1] = UINT32_MAX;
+}
+
+// Load the chunk starting at base into one half of the window
+static void fill_half(t_tape *t, int h, uint32_t base)
+{
+    uint32_t len = t->size - base;
+    if (len > TAPE_CHUNK)
+        len = TAPE_CHUNK;
+
+    t->half_len[h] = t->read(t->ctx, base, t->half[h], len);
+    t->half_base[h] = base;
+}
+
+uint8_t tape_load(t_tape *t, uint32_t addr)
+{
+    if ((addr >= t->size) || (t->read == NULL))
+        return 0;
+
+    /*
+     * Sequential reads land in the other half, which should already
+     * have been prefetched - as should the block a jump, loop or call
+     * goes to next (tape_prefetch_at). Anything else is a miss.
+     */
+    uint32_t base = addr - (addr % TAPE_CHUNK);
+    int h = t->cur ^ 1;
+    if (t->half_base[h] != base)
+        fill_half(t, h, base);
+
+    // Swap halves - the old one is now free for tape_prefetch()
+    t->cur = h;
+    t->data = t->half[h];
+    t->base = t->half_base[h];
+    t->len = t->half_len[h];
+
+    if (addr - t->base >= t->len)
+        return 0; // Short read
+
+    return t->data[addr - t->base];
+}
+
+uint32_t tape_uint(t_tape *t, uint32_t addr, int width)
+{
+    uint32_t value = 0;
+    for (int x = 0; x < width; x++)
+        value |= (uint32_t)tape_byte(t, addr + x) << (x * 8);
+
+    return value;
+}
+
+uint32_t tape_read(t_tape *t, uint32_t addr, uint8_t *dst, uint32_t len)
+{
+    uint32_t done = 0;
+
+    while (done < len)
+    {
+        // Make sure addr is in the window, then copy what we can
+        if (addr - t->base >= t->len)
+        {
+            if ((addr >= t->size) || (t->read == NULL))
+                break;
+            tape_load(t, addr);
+            if (addr - t->base >= t->len)
+                break;
+        }
+
+        uint32_t n = t->len - (addr - t->base);
+        if (n > len - done)
+            n = len - done;
+        memcpy(dst + done, t->data + (addr - t->base), n);
+
+        addr += n;
+        done += n;
+    }
+
+    // Past the end of tape reads as zeros
+    memset(dst + done, 0, len - done);
+
+    return done;
+}
+
+void tape_prefetch(t_tape *t)
+{
+    if (t->read == NULL)
+        return;
+
+    uint32_t next = t->base + t->len;
+    int h = t->cur ^ 1;
+    if ((t->len == TAPE_CHUNK) && (next < t->size) && (t->half_base[h] != next))
+        fill_half(t, h, next);
+}
+
+void tape_prefetch_at(t_tape *t, uint32_t addr)
+{
+    if ((t->read == NULL) || (addr >= t->size))
+        return;
+
+    uint32_t base = addr - (addr % TAPE_CHUNK);
+    int h = t->cur ^ 1;
+    if ((t->base != base) && (t->half_base[h] != base))
+        fill_half(t, h, base);
+}
+
+uint32_t tape_crc32(t_tape *t, uint32_t len)
+{
+    // A nibble at a time, as zip
+    static const uint32_t nibble[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C};
+    uint32_t crc = 0xFFFFFFFF;
+
+    if (len > t->size)
+        len = t->size;
+    for (uint32_t i = 0; i < len; i++)
+    {
+        crc ^= tape_byte(t, i);
+        crc = (crc >> 4) ^ nibble[crc & 0x0F];
+        crc = (crc >> 4) ^ nibble[crc & 0x0F];
+    }
+    return ~crc;
+}
+
+#ifdef USE_FATFS
+uint32_t tape_read_fatfs(void *ctx, uint32_t addr, uint8_t *dst, uint32_t len)
+{
+    FIL *fh = ctx;
+    UINT got = 0;
+
+    if (f_tell(fh) != addr)
+    {
+        if (f_lseek(fh, addr) != FR_OK)
+            return 0;
+    }
+
+    if (f_read(fh, dst, len, &got) != FR_OK)
+        return 0;
+
+    return got;
+}
+#endif
@@ -0,0 +1,81 @@
+#ifndef TAPEIO_H
+#define TAPEIO_H
+
+#include <stdint.h>
+
+/*
+ * Streaming tape reader
+ *
+ * Tapes are read through a bounded window rather than being loaded into
+ * memory whole. The window is two halves of TAPE_CHUNK bytes: one is being
+ * read by the decoders while the other can be refilled in the background
+ * (tape_prefetch) while the PIO drains pulses.
+ *
+ * Tapes embedded in flash are read in-place, with no copying at all.
+ */
+
+// Size of each half of the read window - a multiple of the SD sector size
+#define TAPE_CHUNK 4096
+
+// Source callback: copy len bytes from addr into dst, returns bytes copied
+typedef uint32_t (*tape_read_fn)(void *ctx, uint32_t addr, uint8_t *dst, uint32_t len);
+
+typedef struct t_tape
+{
+    // Data source
+    tape_read_fn read;
+    void *ctx;
+    uint32_t size;
+
+    // Bytes currently readable without a refill: [base, base + len)
+    const uint8_t *data;
+    uint32_t base;
+    uint32_t len;
+
+    // Double-buffered window (unused for in-memory tapes)
+    uint8_t (*half)[TAPE_CHUNK];
+    uint32_t half_base[2];
+    uint32_t half_len[2];
+    uint8_t cur;
+} t_tape;
+
+// Tape already in memory (e.g. embedded in flash)
+void tape_open_mem(t_tape *t, const uint8_t *data, uint32_t size);
+
+// Tape read via a callback, using a caller-supplied two-half window
+void tape_open(t_tape *t, tape_read_fn read, void *ctx, uint32_t size,
+               uint8_t (*window)[TAPE_CHUNK]);
+
+// Slow path of tape_byte() - swaps or refills the window
+uint8_t tape_load(t_tape *t, uint32_t addr);
+
+// Read a single byte, zero if past the end of the tape
+static inline uint8_t tape_byte(t_tape *t, uint32_t addr)
+{
+    if (addr - t->base < t->len)
+        return t->data[addr - t->base];
+
+    return tape_load(t, addr);
+}
+
+// Little-endian value of 1-4 bytes
+uint32_t tape_uint(t_tape *t, uint32_t addr, int width);
+
+// Copy a run of bytes, zero-filling past the end of the tape
+uint32_t tape_read(t_tape *t, uint32_t addr, uint8_t *dst, uint32_t len);
+
+// Refill the idle half of the window with the next chunk, if needed
+void tape_prefetch(t_tape *t);
+
+// Refill the idle half with the chunk holding addr instead, for a jump ahead of time
+void tape_prefetch_at(t_tape *t, uint32_t addr);
+
+// CRC-32 (as zip) of the first len bytes of the tape, or all of it if shorter
+uint32_t tape_crc32(t_tape *t, uint32_t len);
+
+#ifdef USE_FATFS
+// Source callback for an open FatFs file (ctx is a FIL *)
+uint32_t tape_read_fatfs(void *ctx, uint32_t addr, uint8_t *dst, uint32_t len);
+#endif
+
+#endif
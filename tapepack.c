@@ -0,0 +1,119 @@
+#include <string.h> // memcmp, memcpy, strcmp
+#include "tapepack.h"
+
+bool pack_open(t_pack *p, const uint8_t *data, uint32_t size)
+{
+    memset(p, 0, sizeof(*p));
+    tape_open_mem(&p->src, data, size);
+    if ((size < PACK_HDR_SIZE) || memcmp(data, PACK_MAGIC, 4) || (tape_uint(&p->src, 4, 2) != PACK_VERSION))
+        return false;
+
+    p->count = tape_uint(&p->src, 6, 2);
+    p->chunks = tape_uint(&p->src, 8, 4);
+    p->table = PACK_HDR_SIZE + (uint32_t)p->count * PACK_ENTRY_SIZE;
+
+    // The table has to fit, and so does the last chunk
+    if ((p->table > size) || (p->chunks >= (size - p->table) / 4))
+        return false;
+    return tape_uint(&p->src, p->table + p->chunks * 4, 4) <= size;
+}
+
+bool pack_get(t_pack *p, uint16_t n, t_pack_entry *e)
+{
+    if (n >= p->count)
+        return false;
+
+    uint32_t at = PACK_HDR_SIZE + (uint32_t)n * PACK_ENTRY_SIZE;
+    tape_read(&p->src, at, (uint8_t *)e->name, PACK_NAME);
+    e->name[PACK_NAME - 1] = '\0';
+    e->size = tape_uint(&p->src, at + PACK_NAME, 4);
+    e->chunk = tape_uint(&p->src, at + PACK_NAME + 4, 4);
+
+    // Every chunk of the tape has to be there
+    return (e->chunk <= p->chunks) && ((e->size + TAPE_CHUNK - 1) / TAPE_CHUNK <= p->chunks - e->chunk);
+}
+
+int32_t pack_find(t_pack *p, const char *name)
+{
+    t_pack_entry e;
+
+    for (uint16_t n = 0; n < p->count; n++)
+    {
+        if (pack_get(p, n, &e) && !strcmp(e.name, name))
+            return n;
+    }
+    return -1;
+}
+
+bool pack_tape_open(t_pack *p, uint16_t n, t_pack_reader *r, t_tape *t, uint8_t (*window)[TAPE_CHUNK])
+{
+    t_pack_entry e;
+
+    if (!pack_get(p, n, &e))
+        return false;
+
+    r->pack = p;
+    r->first = e.chunk;
+    r->size = e.size;
+    r->chunk = UINT32_MAX;
+    tape_open(t, tape_read_pack, r, e.size, window);
+    return true;
+}
+
+// Inflate chunk n of the tape into dst, false if it is damaged
+static bool inflate_chunk(t_pack_reader *r, uint32_t n, uint8_t *dst, uint32_t len)
+{
+    t_pack *p = r->pack;
+    uint32_t at = p->table + (r->first + n) * 4;
+    uint32_t start = tape_uint(&p->src, at, 4);
+    uint32_t end = tape_uint(&p->src, at + 4, 4);
+
+    r->chunk = UINT32_MAX;
+    if ((end < start) || (zinf_init_window(&r->z, &p->src, start, end - start, r->window, TAPE_CHUNK) < 0))
+        return false;
+    if (zinf_read(&r->z, dst, len) != len)
+        return false;
+
+    r->chunk = n;
+    return true;
+}
+
+uint32_t tape_read_pack(void *ctx, uint32_t addr, uint8_t *dst, uint32_t len)
+{
+    t_pack_reader *r = ctx;
+    uint32_t done = 0;
+
+    while ((done < len) && (addr < r->size))
+    {
+        uint32_t n = addr / TAPE_CHUNK;
+        uint32_t from = addr % TAPE_CHUNK;
+        uint32_t chunk_len = r->size - n * TAPE_CHUNK;
+        if (chunk_len > TAPE_CHUNK)
+            chunk_len = TAPE_CHUNK;
+        uint32_t take = chunk_len - from;
+        if (take > len - done)
+            take = len - done;
+
+        if ((n != r->chunk) && (from == 0) && (take == chunk_len))
+        {
+            // A whole chunk, as the window asks for - straight in
+            if (!inflate_chunk(r, n, dst + done, chunk_len))
+                break;
+        }
+        else
+        {
+            /*
+             * Part of one: it is inflated into the history window itself,
+             * which then holds the whole chunk (as it starts from nothing,
+             * and is as big as a chunk) for the rest to be copied from
+             */
+            if ((n != r->chunk) && !inflate_chunk(r, n, r->window, chunk_len))
+                break;
+            memcpy(dst + done, r->window + from, take);
+        }
+
+        addr += take;
+        done += take;
+    }
+    return done;
+}
@@ -0,0 +1,84 @@
+#ifndef TAPEPACK_H
+#define TAPEPACK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "tapeio.h"
+#include "zinflate.h"
+
+/*
+ * Packed tape library
+ *
+ * Several tapes compressed into one archive, for boards with no SD card:
+ * tappioca-pack writes it as a header to build in, and it is read in place
+ * from flash. Each tape is cut into TAPE_CHUNK byte chunks, and each chunk
+ * is a zlib stream of its own, so any chunk can be inflated without the
+ * ones before it - a jump, loop or seek costs no more than playing on.
+ *
+ * A tape is read through the usual two-half window (see tapeio.h), with
+ * tape_read_pack() inflating a chunk into a half as it is needed. The only
+ * other RAM is one chunk of history, however big the tapes are.
+ *
+ * Layout, all little-endian:
+ *  0  "TPAK"
+ *  4  version (2)
+ *  6  tapes (2)
+ *  8  chunks
+ *  12 tapes, PACK_ENTRY_SIZE each: name, size (4), first chunk (4)
+ *  .. chunks + 1 offsets (4) from the start of the archive - each chunk
+ *     runs up to where the next one starts
+ *  .. the chunks
+ */
+#define PACK_MAGIC "TPAK"
+#define PACK_VERSION 1
+
+// Longest name kept, with the terminator
+#define PACK_NAME 32
+
+#define PACK_HDR_SIZE 12
+#define PACK_ENTRY_SIZE (PACK_NAME + 4 + 4)
+
+typedef struct t_pack_entry
+{
+    char name[PACK_NAME];
+    uint32_t size;  // Unpacked
+    uint32_t chunk; // First chunk
+} t_pack_entry;
+
+typedef struct t_pack
+{
+    t_tape src; // The archive itself, read in place
+    uint16_t count;
+    uint32_t chunks;
+    uint32_t table; // Where the chunk offsets start
+} t_pack;
+
+// A tape being read out of the pack
+typedef struct t_pack_reader
+{
+    t_pack *pack;
+    uint32_t first;
+    uint32_t size;
+
+    // The chunk last inflated is kept whole in the history window
+    uint32_t chunk;
+    t_zinflate z;
+    uint8_t window[TAPE_CHUNK];
+} t_pack_reader;
+
+// Open an archive in memory, false if it is not one
+bool pack_open(t_pack *p, const uint8_t *data, uint32_t size);
+
+// Tape n, false if there is no such tape
+bool pack_get(t_pack *p, uint16_t n, t_pack_entry *e);
+
+// Number of the tape with this name, -1 if it is not in the pack
+int32_t pack_find(t_pack *p, const char *name);
+
+// Open tape n for reading through the window, with r doing the inflating
+bool pack_tape_open(t_pack *p, uint16_t n, t_pack_reader *r, t_tape *t, uint8_t (*window)[TAPE_CHUNK]);
+
+// Source callback for a packed tape (ctx is a t_pack_reader *)
+uint32_t tape_read_pack(void *ctx, uint32_t addr, uint8_t *dst, uint32_t len);
+
+#endif
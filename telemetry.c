@@ -0,0 +1,115 @@
+#include <stdio.h>  // printf
+#include <string.h> // memset
+#include "telemetry.h"
+
+// PIO cycles in a millisecond
+#define CYCLES_MS ((double)FREQ * PULSE_SCALE / 1000)
+
+void telem_init(t_telemetry *t, uint64_t (*now_us)(void))
+{
+    t->now_us = now_us;
+    telem_reset(t);
+}
+
+void telem_reset(t_telemetry *t)
+{
+    memset(&t->cur, 0, sizeof(t->cur));
+    memset(t->worst, 0, sizeof(t->worst));
+    t->timing = false;
+    t->blocks = 0;
+    t->produce_us = 0;
+    t->play_cycles = 0;
+    t->headroom = UINT32_MAX;
+    t->stalls = 0;
+}
+
+// a was slower than b to decode, for the time each plays
+static bool slower(const t_block_time *a, const t_block_time *b)
+{
+    return (uint64_t)a->produce_us * b->play_cycles > (uint64_t)b->produce_us * a->play_cycles;
+}
+
+void telem_block_begin(t_telemetry *t, const t_pulse_sink *s, uint16_t block, uint8_t id)
+{
+    t->cur.block = block;
+    t->cur.id = id;
+    t->cur.produce_us = 0;
+    t->cur.play_cycles = 0;
+    t->cur.headroom = UINT32_MAX;
+    t->timing = true;
+    t->since = t->now_us();
+    t->mark = s->pos;
+}
+
+void telem_resume(t_telemetry *t, const t_pulse_sink *s)
+{
+    t->since = t->now_us();
+    t->mark = s->pos;
+}
+
+void telem_pause(t_telemetry *t, const t_pulse_sink *s)
+{
+    if (!t->timing)
+        return;
+
+    t->cur.produce_us += t->now_us() - t->since;
+    for (uint32_t i = t->mark; i < s->pos; i++)
+        t->cur.play_cycles += pulse_cycles(s->buf[i]);
+    t->mark = s->pos;
+}
+
+void telem_block_end(t_telemetry *t, const t_pulse_sink *s)
+{
+    telem_pause(t, s);
+    t->timing = false;
+
+    t->blocks++;
+    t->produce_us += t->cur.produce_us;
+    t->play_cycles += t->cur.play_cycles;
+    if (t->cur.play_cycles == 0)
+        return;
+
+    // A block played again (in a loop) is kept once, at its slowest
+    for (int x = 0; x < TELEM_WORST; x++)
+    {
+        if ((t->worst[x].play_cycles > 0) && (t->worst[x].block == t->cur.block))
+        {
+            if (!slower(&t->cur, &t->worst[x]))
+                return;
+            memmove(&t->worst[x], &t->worst[x + 1], (TELEM_WORST - 1 - x) * sizeof(t_block_time));
+            t->worst[TELEM_WORST - 1].play_cycles = 0;
+            break;
+        }
+    }
+
+    // Keep the worst few, slowest first
+    for (int x = 0; x < TELEM_WORST; x++)
+    {
+        if ((t->worst[x].play_cycles == 0) || slower(&t->cur, &t->worst[x]))
+        {
+            memmove(&t->worst[x + 1], &t->worst[x], (TELEM_WORST - 1 - x) * sizeof(t_block_time));
+            t->worst[x] = t->cur;
+            break;
+        }
+    }
+}
+
+void telem_print(const t_telemetry *t)
+{
+    printf("Decoded %u blocks in %.3f ms, for %.3f secs of tape\n", t->blocks,
+           (double)t->produce_us / 1000, t->play_cycles / CYCLES_MS / 1000);
+    if (t->headroom != UINT32_MAX)
+        printf("FIFO underruns: %u, fewest words queued: %u\n", t->stalls, t->headroom);
+    else
+        printf("FIFO underruns: %u\n", t->stalls);
+
+    for (int x = 0; (x < TELEM_WORST) && (t->worst[x].play_cycles > 0); x++)
+    {
+        const t_block_time *b = &t->worst[x];
+        printf("  Block %u (%02x): %.3f ms to decode, %.3f ms to play", b->block, b->id,
+               (double)b->produce_us / 1000, b->play_cycles / CYCLES_MS);
+        if (b->headroom != UINT32_MAX)
+            printf(", %u words queued", b->headroom);
+        printf("\n");
+    }
+}
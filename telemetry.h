@@ -0,0 +1,79 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "pulse.h"
+
+/*
+ * Playback telemetry
+ *
+ * When a tape fails to load, this says whether the PIO ran dry and which
+ * blocks were slow to decode. The player times each data block while it is
+ * decoded (produce time), and counts the PIO cycles of the words it made
+ * (play time). The caller adds how many words were queued ahead of the PIO
+ * each time it hands a chunk over (headroom), and how many times the PIO
+ * was found stalled on an empty FIFO.
+ *
+ * Nothing is printed while the tape plays - telem_print() is for after it
+ * has ended. Time comes from a callback, so the same counters work on the
+ * host, where the PIO and its FIFO are modelled instead.
+ */
+// Blocks kept that were slowest to decode for their length
+#define TELEM_WORST 4
+
+typedef struct t_block_time
+{
+    uint16_t block;
+    uint8_t id;
+    uint32_t produce_us;  // Decoding it
+    uint64_t play_cycles; // Playing it, in PIO cycles
+    uint32_t headroom;    // Fewest words queued while it was decoded
+} t_block_time;
+
+typedef struct t_telemetry
+{
+    uint64_t (*now_us)(void);
+
+    // Block being decoded, and where it was up to when the sink last filled
+    t_block_time cur;
+    bool timing;
+    uint64_t since;
+    uint32_t mark;
+
+    // Whole tape
+    uint32_t blocks;
+    uint64_t produce_us;
+    uint64_t play_cycles;
+    uint32_t headroom;
+    uint32_t stalls;
+
+    t_block_time worst[TELEM_WORST];
+} t_telemetry;
+
+void telem_init(t_telemetry *t, uint64_t (*now_us)(void));
+
+// Clear the counters for another play of the tape
+void telem_reset(t_telemetry *t);
+
+/*
+ * Called by the player: a data block starting and ending, and the player
+ * resuming and stopping as the sink is emptied and filled
+ */
+void telem_block_begin(t_telemetry *t, const t_pulse_sink *s, uint16_t block, uint8_t id);
+void telem_block_end(t_telemetry *t, const t_pulse_sink *s);
+void telem_resume(t_telemetry *t, const t_pulse_sink *s);
+void telem_pause(t_telemetry *t, const t_pulse_sink *s);
+
+// Called by whoever empties the sink: words still queued ahead of the PIO
+static inline void telem_queued(t_telemetry *t, uint32_t words)
+{
+    if (words < t->cur.headroom)
+        t->cur.headroom = words;
+    if (words < t->headroom)
+        t->headroom = words;
+}
+
+void telem_print(const t_telemetry *t);
+
+#endif
@@ -0,0 +1,365 @@
+#include <stdlib.h> // malloc
+#include <string.h> // memset
+#include "zinflate.h"
+
+enum zinf_states
+{
+    ZI_BLOCK, // Next thing is a block header
+    ZI_STORED,
+    ZI_HUFF,
+    ZI_DONE,
+    ZI_ERROR
+};
+
+// Length and distance codes: base value and extra bits
+static const uint16_t len_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t len_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t dist_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const uint8_t dist_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+// Order the code length code lengths are sent in
+static const uint8_t clen_order[19] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+static uint8_t zinf_byte(t_zinflate *z)
+{
+    // Running off the end reads zeros, which ends in an error soon enough
+    if (z->addr >= z->end)
+        return 0;
+    return tape_byte(z->tape, z->addr++);
+}
+
+// Next need bits, LSB first
+static uint32_t zinf_bits(t_zinflate *z, uint8_t need)
+{
+    while (z->bitcnt < need)
+    {
+        z->bitbuf |= (uint32_t)zinf_byte(z) << z->bitcnt;
+        z->bitcnt += 8;
+    }
+
+    uint32_t value = z->bitbuf & ((1u << need) - 1);
+    z->bitbuf >>= need;
+    z->bitcnt -= need;
+    return value;
+}
+
+// Build a code from a list of lengths, -1 if over-subscribed
+static int zinf_build(t_huffman *h, const uint8_t *length, int n)
+{
+    uint16_t offs[16];
+
+    memset(h->count, 0, sizeof(h->count));
+    for (int sym = 0; sym < n; sym++)
+        h->count[length[sym]]++;
+    if (h->count[0] == n)
+        return 0;
+
+    int left = 1;
+    for (int len = 1; len < 16; len++)
+    {
+        left <<= 1;
+        left -= h->count[len];
+        if (left < 0)
+            return -1;
+    }
+
+    offs[1] = 0;
+    for (int len = 1; len < 15; len++)
+        offs[len + 1] = offs[len] + h->count[len];
+
+    for (int sym = 0; sym < n; sym++)
+    {
+        if (length[sym] != 0)
+            h->symbol[offs[length[sym]]++] = sym;
+    }
+    return 0;
+}
+
+// Decode a symbol a bit at a time, -1 if the code is not in the table
+static int zinf_decode(t_zinflate *z, const t_huffman *h)
+{
+    int code = 0;
+    int first = 0;
+    int index = 0;
+
+    for (int len = 1; len < 16; len++)
+    {
+        code |= zinf_bits(z, 1);
+        int count = h->count[len];
+        if (code - count < first)
+            return h->symbol[index + (code - first)];
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+static int zinf_fixed(t_zinflate *z)
+{
+    uint8_t lengths[288 + 30];
+    int sym = 0;
+
+    for (; sym < 144; sym++)
+        lengths[sym] = 8;
+    for (; sym < 256; sym++)
+        lengths[sym] = 9;
+    for (; sym < 280; sym++)
+        lengths[sym] = 7;
+    for (; sym < 288; sym++)
+        lengths[sym] = 8;
+    for (; sym < 288 + 30; sym++)
+        lengths[sym] = 5;
+
+    zinf_build(&z->lencode, lengths, 288);
+    zinf_build(&z->distcode, lengths + 288, 30);
+    return 0;
+}
+
+static int zinf_dynamic(t_zinflate *z)
+{
+    uint8_t lengths[288 + 30];
+
+    int nlen = zinf_bits(z, 5) + 257;
+    int ndist = zinf_bits(z, 5) + 1;
+    int ncode = zinf_bits(z, 4) + 4;
+    if ((nlen > 286) || (ndist > 30))
+        return -1;
+
+    // Code length code, borrowing the length table while it is needed
+    memset(lengths, 0, 19);
+    for (int i = 0; i < ncode; i++)
+        lengths[clen_order[i]] = zinf_bits(z, 3);
+    if (zinf_build(&z->lencode, lengths, 19) < 0)
+        return -1;
+
+    // Literal / length and distance code lengths, run-length coded
+    int i = 0;
+    while (i < nlen + ndist)
+    {
+        int sym = zinf_decode(z, &z->lencode);
+        if (sym < 0)
+            return -1;
+
+        if (sym < 16)
+        {
+            lengths[i++] = sym;
+            continue;
+        }
+
+        uint8_t len = 0;
+        int repeat;
+        if (sym == 16)
+        {
+            if (i == 0)
+                return -1;
+            len = lengths[i - 1];
+            repeat = 3 + zinf_bits(z, 2);
+        }
+        else if (sym == 17)
+            repeat = 3 + zinf_bits(z, 3);
+        else
+            repeat = 11 + zinf_bits(z, 7);
+
+        if (i + repeat > nlen + ndist)
+            return -1;
+        while (repeat--)
+            lengths[i++] = len;
+    }
+
+    // Without an end-of-block code the block never ends
+    if (lengths[256] == 0)
+        return -1;
+
+    if (zinf_build(&z->lencode, lengths, nlen) < 0)
+        return -1;
+    if (zinf_build(&z->distcode, lengths + nlen, ndist) < 0)
+        return -1;
+    return 0;
+}
+
+// Read a block header - input is always there, so this never suspends
+static int zinf_block(t_zinflate *z)
+{
+    z->last = zinf_bits(z, 1);
+
+    switch (zinf_bits(z, 2))
+    {
+    case 0:
+    {
+        // Stored: byte aligned length and its complement
+        z->bitbuf = 0;
+        z->bitcnt = 0;
+        z->stored = zinf_byte(z);
+        z->stored |= zinf_byte(z) << 8;
+        uint16_t check = zinf_byte(z);
+        check |= zinf_byte(z) << 8;
+        check = ~check;
+        if (z->stored != check)
+            return -1;
+        z->state = ZI_STORED;
+        return 0;
+    }
+    case 1:
+        z->state = ZI_HUFF;
+        return zinf_fixed(z);
+    case 2:
+        z->state = ZI_HUFF;
+        return zinf_dynamic(z);
+    default:
+        return -1;
+    }
+}
+
+// Check the zlib header, and return the window size it asks for - 0 if unusable
+static uint32_t zinf_header(t_zinflate *z, t_tape *t, uint32_t addr, uint32_t len)
+{
+    memset(z, 0, sizeof(*z));
+    z->tape = t;
+    z->addr = addr;
+    z->end = addr + len;
+
+    // CMF / FLG: deflate, window size, no preset dictionary
+    uint8_t cmf = zinf_byte(z);
+    uint8_t flg = zinf_byte(z);
+    if ((((cmf << 8) | flg) % 31 != 0) || ((cmf & 0x0F) != 8) || (cmf >> 4 > 7) || (flg & 0x20))
+        return 0;
+
+    z->state = ZI_BLOCK;
+    return 1u << ((cmf >> 4) + 8);
+}
+
+int zinf_init(t_zinflate *z, t_tape *t, uint32_t addr, uint32_t len)
+{
+    uint32_t size = zinf_header(z, t, addr, len);
+    if (size == 0)
+        return -1;
+
+    z->window = z->own = malloc(size);
+    if (z->window == NULL)
+        return -1;
+    z->wmask = size - 1;
+
+    return 0;
+}
+
+int zinf_init_window(t_zinflate *z, t_tape *t, uint32_t addr, uint32_t len, uint8_t *window, uint32_t size)
+{
+    uint32_t need = zinf_header(z, t, addr, len);
+    if ((need == 0) || (need > size))
+        return -1;
+
+    // A bigger window than the stream needs does no harm
+    z->window = window;
+    z->wmask = size - 1;
+
+    return 0;
+}
+
+uint32_t zinf_read(t_zinflate *z, uint8_t *dst, uint32_t n)
+{
+    uint32_t got = 0;
+
+    while (got < n)
+    {
+        // Carry on with a back-reference first
+        if (z->copy_len > 0)
+        {
+            uint8_t c = z->window[(z->wpos - z->copy_dist) & z->wmask];
+            z->window[z->wpos++ & z->wmask] = c;
+            dst[got++] = c;
+            z->copy_len--;
+            continue;
+        }
+
+        switch (z->state)
+        {
+        case ZI_BLOCK:
+            if (zinf_block(z) < 0)
+                z->state = ZI_ERROR;
+            break;
+
+        case ZI_STORED:
+        {
+            if (z->stored == 0)
+            {
+                z->state = z->last ? ZI_DONE : ZI_BLOCK;
+                break;
+            }
+            uint8_t c = zinf_byte(z);
+            z->window[z->wpos++ & z->wmask] = c;
+            dst[got++] = c;
+            z->stored--;
+            break;
+        }
+
+        case ZI_HUFF:
+        {
+            int sym = zinf_decode(z, &z->lencode);
+            if (sym < 256)
+            {
+                if (sym < 0)
+                {
+                    z->state = ZI_ERROR;
+                    break;
+                }
+                // Literal
+                z->window[z->wpos++ & z->wmask] = sym;
+                dst[got++] = sym;
+                break;
+            }
+            if (sym == 256)
+            {
+                // End of block
+                z->state = z->last ? ZI_DONE : ZI_BLOCK;
+                break;
+            }
+
+            // Length / distance pair
+            sym -= 257;
+            if (sym >= 29)
+            {
+                z->state = ZI_ERROR;
+                break;
+            }
+            uint16_t len = len_base[sym] + zinf_bits(z, len_extra[sym]);
+
+            sym = zinf_decode(z, &z->distcode);
+            if ((sym < 0) || (sym >= 30))
+            {
+                z->state = ZI_ERROR;
+                break;
+            }
+            uint32_t dist = dist_base[sym] + zinf_bits(z, dist_extra[sym]);
+            if ((dist > z->wpos) || (dist > z->wmask + 1))
+            {
+                z->state = ZI_ERROR;
+                break;
+            }
+            z->copy_len = len;
+            z->copy_dist = dist;
+            break;
+        }
+
+        default:
+            // Done, or given up - the Adler-32 is not checked
+            return got;
+        }
+    }
+    return got;
+}
+
+void zinf_end(t_zinflate *z)
+{
+    free(z->own);
+    z->window = z->own = NULL;
+}
@@ -0,0 +1,67 @@
+#ifndef ZINFLATE_H
+#define ZINFLATE_H
+
+#include <stdint.h>
+#include "tapeio.h"
+
+/*
+ * Streaming zlib (RFC 1950) / deflate (RFC 1951) decompressor
+ *
+ * Compressed bytes are pulled straight off the tape as they are needed, and
+ * output is handed out a few bytes at a time: zinf_read() stops as soon as
+ * the caller has enough and carries on from the same spot on the next call.
+ * Memory is the history window (sized from the zlib header, 32KB at most)
+ * plus the Huffman tables, however long the stream is.
+ */
+
+// Canonical Huffman code: codes per length, then symbols in code order
+typedef struct t_huffman
+{
+    uint16_t count[16];
+    uint16_t symbol[288];
+} t_huffman;
+
+typedef struct t_zinflate
+{
+    t_tape *tape;
+    uint32_t addr;
+    uint32_t end;
+
+    // Bits read but not used yet
+    uint32_t bitbuf;
+    uint8_t bitcnt;
+
+    // History for back-references
+    uint8_t *window;
+    uint8_t *own; // Allocated by zinf_init(), freed by zinf_end()
+    uint32_t wmask;
+    uint32_t wpos;
+
+    // Where the stream is up to
+    uint8_t state;
+    uint8_t last;
+    uint16_t stored;
+    uint16_t copy_len;
+    uint16_t copy_dist;
+
+    t_huffman lencode;
+    t_huffman distcode;
+} t_zinflate;
+
+// Check the zlib header of len bytes at addr, 0 or -1 if unusable
+int zinf_init(t_zinflate *z, t_tape *t, uint32_t addr, uint32_t len);
+
+/*
+ * As zinf_init(), with a history window the caller owns, of size bytes (a
+ * power of two) - -1 if the stream needs a bigger one. Nothing is
+ * allocated, so many short streams can be read one after another without
+ * touching the heap.
+ */
+int zinf_init_window(t_zinflate *z, t_tape *t, uint32_t addr, uint32_t len, uint8_t *window, uint32_t size);
+
+// Decompress up to n bytes, fewer only at the end of the stream or on error
+uint32_t zinf_read(t_zinflate *z, uint8_t *dst, uint32_t n);
+
+void zinf_end(t_zinflate *z);
+
+#endif